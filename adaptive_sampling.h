@@ -0,0 +1,129 @@
+/*
+ * Edge-adaptive sparse tracing
+ * C++17, header-only
+ *
+ * Most of a frame is smooth sky or smooth disk; the structure that needs
+ * every ray is confined to the shadow edge, the photon ring and the disk
+ * edges. An adaptive frame traces a coarse grid of pixels, one every
+ * ADAPTIVE_CELL pixels plus the last row and column, and keeps each ray's
+ * lensing sample (kerr_physics.h). A cell whose four corner samples agree,
+ * with the same fate and disk-hit count, disk hits close together in the disk
+ * plane and escape directions close together on the sky (lensing
+ * magnification below ADAPTIVE_MAX_MAGNIFICATION), is filled by
+ * interpolating the corner samples and shading the result. The
+ * interpolation runs over ray geometry, not colour, so stars and disk
+ * texture stay sharp. Every other cell is traced pixel by pixel. What
+ * differences remain are isolated stars of the hashed starfield, which
+ * appear or vanish under sub-pixel changes of the escape direction; the
+ * scalar and packet integrators differ in the same way.
+ *
+ * blackhole_improved.comp implements the same grid and test (uAdaptivePass).
+ */
+
+#pragma once
+
+#include "kerr_physics.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace kerr {
+
+constexpr int ADAPTIVE_CELL = 4;
+// Largest disk-plane distance between corresponding hits of two corners,
+// relative to the hit radius, and largest relative redshift difference
+constexpr float ADAPTIVE_HIT_TOLERANCE = 0.1f;
+// Largest lensing magnification of an interpolated sky cell: the escape
+// directions of its corners may be at most this many times further apart
+// than the camera rays through them
+constexpr float ADAPTIVE_MAX_MAGNIFICATION = 8.0f;
+
+// Grid points of an adaptive frame: x = min(i * cell, width - 1) for
+// i < pointsX, likewise for y; cell (i, j) spans points i..i+1, j..j+1
+struct AdaptiveGrid {
+    int cell = ADAPTIVE_CELL;
+    int width = 0, height = 0;
+    int pointsX = 0, pointsY = 0;
+
+    AdaptiveGrid(int w, int h, int cellSize = ADAPTIVE_CELL)
+        : cell(std::max(cellSize, 1)), width(w), height(h),
+          pointsX((w - 1 + cell - 1) / cell + 1), pointsY((h - 1 + cell - 1) / cell + 1) {}
+
+    int pointX(int i) const { return std::min(i * cell, width - 1); }
+    int pointY(int j) const { return std::min(j * cell, height - 1); }
+    int cellsX() const { return std::max(pointsX - 1, 1); }
+    int cellsY() const { return std::max(pointsY - 1, 1); }
+    int points() const { return pointsX * pointsY; }
+    bool isPoint(int x, int y) const {
+        return (x % cell == 0 || x == width - 1) && (y % cell == 0 || y == height - 1);
+    }
+};
+
+// Escape tolerance for a frame: ADAPTIVE_MAX_MAGNIFICATION times the
+// angle across the diagonal of one cell
+inline float adaptiveEscapeTolerance(const RenderParams& p, int cell) {
+    float pixelAngle = 2.0f * std::tan(radians(p.fov) * 0.5f) / float(p.height);
+    return ADAPTIVE_MAX_MAGNIFICATION * float(cell) * 1.41421356f * pixelAngle;
+}
+
+inline Vec3 diskPlanePoint(float r, float phi) {
+    return {r * std::cos(phi), 0.0f, r * std::sin(phi)};
+}
+
+// Whether a cell with these corner samples can be filled by interpolation
+inline bool lensingSamplesAgree(const LensingSample* const corners[4], float escapeTolerance,
+                                float hitTolerance = ADAPTIVE_HIT_TOLERANCE) {
+    const LensingSample& a = *corners[0];
+    float minEscapeCos = std::cos(escapeTolerance);
+    for (int c = 1; c < 4; ++c) {
+        const LensingSample& b = *corners[c];
+        if (b.fate != a.fate || b.hits != a.hits) return false;
+        for (int k = 0; k < a.hits; ++k) {
+            float gap = length(diskPlanePoint(b.hitR[k], b.hitPhi[k]) - diskPlanePoint(a.hitR[k], a.hitPhi[k]));
+            if (gap > hitTolerance * a.hitR[k]) return false;
+            if (std::fabs(b.hitG[k] - a.hitG[k]) > hitTolerance * a.hitG[k]) return false;
+        }
+        if (a.fate == RayFate::Escaped) {
+            Vec3 da = escapeDirection(a.escapeTheta, a.escapePhi);
+            Vec3 db = escapeDirection(b.escapeTheta, b.escapePhi);
+            if (dot(da, db) < minEscapeCos) return false;
+        }
+    }
+    return true;
+}
+
+// Bilinear blend of four agreeing corner samples (00, 10, 01, 11) at
+// (tx, ty) in the cell. Azimuths are unwrapped against corner 00, and
+// escape directions are blended as vectors so the poles need no care.
+inline LensingSample interpolateLensing(const LensingSample* const corners[4], float tx, float ty) {
+    const float w[4] = {(1.0f - tx) * (1.0f - ty), tx * (1.0f - ty), (1.0f - tx) * ty, tx * ty};
+    const LensingSample& a = *corners[0];
+
+    LensingSample s;
+    s.fate = a.fate;
+    s.hits = a.hits;
+    for (int k = 0; k < a.hits; ++k) {
+        float r = 0.0f, phi = 0.0f, g = 0.0f;
+        for (int c = 0; c < 4; ++c) {
+            const LensingSample& b = *corners[c];
+            r += w[c] * b.hitR[k];
+            phi += w[c] * (a.hitPhi[k] + std::remainder(b.hitPhi[k] - a.hitPhi[k], TWO_PI));
+            g += w[c] * b.hitG[k];
+        }
+        s.hitR[k] = r;
+        s.hitPhi[k] = phi;
+        s.hitG[k] = g;
+    }
+    if (a.fate == RayFate::Escaped) {
+        Vec3 dir;
+        for (int c = 0; c < 4; ++c) {
+            dir += escapeDirection(corners[c]->escapeTheta, corners[c]->escapePhi) * w[c];
+        }
+        dir = normalize(dir);
+        s.escapeTheta = std::acos(clampf(dir.y, -1.0f, 1.0f));
+        s.escapePhi = std::atan2(dir.z, dir.x);
+    }
+    return s;
+}
+
+} // namespace kerr
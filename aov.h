@@ -0,0 +1,199 @@
+/*
+ * Diagnostic images (AOVs) - where the integration cost of a frame goes
+ * C++17, header-only
+ *
+ * Per traced pixel: accepted and rejected steps, why the ray stopped, its
+ * disk bounces, the largest scaled error of an accepted step (1 is the
+ * tolerance) and the radius it was last integrated to. blackhole_improved.comp
+ * writes them into an image2DArray when built with KERR_AOV
+ * (shader_variants.h); kerr_cpu --aov fills the same layout from the
+ * scalar integrator. Neither costs anything when they are off.
+ *
+ * An AovImage is that texture as glGetTexImage returns it: AOV_LAYERS
+ * layers of RGBA float texels, rows in GL texture order. Each channel is
+ * saved as a greyscale PFM with the raw values and as a false-colour PPM
+ * over the range AOV_CHANNELS gives it; the viewer's AOV display
+ * (shader_improved.frag) uses the same ranges and colours.
+ */
+
+#pragma once
+
+#include "kerr_physics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace kerr {
+
+// Why a ray stopped; AOV_END_NONE marks pixels no ray was traced for
+enum AovEnd : int {
+    AOV_END_NONE = 0,
+    AOV_END_HORIZON = 1,
+    AOV_END_ESCAPED = 2,
+    AOV_END_DISK = 3,       // bounce budget used up
+    AOV_END_STEPS = 4,      // step budget used up
+};
+
+constexpr int AOV_LAYERS = 2;
+constexpr int AOV_IMAGE_UNIT = 1;   // aovImage of blackhole_improved.comp
+constexpr int AOV_DISPLAY_UNIT = 2; // aovTexture of shader_improved.frag
+
+struct AovChannel {
+    const char* name;
+    int layer, component;   // texel of the channel
+    float lo, hi;           // false-colour range
+    bool logScale;
+    bool categorical;       // one colour per value instead of a range
+};
+
+// Layer 0: accepted, rejected, termination, bounces; layer 1: max error,
+// final r. shader_improved.frag repeats this table.
+constexpr AovChannel AOV_CHANNELS[] = {
+    {"steps_accepted", 0, 0, 0.0f, 256.0f, false, false},
+    {"steps_rejected", 0, 1, 0.0f, 32.0f, false, false},
+    {"termination", 0, 2, 0.0f, 4.0f, false, true},
+    {"bounces", 0, 3, 0.0f, 3.0f, false, false},
+    {"max_error", 1, 0, 1e-2f, 1.0f, true, false},
+    {"final_r", 1, 1, 1.0f, 150.0f, true, false},
+};
+constexpr int AOV_CHANNEL_COUNT = (int)(sizeof(AOV_CHANNELS) / sizeof(AOV_CHANNELS[0]));
+constexpr int AOV_TERMINATION = 2;  // index of the categorical channel
+
+inline const char* aovEndName(int end) {
+    static const char* const names[] = {"none", "horizon", "escaped", "disk", "steps"};
+    return end >= 0 && end <= AOV_END_STEPS ? names[end] : "?";
+}
+
+// Termination of a traced ray, as storeAov() of the shader decides it
+inline AovEnd aovEnd(const LensingSample& s, int maxBounces) {
+    if (s.fate == RayFate::Horizon) return AOV_END_HORIZON;
+    if (s.fate == RayFate::Escaped) return AOV_END_ESCAPED;
+    return s.hits >= maxBounces ? AOV_END_DISK : AOV_END_STEPS;
+}
+
+struct AovImage {
+    int width = 0, height = 0;
+    std::vector<float> texels;  // AOV_LAYERS x height x width x RGBA
+
+    void reset(int w, int h) {
+        width = w;
+        height = h;
+        texels.assign((size_t)AOV_LAYERS * w * h * 4, 0.0f);
+    }
+
+    float* texel(int layer, size_t pixel) { return &texels[((size_t)layer * width * height + pixel) * 4]; }
+    float value(const AovChannel& c, size_t pixel) const {
+        return texels[((size_t)c.layer * width * height + pixel) * 4 + c.component];
+    }
+
+    // One traced ray, or a pixel skipped inside the shadow (steps 0, horizon)
+    void store(size_t pixel, const StepCounts& steps, AovEnd end, int bounces, const RayDiagnostics& diag) {
+        float* t0 = texel(0, pixel);
+        t0[0] = (float)steps.accepted;
+        t0[1] = (float)steps.rejected;
+        t0[2] = (float)end;
+        t0[3] = (float)bounces;
+        float* t1 = texel(1, pixel);
+        t1[0] = diag.maxError;
+        t1[1] = diag.finalR;
+    }
+};
+
+// Google's polynomial fit of the Turbo colour map, t in [0, 1]
+inline void turboColor(float t, float rgb[3]) {
+    t = std::min(std::max(t, 0.0f), 1.0f);
+    float t2 = t * t, t3 = t2 * t, t4 = t2 * t2, t5 = t4 * t;
+    rgb[0] = 0.13572138f + 4.61539260f * t - 42.66032258f * t2 + 132.13108234f * t3 - 152.94239396f * t4 + 59.28637943f * t5;
+    rgb[1] = 0.09140261f + 2.19418839f * t + 4.84296658f * t2 - 14.18503333f * t3 + 4.27729857f * t4 + 2.82956604f * t5;
+    rgb[2] = 0.10667330f + 12.64194608f * t - 60.58204836f * t2 + 110.36276771f * t3 - 89.90310912f * t4 + 27.34824973f * t5;
+    for (int i = 0; i < 3; ++i) rgb[i] = std::min(std::max(rgb[i], 0.0f), 1.0f);
+}
+
+// Display colour of a channel value: the termination as one colour per
+// AovEnd (none black, horizon purple, escaped blue, disk orange, steps
+// red), everything else on the Turbo map over the channel's range
+inline void aovFalseColor(const AovChannel& c, float v, float rgb[3]) {
+    if (c.categorical) {
+        static const float palette[5][3] = {
+            {0.0f, 0.0f, 0.0f}, {0.35f, 0.1f, 0.5f}, {0.2f, 0.45f, 1.0f}, {1.0f, 0.6f, 0.1f}, {1.0f, 0.1f, 0.1f}};
+        int end = std::min(std::max((int)std::lround(v), 0), (int)AOV_END_STEPS);
+        std::copy(palette[end], palette[end] + 3, rgb);
+        return;
+    }
+    float t = c.logScale ? std::log(std::max(v, c.lo) / c.lo) / std::log(c.hi / c.lo) : (v - c.lo) / (c.hi - c.lo);
+    turboColor(t, rgb);
+}
+
+// Greyscale PFM: little-endian floats, rows bottom to top as in GL
+inline bool writePFM(const std::string& path, int width, int height, const std::vector<float>& values) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open()) {
+        std::cerr << "Failed to open " << path << std::endl;
+        return false;
+    }
+    out << "Pf\n" << width << " " << height << "\n-1.0\n";
+    out.write(reinterpret_cast<const char*>(values.data()), (std::streamsize)(values.size() * sizeof(float)));
+    return out.good();
+}
+
+// PREFIX_<channel>.pfm and PREFIX_<channel>.ppm for every channel
+inline bool writeAovImages(const std::string& prefix, const AovImage& aov) {
+    const size_t count = (size_t)aov.width * aov.height;
+    std::vector<float> values(count);
+    std::vector<uint8_t> rgb(count * 3);
+    for (const AovChannel& c : AOV_CHANNELS) {
+        for (size_t i = 0; i < count; ++i) values[i] = aov.value(c, i);
+        if (!writePFM(prefix + "_" + c.name + ".pfm", aov.width, aov.height, values)) return false;
+
+        // PPM rows run top to bottom
+        for (int y = 0; y < aov.height; ++y) {
+            for (int x = 0; x < aov.width; ++x) {
+                float color[3];
+                aovFalseColor(c, values[(size_t)(aov.height - 1 - y) * aov.width + x], color);
+                for (int k = 0; k < 3; ++k) rgb[((size_t)y * aov.width + x) * 3 + k] = (uint8_t)(color[k] * 255.0f + 0.5f);
+            }
+        }
+        std::string path = prefix + "_" + c.name + ".ppm";
+        std::ofstream out(path, std::ios::binary);
+        out << "P6\n" << aov.width << " " << aov.height << "\n255\n";
+        out.write(reinterpret_cast<const char*>(rgb.data()), (std::streamsize)rgb.size());
+        if (!out.good()) {
+            std::cerr << "Failed to write " << path << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Traced pixels per termination with their mean steps, and the largest
+// scaled error, e.g. "escaped 61.2% (112 steps)"
+inline void printAovSummary(std::ostream& out, const AovImage& aov) {
+    const AovChannel& accepted = AOV_CHANNELS[0];
+    const AovChannel& rejected = AOV_CHANNELS[1];
+    const AovChannel& termination = AOV_CHANNELS[AOV_TERMINATION];
+    const AovChannel& maxError = AOV_CHANNELS[4];
+    uint64_t pixels[AOV_END_STEPS + 1] = {};
+    double steps[AOV_END_STEPS + 1] = {};
+    float worst = 0.0f;
+    const size_t count = (size_t)aov.width * aov.height;
+    for (size_t i = 0; i < count; ++i) {
+        int end = std::min(std::max((int)aov.value(termination, i), 0), (int)AOV_END_STEPS);
+        pixels[end]++;
+        steps[end] += aov.value(accepted, i) + aov.value(rejected, i);
+        worst = std::max(worst, aov.value(maxError, i));
+    }
+    out << "AOV termination:";
+    for (int end = AOV_END_HORIZON; end <= AOV_END_STEPS; ++end) {
+        out << " " << aovEndName(end) << " " << 100.0 * (double)pixels[end] / (double)std::max<size_t>(count, 1) << "%";
+        if (pixels[end]) out << " (" << (int)(steps[end] / (double)pixels[end]) << " steps)";
+    }
+    if (pixels[AOV_END_NONE]) out << ", " << pixels[AOV_END_NONE] << " pixels untraced";
+    out << " | max scaled error " << worst << std::endl;
+}
+
+} // namespace kerr
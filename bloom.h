@@ -0,0 +1,152 @@
+/*
+ * Multi-level bloom
+ * C++17, header-only; include after the program's OpenGL declarations
+ * (GL/glew.h or gl_headless.h)
+ *
+ * Runs the passes of bloom.comp on a finished frame. The bright part of
+ * the frame is thresholded into a chain of BLOOM_LEVELS images at 1/2, 1/4
+ * and 1/8 of its size, each level is blurred with a separable Gaussian,
+ * and the levels are added back up into the half-size one, which then
+ * holds the bloom. Every pass works at half size or below, so the whole
+ * chain costs about a third of one full-size separable blur of the same
+ * reach.
+ *
+ * Either the display pass samples levels[0] (the viewer,
+ * shader_improved.frag) or apply() adds it into the frame itself
+ * (kerr_headless).
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+
+namespace kerr {
+
+constexpr int BLOOM_LEVELS = 3;                 // 1/2, 1/4, 1/8 of the frame
+constexpr float BLOOM_THRESHOLD = 0.8f;         // display value where bloom starts
+constexpr unsigned BLOOM_PARAMS_BINDING = 1;    // uniform buffer
+constexpr unsigned BLOOM_SOURCE_UNIT = 2;       // texture unit of a pass source
+constexpr unsigned BLOOM_TARGET_IMAGE = 1;      // image unit of a pass target
+constexpr unsigned BLOOM_FRAME_IMAGE = 0;       // image unit of the frame (outputImage)
+constexpr unsigned BLOOM_DISPLAY_UNIT = 1;      // texture unit shader_improved.frag reads the bloom from
+
+enum BloomPass : int32_t {
+    BLOOM_PREFILTER = 0,
+    BLOOM_DOWNSAMPLE = 1,
+    BLOOM_BLUR_H = 2,
+    BLOOM_BLUR_V = 3,
+    BLOOM_UPSAMPLE = 4,
+    BLOOM_COMPOSITE = 5
+};
+
+// std140 block BloomParams of bloom.comp
+struct alignas(16) BloomParams {
+    int32_t pass = BLOOM_PREFILTER;
+    float threshold = BLOOM_THRESHOLD;
+    float strength = 0.0f;
+};
+
+static_assert(sizeof(BloomParams) == 16, "std140 block size mismatch");
+
+struct BloomChain {
+    GLuint program = 0;
+    GLuint paramsBuffer = 0;
+    GLuint levels[BLOOM_LEVELS] = {};    // levels[0] holds the bloom after apply()
+    GLuint scratch[BLOOM_LEVELS] = {};   // horizontal blur of each level
+    int width[BLOOM_LEVELS] = {};
+    int height[BLOOM_LEVELS] = {};
+
+    // program is bloom.comp, linked; the frame is frameWidth x frameHeight
+    bool create(GLuint bloomProgram, int frameWidth, int frameHeight) {
+        if (!bloomProgram) {
+            std::cerr << "Bloom: no program" << std::endl;
+            return false;
+        }
+        program = bloomProgram;
+        glGenBuffers(1, &paramsBuffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, paramsBuffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(BloomParams), nullptr, GL_DYNAMIC_DRAW);
+
+        // Created on the source unit so the frame's binding on unit 0 stays
+        glActiveTexture(GL_TEXTURE0 + BLOOM_SOURCE_UNIT);
+        glGenTextures(BLOOM_LEVELS, levels);
+        glGenTextures(BLOOM_LEVELS, scratch);
+        for (int i = 0; i < BLOOM_LEVELS; ++i) {
+            width[i] = std::max(frameWidth >> (i + 1), 1);
+            height[i] = std::max(frameHeight >> (i + 1), 1);
+            for (GLuint texture : {levels[i], scratch[i]}) {
+                glBindTexture(GL_TEXTURE_2D, texture);
+                glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA16F, width[i], height[i]);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            }
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glActiveTexture(GL_TEXTURE0);
+        return true;
+    }
+
+    // Bloom of the frame in frameTexture (linear filtered, RGBA32F) into
+    // levels[0]; with composite, also strength times it added to the frame.
+    // The frame stays bound to image unit BLOOM_FRAME_IMAGE afterwards.
+    void apply(GLuint frameTexture, float strength, bool composite) {
+        glUseProgram(program);
+        glBindBufferBase(GL_UNIFORM_BUFFER, BLOOM_PARAMS_BINDING, paramsBuffer);
+        glActiveTexture(GL_TEXTURE0 + BLOOM_SOURCE_UNIT);
+
+        dispatch(BLOOM_PREFILTER, frameTexture, levels[0], 0, strength);
+        for (int i = 1; i < BLOOM_LEVELS; ++i) dispatch(BLOOM_DOWNSAMPLE, levels[i - 1], levels[i], i, strength);
+        for (int i = 0; i < BLOOM_LEVELS; ++i) {
+            dispatch(BLOOM_BLUR_H, levels[i], scratch[i], i, strength);
+            dispatch(BLOOM_BLUR_V, scratch[i], levels[i], i, strength);
+        }
+        for (int i = BLOOM_LEVELS - 2; i >= 0; --i) dispatch(BLOOM_UPSAMPLE, levels[i + 1], levels[i], i, strength);
+        if (composite) {
+            glBindImageTexture(BLOOM_FRAME_IMAGE, frameTexture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+            GLint frameWidth = 0, frameHeight = 0;
+            glBindTexture(GL_TEXTURE_2D, frameTexture);
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &frameWidth);
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &frameHeight);
+            upload(BLOOM_COMPOSITE, strength);
+            glBindTexture(GL_TEXTURE_2D, levels[0]);
+            glDispatchCompute((frameWidth + 15) / 16, (frameHeight + 15) / 16, 1);
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT |
+                            GL_TEXTURE_UPDATE_BARRIER_BIT);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    void destroy() {
+        if (paramsBuffer) glDeleteBuffers(1, &paramsBuffer);
+        if (levels[0]) glDeleteTextures(BLOOM_LEVELS, levels);
+        if (scratch[0]) glDeleteTextures(BLOOM_LEVELS, scratch);
+        paramsBuffer = 0;
+        std::fill(levels, levels + BLOOM_LEVELS, 0u);
+        std::fill(scratch, scratch + BLOOM_LEVELS, 0u);
+    }
+
+private:
+    void upload(BloomPass pass, float strength) {
+        BloomParams params;
+        params.pass = pass;
+        params.strength = strength;
+        glBindBuffer(GL_UNIFORM_BUFFER, paramsBuffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(params), &params);
+    }
+
+    // One pass from source into target, which is level-sized
+    void dispatch(BloomPass pass, GLuint source, GLuint target, int level, float strength) {
+        upload(pass, strength);
+        glBindTexture(GL_TEXTURE_2D, source);
+        glBindImageTexture(BLOOM_TARGET_IMAGE, target, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA16F);
+        glDispatchCompute((width[level] + 15) / 16, (height[level] + 15) / 16, 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+    }
+};
+
+} // namespace kerr
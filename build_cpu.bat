@@ -0,0 +1,46 @@
+@echo off
+REM Build script for Kerr Black Hole - Native CPU Renderer
+REM Requires: MinGW-w64 (no SDL2/GLEW/GPU needed)
+
+echo ========================================
+echo Kerr Black Hole - CPU Renderer Build
+echo ========================================
+echo.
+
+if not exist main_cpu.cpp (
+    echo ERROR: main_cpu.cpp not found
+    pause
+    exit /b 1
+)
+
+if not exist kerr_physics.h (
+    echo ERROR: kerr_physics.h not found
+    pause
+    exit /b 1
+)
+
+echo [1/2] Compiling CPU renderer...
+echo.
+
+g++ main_cpu.cpp -o KerrBlackHole_CPU.exe -std=c++17 -O3 -march=native -pthread
+
+if %errorlevel% neq 0 (
+    echo.
+    echo ERROR: Compilation failed
+    pause
+    exit /b 1
+)
+
+echo.
+echo [2/2] Build successful!
+echo.
+echo Output: KerrBlackHole_CPU.exe
+echo.
+echo FEATURES:
+echo  - Same physics as blackhole_improved.comp
+echo  - Tile-based work-stealing thread pool
+echo  - Reports rays/s and steps/s
+echo.
+echo To run: KerrBlackHole_CPU.exe --spin 0.9 --inclination 85 --resolution 1920x1080
+echo ========================================
+pause
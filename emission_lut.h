@@ -0,0 +1,207 @@
+/*
+ * Tabulated disk emission
+ * C++17, header-only; include after the program's OpenGL declarations
+ * (GL/glew.h or gl_headless.h)
+ *
+ * KERR_EMISSION_LUT builds of blackhole_improved.comp shade a disk hit with
+ * two texture fetches instead of evaluating diskEmission:
+ *
+ *   disk structure  2D, azimuth x radius: (temperature, intensity) of the
+ *                   disk at time 0, turbulence, spiral waves and hot spots
+ *                   included. The disk pattern turns at DISK_PATTERN_SPEED,
+ *                   so time only rotates the azimuth coordinate.
+ *   blackbody       1D, temperature -> linear sRGB of a blackbody, from the
+ *                   Planck spectrum integrated against the CIE 1931 colour
+ *                   matching functions and scaled to a largest component
+ *                   of 1. The disk temperature runs from 0 to 1 at
+ *                   DISK_INNER and is displayed as BLACKBODY_INNER_KELVIN
+ *                   times that.
+ *
+ * Both are built on the host. EmissionTextures keeps them and rebuilds the
+ * disk structure only when its DiskModel changes.
+ */
+
+#pragma once
+
+#include "kerr_physics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+namespace kerr {
+
+constexpr int BLACKBODY_LUT_SIZE = 256;
+constexpr float BLACKBODY_INNER_KELVIN = 12000.0f;  // temperature 1, the inner disk edge
+constexpr float BLACKBODY_MIN_KELVIN = 1000.0f;     // below this the table holds this colour
+constexpr int DISK_LUT_AZIMUTH = 1024;
+constexpr int DISK_LUT_RADIAL = 256;
+constexpr float DISK_PATTERN_SPEED = 0.1f;          // radians per time unit, the spiral waves' speed
+
+// Texture units of the two tables; sampler bindings in blackhole_improved.comp
+constexpr unsigned DISK_STRUCTURE_UNIT = 4;
+constexpr unsigned BLACKBODY_LUT_UNIT = 5;
+
+// CIE 1931 2-degree colour matching functions, multi-lobe Gaussian fit of
+// Wyman, Sloan and Shirley (JCGT 2013); lambda in nm
+inline void cieColorMatching(double lambda, double& x, double& y, double& z) {
+    auto g = [lambda](double mu, double below, double above) {
+        double t = (lambda - mu) / (lambda < mu ? below : above);
+        return std::exp(-0.5 * t * t);
+    };
+    x = 1.056 * g(599.8, 37.9, 31.0) + 0.362 * g(442.0, 16.0, 26.7) - 0.065 * g(501.1, 20.4, 26.2);
+    y = 0.821 * g(568.8, 46.9, 40.5) + 0.286 * g(530.9, 16.3, 31.1);
+    z = 1.217 * g(437.0, 11.8, 36.0) + 0.681 * g(459.0, 26.0, 13.8);
+}
+
+// Linear sRGB colour of a blackbody at the given temperature, largest
+// component 1; colours outside the sRGB gamut are clipped at 0
+inline Vec3 blackbodyColor(double kelvin) {
+    const double c2 = 1.4387769e7;      // second radiation constant hc/k, nm K
+    double X = 0.0, Y = 0.0, Z = 0.0;
+    for (double lambda = 380.0; lambda <= 780.0; lambda += 1.0) {
+        double radiance = 1.0 / (std::pow(lambda, 5.0) * std::expm1(c2 / (lambda * kelvin)));
+        double x, y, z;
+        cieColorMatching(lambda, x, y, z);
+        X += radiance * x;
+        Y += radiance * y;
+        Z += radiance * z;
+    }
+    double r = 3.2404542 * X - 1.5371385 * Y - 0.4985314 * Z;
+    double g = -0.9692660 * X + 1.8760108 * Y + 0.0415560 * Z;
+    double b = 0.0556434 * X - 0.2040259 * Y + 1.0572252 * Z;
+    r = std::max(r, 0.0);
+    g = std::max(g, 0.0);
+    b = std::max(b, 0.0);
+    double peak = std::max({r, g, b, 1e-300});
+    return {(float)(r / peak), (float)(g / peak), (float)(b / peak)};
+}
+
+// RGB triples; entry i is disk temperature i / (BLACKBODY_LUT_SIZE - 1)
+inline std::vector<float> buildBlackbodyLut() {
+    std::vector<float> rgb(BLACKBODY_LUT_SIZE * 3);
+    for (int i = 0; i < BLACKBODY_LUT_SIZE; ++i) {
+        double t = (double)i / (BLACKBODY_LUT_SIZE - 1);
+        Vec3 c = blackbodyColor(std::max((double)BLACKBODY_MIN_KELVIN, t * BLACKBODY_INNER_KELVIN));
+        rgb[i * 3 + 0] = c.x;
+        rgb[i * 3 + 1] = c.y;
+        rgb[i * 3 + 2] = c.z;
+    }
+    return rgb;
+}
+
+// What the disk structure table depends on
+struct DiskModel {
+    bool detail = true;         // KERR_DISK_DETAIL
+    int azimuthTexels = DISK_LUT_AZIMUTH;
+    int radialTexels = DISK_LUT_RADIAL;
+
+    bool operator==(const DiskModel& o) const {
+        return detail == o.detail && azimuthTexels == o.azimuthTexels && radialTexels == o.radialTexels;
+    }
+    bool operator!=(const DiskModel& o) const { return !(*this == o); }
+};
+
+// (temperature, intensity) pairs, azimuth fastest. Texel centres sit at
+// azimuth (i + 0.5) / azimuthTexels * 2 pi and radius DISK_INNER +
+// j / (radialTexels - 1) * (DISK_OUTER - DISK_INNER), the same model as
+// diskEmission in blackhole_improved.comp at height 0 and time 0.
+inline std::vector<float> buildDiskStructure(const DiskModel& model) {
+    std::vector<float> texels((size_t)model.azimuthTexels * model.radialTexels * 2);
+    for (int j = 0; j < model.radialTexels; ++j) {
+        float r = DISK_INNER + (DISK_OUTER - DISK_INNER) * (float)j / (float)(model.radialTexels - 1);
+        float temp = std::pow(DISK_INNER / r, 0.75f);
+        float base = std::pow(DISK_INNER / r, 3.0f);
+        for (int i = 0; i < model.azimuthTexels; ++i) {
+            float phi = TWO_PI * ((float)i + 0.5f) / (float)model.azimuthTexels;
+            float intensity = base;
+            if (model.detail) {
+                float turbulence = 0.15f * std::sin(phi * 12.0f + r * 0.8f);
+                turbulence += 0.08f * std::sin(-phi * 8.0f + r * 1.2f);
+                intensity *= 1.0f + turbulence;
+                intensity *= 1.0f + 0.2f * std::sin(phi * 2.0f + std::log(r) * 3.0f);
+                intensity += 2.0f * smoothstep(0.98f, 1.0f, std::sin(phi * 3.0f) * std::sin(r * 0.5f));
+            }
+            float* t = &texels[((size_t)j * model.azimuthTexels + i) * 2];
+            t[0] = temp;
+            t[1] = intensity;
+        }
+    }
+    return texels;
+}
+
+// The two tables as textures, bound to DISK_STRUCTURE_UNIT and
+// BLACKBODY_LUT_UNIT
+class EmissionTextures {
+public:
+    bool create() {
+        glGenTextures(1, &blackbody);
+        glGenTextures(1, &disk);
+        if (!blackbody || !disk) {
+            std::cerr << "EmissionTextures: texture creation failed" << std::endl;
+            return false;
+        }
+        std::vector<float> lut = buildBlackbodyLut();
+        glBindTexture(GL_TEXTURE_1D, blackbody);
+        glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexImage1D(GL_TEXTURE_1D, 0, GL_RGB32F, BLACKBODY_LUT_SIZE, 0, GL_RGB, GL_FLOAT, lut.data());
+
+        // Azimuth wraps around, radius does not
+        glBindTexture(GL_TEXTURE_2D, disk);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        built = false;
+        return true;
+    }
+
+    // Rebuilds the disk structure if model differs from the one it holds;
+    // true if it did
+    bool update(const DiskModel& model) {
+        if (built && model == current) return false;
+        std::vector<float> texels = buildDiskStructure(model);
+        glBindTexture(GL_TEXTURE_2D, disk);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, model.azimuthTexels, model.radialTexels, 0, GL_RG, GL_FLOAT,
+                     texels.data());
+        current = model;
+        built = true;
+        rebuilds++;
+        return true;
+    }
+
+    // Texture units are shared with other passes, so bind before each dispatch
+    void bind() const {
+        glActiveTexture(GL_TEXTURE0 + DISK_STRUCTURE_UNIT);
+        glBindTexture(GL_TEXTURE_2D, disk);
+        glActiveTexture(GL_TEXTURE0 + BLACKBODY_LUT_UNIT);
+        glBindTexture(GL_TEXTURE_1D, blackbody);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    int rebuildCount() const { return rebuilds; }
+
+    size_t bytes() const {
+        return built ? (size_t)BLACKBODY_LUT_SIZE * 3 * sizeof(float) +
+                       (size_t)current.azimuthTexels * current.radialTexels * 2 * sizeof(float)
+                     : 0;
+    }
+
+    void destroy() {
+        if (blackbody) glDeleteTextures(1, &blackbody);
+        if (disk) glDeleteTextures(1, &disk);
+        blackbody = disk = 0;
+        built = false;
+    }
+
+private:
+    GLuint blackbody = 0, disk = 0;
+    DiskModel current;
+    bool built = false;
+    int rebuilds = 0;
+};
+
+} // namespace kerr
@@ -0,0 +1,27 @@
+/*
+ * Numbered file names for animation frames
+ * C++17, header-only
+ *
+ * kerr_cpu, kerr_headless and kerr_farm all write an animation's frames
+ * next to the --output name, numbered before the extension.
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <string>
+
+namespace kerr {
+
+// output.ppm -> output_0007.ppm for frame 7; a name without an extension
+// gets the number appended
+inline std::string framePath(const std::string& path, int frame) {
+    char suffix[16];
+    std::snprintf(suffix, sizeof(suffix), "_%04d", frame);
+    size_t slash = path.find_last_of("/\\");
+    size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return path + suffix;
+    return path.substr(0, dot) + suffix + path.substr(dot);
+}
+
+} // namespace kerr
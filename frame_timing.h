@@ -0,0 +1,248 @@
+/*
+ * GPU pass timers and per-frame telemetry
+ * C++17, header-only; include after the program's OpenGL declarations
+ * (GL/glew.h or gl_headless.h)
+ *
+ * GpuPassTimer brackets passes with GL_TIME_ELAPSED queries. It keeps
+ * GPU_TIMER_FRAMES sets of queries and reads a set back only when the
+ * frame that issued it comes around again, by which time the GPU has
+ * finished it, so reading never waits on work still in flight.
+ *
+ * A FrameRecord holds one frame's CPU and GPU timings. TelemetryLog
+ * writes records as CSV, or as a JSON array when the file name ends in
+ * .json. TimingSummary keeps the last records and reports the mean and
+ * 99th percentile of every column.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace kerr {
+
+constexpr int GPU_TIMER_FRAMES = 2;     // query sets in flight
+constexpr int GPU_TIMER_MAX_PASSES = 8;
+
+// Milliseconds since a steady-clock time point
+inline double msSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+class GpuPassTimer {
+public:
+    // One query per pass name and frame set
+    bool create(const std::vector<std::string>& passNames) {
+        names = passNames;
+        if (names.size() > (size_t)GPU_TIMER_MAX_PASSES) {
+            std::cerr << "GpuPassTimer: at most " << GPU_TIMER_MAX_PASSES << " passes" << std::endl;
+            return false;
+        }
+        for (int f = 0; f < GPU_TIMER_FRAMES; ++f) {
+            glGenQueries((GLsizei)names.size(), queries[f]);
+            std::fill(issued[f], issued[f] + GPU_TIMER_MAX_PASSES, false);
+        }
+        return true;
+    }
+
+    int passes() const { return (int)names.size(); }
+    const std::string& name(int pass) const { return names[pass]; }
+
+    // Query set of the current frame, 0 .. GPU_TIMER_FRAMES - 1
+    int slot() const { return current; }
+
+    // Moves to the next query set. The frame that last used it is read
+    // back into ms (negative for passes it did not issue); false if that
+    // frame issued none.
+    bool beginFrame(std::vector<double>& ms) {
+        current = (current + 1) % GPU_TIMER_FRAMES;
+        ms.assign(names.size(), -1.0);
+        bool any = false;
+        for (int p = 0; p < passes(); ++p) {
+            if (!issued[current][p]) continue;
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(queries[current][p], GL_QUERY_RESULT, &ns);
+            ms[p] = ns * 1e-6;
+            issued[current][p] = false;
+            any = true;
+        }
+        return any;
+    }
+
+    // Passes may not nest; GL allows one GL_TIME_ELAPSED query at a time
+    void begin(int pass) {
+        glBeginQuery(GL_TIME_ELAPSED, queries[current][pass]);
+        issued[current][pass] = true;
+    }
+
+    void end() { glEndQuery(GL_TIME_ELAPSED); }
+
+    void destroy() {
+        if (names.empty()) return;
+        for (int f = 0; f < GPU_TIMER_FRAMES; ++f) glDeleteQueries((GLsizei)names.size(), queries[f]);
+        names.clear();
+    }
+
+private:
+    std::vector<std::string> names;
+    GLuint queries[GPU_TIMER_FRAMES][GPU_TIMER_MAX_PASSES] = {};
+    bool issued[GPU_TIMER_FRAMES][GPU_TIMER_MAX_PASSES] = {};
+    int current = 0;
+};
+
+// Timings of one frame; negative values were not measured
+struct FrameRecord {
+    uint64_t frame = 0;
+    double time = 0.0;              // seconds since start
+    bool rendered = false;          // a compute dispatch, not only a redraw
+    int pixelStride = 1;            // progressive refinement pass
+    int sampleIndex = 0;
+    int quality = -1;               // frame-time governor level, -1 = off
+    std::vector<double> cpuMs;      // per CPU stage
+    std::vector<double> gpuMs;      // per GPU pass
+};
+
+// Column names of FrameRecord with the given stage and pass names
+inline std::vector<std::string> frameColumns(const std::vector<std::string>& cpuStages,
+                                             const std::vector<std::string>& gpuPasses) {
+    std::vector<std::string> columns;
+    for (const std::string& s : cpuStages) columns.push_back("cpu_" + s + "_ms");
+    for (const std::string& p : gpuPasses) columns.push_back("gpu_" + p + "_ms");
+    return columns;
+}
+
+class TelemetryLog {
+public:
+    bool open(const std::string& path, const std::vector<std::string>& cpuStages,
+              const std::vector<std::string>& gpuPasses) {
+        out.open(path);
+        if (!out.is_open()) {
+            std::cerr << "Failed to open telemetry log: " << path << std::endl;
+            return false;
+        }
+        json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+        columns = frameColumns(cpuStages, gpuPasses);
+        out << std::fixed << std::setprecision(4);
+        if (json) {
+            out << "[\n";
+        } else {
+            out << "frame,time_s,rendered,pixel_stride,sample_index,quality_level";
+            for (const std::string& c : columns) out << "," << c;
+            out << "\n";
+        }
+        return true;
+    }
+
+    bool isOpen() const { return out.is_open(); }
+
+    void write(const FrameRecord& r) {
+        if (!out.is_open()) return;
+        std::vector<double> values = r.cpuMs;
+        values.insert(values.end(), r.gpuMs.begin(), r.gpuMs.end());
+        values.resize(columns.size(), -1.0);
+        if (json) {
+            out << (records ? ",\n" : "") << "  {\"frame\": " << r.frame << ", \"time_s\": " << r.time
+                << ", \"rendered\": " << (r.rendered ? "true" : "false") << ", \"pixel_stride\": " << r.pixelStride
+                << ", \"sample_index\": " << r.sampleIndex << ", \"quality_level\": " << r.quality;
+            for (size_t i = 0; i < columns.size(); ++i) {
+                out << ", \"" << columns[i] << "\": ";
+                if (values[i] < 0.0) out << "null";
+                else out << values[i];
+            }
+            out << "}";
+        } else {
+            out << r.frame << "," << r.time << "," << (r.rendered ? 1 : 0) << "," << r.pixelStride << ","
+                << r.sampleIndex << "," << r.quality;
+            for (double v : values) {
+                out << ",";
+                if (v >= 0.0) out << v;
+            }
+            out << "\n";
+        }
+        records++;
+    }
+
+    void close() {
+        if (!out.is_open()) return;
+        if (json) out << (records ? "\n" : "") << "]\n";
+        out.close();
+    }
+
+    ~TelemetryLog() { close(); }
+
+private:
+    std::ofstream out;
+    std::vector<std::string> columns;
+    bool json = false;
+    uint64_t records = 0;
+};
+
+// Mean and 99th percentile of the measured values
+struct TimingStats {
+    double mean = 0.0;
+    double p99 = 0.0;
+    size_t count = 0;
+};
+
+inline TimingStats timingStats(std::vector<double> values) {
+    TimingStats s;
+    values.erase(std::remove_if(values.begin(), values.end(), [](double v) { return v < 0.0; }), values.end());
+    if (values.empty()) return s;
+    std::sort(values.begin(), values.end());
+    double sum = 0.0;
+    for (double v : values) sum += v;
+    s.count = values.size();
+    s.mean = sum / values.size();
+    s.p99 = values[std::min(values.size() - 1, (size_t)std::ceil(0.99 * values.size()) - 1)];
+    return s;
+}
+
+// The last `capacity` records
+class TimingSummary {
+public:
+    TimingSummary(std::vector<std::string> cpuStages, std::vector<std::string> gpuPasses, size_t capacity = 256)
+        : columns(frameColumns(cpuStages, gpuPasses)), history(capacity) {}
+
+    void add(const FrameRecord& r) {
+        std::vector<double> values = r.cpuMs;
+        values.insert(values.end(), r.gpuMs.begin(), r.gpuMs.end());
+        values.resize(columns.size(), -1.0);
+        history[next] = values;
+        next = (next + 1) % history.size();
+        size = std::min(size + 1, history.size());
+    }
+
+    TimingStats column(size_t c) const {
+        std::vector<double> values;
+        for (size_t i = 0; i < size; ++i) values.push_back(history[i][c]);
+        return timingStats(values);
+    }
+
+    void print(std::ostream& out) const {
+        std::ostringstream text;
+        text << std::fixed << std::setprecision(3) << "Timing over the last " << size << " frames (ms, mean / p99):\n";
+        for (size_t c = 0; c < columns.size(); ++c) {
+            TimingStats s = column(c);
+            text << "  " << std::left << std::setw(20) << columns[c] << std::right;
+            if (s.count) text << std::setw(9) << s.mean << " / " << std::setw(9) << s.p99 << "  (" << s.count << ")\n";
+            else text << "        -\n";
+        }
+        out << text.str() << std::flush;
+    }
+
+private:
+    std::vector<std::string> columns;
+    std::vector<std::vector<double>> history;
+    size_t next = 0;
+    size_t size = 0;
+};
+
+} // namespace kerr
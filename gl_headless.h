@@ -0,0 +1,152 @@
+/*
+ * Headless OpenGL context and compute program helpers
+ * C++17, header-only, Linux (EGL)
+ *
+ * Creates an OpenGL 4.5 core context without a window for the batch tools
+ * (main_headless.cpp, main_farm.cpp): EGL on the Mesa surfaceless platform
+ * where available, otherwise the default display with a small pbuffer.
+ * Entry points come from libOpenGL, so no loader library is needed.
+ */
+
+#pragma once
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#ifndef GL_GLEXT_PROTOTYPES
+#define GL_GLEXT_PROTOTYPES
+#endif
+#include <GL/glcorearb.h>
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+struct HeadlessContext {
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLSurface surface = EGL_NO_SURFACE;
+    EGLContext context = EGL_NO_CONTEXT;
+
+    bool create(bool forcePbuffer) {
+        // Prefer the surfaceless platform, which needs neither X nor a GBM device
+        const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+        if (clientExtensions && std::strstr(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+            auto getPlatformDisplay =
+                (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+            if (getPlatformDisplay) display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        }
+        if (display == EGL_NO_DISPLAY) display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+        EGLint major = 0, minor = 0;
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+            std::cerr << "EGL initialization failed" << std::endl;
+            return false;
+        }
+        if (!eglBindAPI(EGL_OPENGL_API)) {
+            std::cerr << "EGL has no desktop OpenGL" << std::endl;
+            return false;
+        }
+
+        const char* displayExtensions = eglQueryString(display, EGL_EXTENSIONS);
+        bool surfaceless = !forcePbuffer && displayExtensions &&
+                           std::strstr(displayExtensions, "EGL_KHR_surfaceless_context");
+
+        const EGLint configAttribs[] = {
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_SURFACE_TYPE, surfaceless ? 0 : EGL_PBUFFER_BIT,
+            EGL_NONE
+        };
+        EGLConfig config = nullptr;
+        EGLint configCount = 0;
+        eglChooseConfig(display, configAttribs, &config, 1, &configCount);
+        if (configCount == 0 && !surfaceless) {
+            std::cerr << "No EGL config with pbuffer support" << std::endl;
+            return false;
+        }
+
+        const EGLint contextAttribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 4,
+            EGL_CONTEXT_MINOR_VERSION, 5,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        context = eglCreateContext(display, configCount ? config : nullptr, EGL_NO_CONTEXT, contextAttribs);
+        if (context == EGL_NO_CONTEXT) {
+            std::cerr << "Failed to create an OpenGL 4.5 core context (EGL error 0x"
+                      << std::hex << eglGetError() << std::dec << ")" << std::endl;
+            return false;
+        }
+
+        if (!surfaceless) {
+            // Never drawn to; compute writes into textures
+            const EGLint pbufferAttribs[] = {EGL_WIDTH, 16, EGL_HEIGHT, 16, EGL_NONE};
+            surface = eglCreatePbufferSurface(display, config, pbufferAttribs);
+            if (surface == EGL_NO_SURFACE) {
+                std::cerr << "Failed to create a pbuffer surface" << std::endl;
+                return false;
+            }
+        }
+        if (!eglMakeCurrent(display, surface, surface, context)) {
+            std::cerr << "eglMakeCurrent failed" << std::endl;
+            return false;
+        }
+        // One write, so banners of concurrent worker processes do not interleave
+        std::ostringstream banner;
+        banner << "EGL " << major << "." << minor << (surfaceless ? " surfaceless" : " pbuffer")
+               << " | " << glGetString(GL_RENDERER) << " | OpenGL " << glGetString(GL_VERSION) << "\n";
+        std::cerr << banner.str() << std::flush;
+        return true;
+    }
+
+    ~HeadlessContext() {
+        if (display == EGL_NO_DISPLAY) return;
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (surface != EGL_NO_SURFACE) eglDestroySurface(display, surface);
+        if (context != EGL_NO_CONTEXT) eglDestroyContext(display, context);
+        eglTerminate(display);
+    }
+};
+
+inline std::string loadFile(const std::string& path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open: " << path << std::endl;
+        return "";
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    return buffer.str();
+}
+
+inline GLuint createComputeProgram(const std::string& source) {
+    const char* src = source.c_str();
+    GLuint shader = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(shader, 1, &src, nullptr);
+    glCompileShader(shader);
+
+    GLint success;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success) {
+        char log[4096];
+        glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        std::cerr << "Compute shader error:\n" << log << std::endl;
+        glDeleteShader(shader);
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program, shader);
+    glLinkProgram(program);
+    glDeleteShader(shader);
+
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        char log[4096];
+        glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+        std::cerr << "Program link error:\n" << log << std::endl;
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
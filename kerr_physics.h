@@ -0,0 +1,1487 @@
+/*
+ * Kerr Black Hole Physics - CPU port of blackhole_improved.comp
+ * C++17, header-only
+ *
+ * Every function mirrors its GLSL counterpart in blackhole_improved.comp
+ * so that the CPU renderer and the compute shader produce the same image
+ * for the same parameters. The integrator is templated on the scalar type:
+ * float matches the GPU, double is available for validation.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <initializer_list>
+#include <utility>
+
+namespace kerr {
+
+// Enhanced constants (same values as blackhole_improved.comp)
+constexpr float M = 1.0f;
+constexpr int MAX_STEPS = 768;
+constexpr float EPSILON = 1e-5f;
+constexpr float PI = 3.14159265359f;
+constexpr float TWO_PI = 6.28318530718f;
+
+// Improved disk parameters
+constexpr float DISK_INNER = 2.5f;
+constexpr float DISK_OUTER = 15.0f;
+constexpr float DISK_THICKNESS_PARAM = 0.02f;
+
+// Advanced rendering
+constexpr int MAX_BOUNCES = 3;
+constexpr int MAX_BOUNCES_LIMIT = 5;        // upper bound of --bounces
+constexpr float ESCAPE_RADIUS = 100.0f;
+
+// Conserved-quantity integrator: Mino-time step is MINO_STEP_SCALE / r,
+// roughly a constant fraction of r per step far from the hole
+constexpr float MINO_STEP_SCALE = 0.04f;
+// Largest change of phi per step from the lambda / sin^2(theta) pole term
+constexpr float MINO_POLE_STEP = 0.1f;
+
+// Embedded-RK step controller (PI control on the Cash-Karp error estimate).
+// Exponents are 0.7/5 and 0.4/5 for the 4th-order embedded error.
+constexpr float STEP_SAFETY = 0.9f;
+constexpr float STEP_PI_ALPHA = 0.14f;
+constexpr float STEP_PI_BETA = 0.08f;
+constexpr float STEP_MIN_SCALE = 0.2f;
+constexpr float STEP_MAX_SCALE = 5.0f;
+constexpr float STEP_MIN_SIZE = 1e-6f;      // steps this small are accepted regardless of error
+constexpr float STEP_INITIAL_AFFINE = 0.01f;
+
+// Geodesic integration modes (uIntegrator in the shader)
+enum class Integrator {
+    Affine = 0,   // 8-component second-order system in affine parameter
+    Mino = 1      // E, Lz, Q fixed at launch; first-order r/theta system in Mino time
+};
+
+// ===================================================================
+// VECTOR TYPES
+// ===================================================================
+
+template <typename T>
+struct Vec4T {
+    T x = 0, y = 0, z = 0, w = 0;
+};
+
+template <typename T> inline Vec4T<T> operator+(Vec4T<T> a, Vec4T<T> b) { return {a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w}; }
+template <typename T> inline Vec4T<T> operator-(Vec4T<T> a, Vec4T<T> b) { return {a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w}; }
+template <typename T> inline Vec4T<T> operator-(Vec4T<T> a) { return {-a.x, -a.y, -a.z, -a.w}; }
+template <typename T> inline Vec4T<T> operator*(T s, Vec4T<T> a) { return {s * a.x, s * a.y, s * a.z, s * a.w}; }
+template <typename T> inline T length(Vec4T<T> a) { return std::sqrt(a.x * a.x + a.y * a.y + a.z * a.z + a.w * a.w); }
+
+using Vec4 = Vec4T<float>;
+
+struct Vec3 {
+    float x = 0, y = 0, z = 0;
+};
+
+inline Vec3 operator+(Vec3 a, Vec3 b) { return {a.x + b.x, a.y + b.y, a.z + b.z}; }
+inline Vec3 operator-(Vec3 a, Vec3 b) { return {a.x - b.x, a.y - b.y, a.z - b.z}; }
+inline Vec3 operator*(Vec3 a, Vec3 b) { return {a.x * b.x, a.y * b.y, a.z * b.z}; }
+inline Vec3 operator/(Vec3 a, Vec3 b) { return {a.x / b.x, a.y / b.y, a.z / b.z}; }
+inline Vec3 operator*(float s, Vec3 a) { return {s * a.x, s * a.y, s * a.z}; }
+inline Vec3 operator*(Vec3 a, float s) { return {s * a.x, s * a.y, s * a.z}; }
+inline Vec3 operator+(Vec3 a, float s) { return {a.x + s, a.y + s, a.z + s}; }
+inline Vec3& operator+=(Vec3& a, Vec3 b) { a = a + b; return a; }
+inline Vec3& operator*=(Vec3& a, float s) { a = a * s; return a; }
+inline float dot(Vec3 a, Vec3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline float length(Vec3 a) { return std::sqrt(dot(a, a)); }
+inline Vec3 normalize(Vec3 a) { return a * (1.0f / length(a)); }
+inline Vec3 cross(Vec3 a, Vec3 b) {
+    return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+
+// GLSL built-ins used by the shader
+inline float clampf(float x, float lo, float hi) { return std::min(std::max(x, lo), hi); }
+inline float fract(float x) { return x - std::floor(x); }
+inline float radians(float deg) { return deg * (PI / 180.0f); }
+inline float smoothstep(float e0, float e1, float x) {
+    float t = clampf((x - e0) / (e1 - e0), 0.0f, 1.0f);
+    return t * t * (3.0f - 2.0f * t);
+}
+inline Vec3 clamp01(Vec3 c) { return {clampf(c.x, 0.0f, 1.0f), clampf(c.y, 0.0f, 1.0f), clampf(c.z, 0.0f, 1.0f)}; }
+
+// Ray state with conserved quantities
+template <typename T>
+struct RayStateT {
+    Vec4T<T> pos;   // (t, r, theta, phi)
+    Vec4T<T> vel;   // (dt/dlambda, dr/dlambda, dtheta/dlambda, dphi/dlambda)
+    T E = 0;        // Energy (conserved)
+    T Lz = 0;       // Angular momentum (conserved)
+    T Q = 0;        // Carter constant (conserved)
+};
+
+using RayState = RayStateT<float>;
+
+// Relative and absolute tolerances of the step controller, separately for
+// position and momentum components (uniforms in the shader)
+struct StepTolerances {
+    float relPos = 1e-4f;
+    float absPos = 1e-5f;
+    float relMom = 1e-4f;
+    float absMom = 1e-5f;
+};
+
+// Per-ray integration statistics; every attempt counts against the step
+// budget (MAX_STEPS unless a tracer is given another)
+struct StepCounts {
+    int accepted = 0;
+    int rejected = 0;
+    int attempts() const { return accepted + rejected; }
+};
+
+// What a ray's lensing sample and step counts do not keep, for diagnostic
+// images (aov.h)
+struct RayDiagnostics {
+    float maxError = 0.0f;   // largest scaled error of an accepted step
+    float finalR = 0.0f;     // radius the ray was last integrated to
+};
+
+// PI step-size controller. The step size persists across steps; a rejected
+// step is retried from the same state with a smaller step, and the step
+// after a rejection is not allowed to grow.
+struct StepController {
+    float h = STEP_INITIAL_AFFINE;
+    float prevError = 1.0f;
+    bool rejectedLast = false;
+
+    // error is the tolerance-scaled norm of a step of size h (<= 1 accepts).
+    // Updates h and returns whether the step is accepted.
+    bool update(float error) {
+        if (!(error == error)) error = 1e10f;   // NaN: reject hard
+        if (error <= 1.0f || h <= STEP_MIN_SIZE) {
+            float scale = STEP_MAX_SCALE;
+            if (error > 0.0f) {
+                scale = STEP_SAFETY * std::pow(error, -STEP_PI_ALPHA) * std::pow(prevError, STEP_PI_BETA);
+                scale = clampScale(scale);
+            }
+            if (rejectedLast) scale = std::min(scale, 1.0f);
+            h = std::max(h * scale, STEP_MIN_SIZE);
+            prevError = std::max(error, 1e-4f);
+            rejectedLast = false;
+            return true;
+        }
+        float scale = std::max(STEP_MIN_SCALE, STEP_SAFETY * std::pow(error, -0.2f));
+        h = std::max(h * scale, STEP_MIN_SIZE);
+        rejectedLast = true;
+        return false;
+    }
+
+    static float clampScale(float scale) { return std::min(std::max(scale, STEP_MIN_SCALE), STEP_MAX_SCALE); }
+};
+
+// ===================================================================
+// IMPROVED METRIC FUNCTIONS
+// ===================================================================
+
+template <typename T>
+inline T sigma(T r, T theta, T a) {
+    T cosTheta = std::cos(theta);
+    return r * r + a * a * cosTheta * cosTheta;
+}
+
+template <typename T>
+inline T delta(T r, T a) {
+    return r * r - T(2) * T(M) * r + a * a;
+}
+
+template <typename T>
+inline T A_func(T r, T theta, T a) {
+    T sin2 = std::sin(theta) * std::sin(theta);
+    T r2_a2 = r * r + a * a;
+    return r2_a2 * r2_a2 - a * a * delta(r, a) * sin2;
+}
+
+template <typename T>
+inline T eventHorizon(T a) {
+    return T(M) + std::sqrt(T(M) * T(M) - a * a);
+}
+
+// Compute all metric components and inverses
+template <typename T>
+inline void computeFullMetric(T r, T theta, T a,
+                              T& gtt, T& gtphi, T& grr,
+                              T& gthth, T& gphiphi,
+                              T& gtt_inv, T& gphiphi_inv, T& gtphi_inv) {
+    T sig = sigma(r, theta, a);
+    T dlt = delta(r, a);
+    T sin2 = std::sin(theta) * std::sin(theta);
+    T A = A_func(r, theta, a);
+
+    // Covariant components
+    gtt = -(T(1) - T(2) * T(M) * r / sig);
+    gtphi = -T(2) * T(M) * a * r * sin2 / sig;
+    grr = sig / dlt;
+    gthth = sig;
+    gphiphi = A * sin2 / sig;
+
+    // Inverse components (contravariant)
+    T det_2d = gtt * gphiphi - gtphi * gtphi;
+    gtt_inv = gphiphi / det_2d;
+    gphiphi_inv = gtt / det_2d;
+    gtphi_inv = -gtphi / det_2d;
+}
+
+// E, Lz and the Carter constant Q of an affine ray state, on the sign
+// convention of launchRay (rays run backwards in time). The integrator
+// carries the launch values along; the difference measures its drift.
+template <typename T>
+inline void conservedQuantities(const RayStateT<T>& s, T a, T& E, T& Lz, T& Q) {
+    T gtt, gtphi, grr, gthth, gphiphi, gtt_inv, gphiphi_inv, gtphi_inv;
+    computeFullMetric(s.pos.y, s.pos.z, a, gtt, gtphi, grr, gthth, gphiphi, gtt_inv, gphiphi_inv, gtphi_inv);
+    E = gtt * s.vel.x + gtphi * s.vel.w;
+    Lz = -(gtphi * s.vel.x + gphiphi * s.vel.w);
+    T p_theta = gthth * s.vel.z;
+    T cos2 = std::cos(s.pos.z) * std::cos(s.pos.z);
+    T sin2 = std::max(T(1) - cos2, T(1e-12));
+    Q = p_theta * p_theta + cos2 * (Lz * Lz / sin2 - a * a * E * E);
+}
+
+// ===================================================================
+// IMPROVED GEODESIC INTEGRATION - CASH-KARP RK5
+// ===================================================================
+
+// Geodesic equation d2x/dlambda2 = -Gamma^mu_ab v^a v^b, built from the
+// metric and its r and theta derivatives:
+//   Gamma_nu,ab v^a v^b = (d_a g_nu,b) v^a v^b - 1/2 (d_nu g_ab) v^a v^b
+// then raised with the inverse metric. E and Lz are conserved to the
+// accuracy of the integrator.
+template <typename T>
+inline Vec4T<T> geodesicDerivatives(const Vec4T<T>& pos, const Vec4T<T>& vel, T a) {
+    const T m = T(M);
+    T r = pos.y;
+    T theta = pos.z;
+
+    T sin_theta = std::sin(theta);
+    T cos_theta = std::cos(theta);
+    T sin2 = sin_theta * sin_theta;
+    T a2 = a * a;
+    T r2_a2 = r * r + a2;
+
+    T sig = r * r + a2 * cos_theta * cos_theta;
+    T dlt = r * r - T(2) * m * r + a2;
+    T A = r2_a2 * r2_a2 - a2 * dlt * sin2;
+
+    T dsig_dr = T(2) * r;
+    T dsig_dth = -T(2) * a2 * cos_theta * sin_theta;
+    T ddlt_dr = T(2) * (r - m);
+    T dA_dr = T(4) * r * r2_a2 - a2 * sin2 * ddlt_dr;
+    T dA_dth = -T(2) * a2 * dlt * sin_theta * cos_theta;
+    T dsin2_dth = T(2) * sin_theta * cos_theta;
+
+    // Covariant metric
+    T sig2 = sig * sig;
+    T gtt = -(T(1) - T(2) * m * r / sig);
+    T gtphi = -T(2) * m * a * r * sin2 / sig;
+    T gphiphi = A * sin2 / sig;
+
+    // r and theta derivatives of the metric
+    T dgtt_dr = T(2) * m * (sig - r * dsig_dr) / sig2;
+    T dgtt_dth = -T(2) * m * r * dsig_dth / sig2;
+    T dgtphi_dr = -T(2) * m * a * sin2 * (sig - r * dsig_dr) / sig2;
+    T dgtphi_dth = -T(2) * m * a * r * (dsin2_dth * sig - sin2 * dsig_dth) / sig2;
+    T dgphiphi_dr = sin2 * (dA_dr * sig - A * dsig_dr) / sig2;
+    T dgphiphi_dth = ((dA_dth * sin2 + A * dsin2_dth) * sig - A * sin2 * dsig_dth) / sig2;
+    T dgrr_dr = (dsig_dr * dlt - sig * ddlt_dr) / (dlt * dlt);
+    T dgrr_dth = dsig_dth / dlt;
+    T dgthth_dr = dsig_dr;
+    T dgthth_dth = dsig_dth;
+
+    T dt = vel.x;
+    T dr = vel.y;
+    T dtheta = vel.z;
+    T dphi = vel.w;
+
+    // d_nu g_ab v^a v^b for nu = r, theta
+    T quad_r = dgtt_dr * dt * dt + T(2) * dgtphi_dr * dt * dphi + dgphiphi_dr * dphi * dphi
+             + dgrr_dr * dr * dr + dgthth_dr * dtheta * dtheta;
+    T quad_th = dgtt_dth * dt * dt + T(2) * dgtphi_dth * dt * dphi + dgphiphi_dth * dphi * dphi
+              + dgrr_dth * dr * dr + dgthth_dth * dtheta * dtheta;
+
+    // Lowered Christoffel contractions
+    T F_t = dr * (dgtt_dr * dt + dgtphi_dr * dphi) + dtheta * (dgtt_dth * dt + dgtphi_dth * dphi);
+    T F_phi = dr * (dgtphi_dr * dt + dgphiphi_dr * dphi) + dtheta * (dgtphi_dth * dt + dgphiphi_dth * dphi);
+    T F_r = dr * (dgrr_dr * dr + dgrr_dth * dtheta) - T(0.5) * quad_r;
+    T F_th = dr * dgthth_dr * dtheta + dtheta * dgthth_dth * dtheta - T(0.5) * quad_th;
+
+    // Inverse of the t-phi block
+    T det = gtt * gphiphi - gtphi * gtphi;
+    T gtt_inv = gphiphi / det;
+    T gtphi_inv = -gtphi / det;
+    T gphiphi_inv = gtt / det;
+
+    Vec4T<T> accel;
+    accel.x = gtt_inv * F_t + gtphi_inv * F_phi;
+    accel.y = dlt / sig * F_r;
+    accel.z = F_th / sig;
+    accel.w = gtphi_inv * F_t + gphiphi_inv * F_phi;
+    return -accel;
+}
+
+// Cash-Karp RK5 step; returns the embedded 4th/5th order error per component
+template <typename T>
+inline void rk5Step(RayStateT<T>& state, T a, T dlambda, Vec4T<T>& pos_err, Vec4T<T>& vel_err) {
+    // Cash-Karp coefficients
+    const T b21 = T(0.2);
+    const T b31 = T(3.0 / 40.0), b32 = T(9.0 / 40.0);
+    const T b41 = T(0.3), b42 = T(-0.9), b43 = T(1.2);
+    const T b51 = T(-11.0 / 54.0), b52 = T(2.5), b53 = T(-70.0 / 27.0), b54 = T(35.0 / 27.0);
+    const T b61 = T(1631.0 / 55296.0), b62 = T(175.0 / 512.0), b63 = T(575.0 / 13824.0);
+    const T b64 = T(44275.0 / 110592.0), b65 = T(253.0 / 4096.0);
+
+    // 5th order
+    const T c1 = T(37.0 / 378.0), c3 = T(250.0 / 621.0), c4 = T(125.0 / 594.0), c6 = T(512.0 / 1771.0);
+    // 4th order for error estimation
+    const T dc1 = c1 - T(2825.0 / 27648.0), dc3 = c3 - T(18575.0 / 48384.0);
+    const T dc4 = c4 - T(13525.0 / 55296.0), dc5 = T(-277.0 / 14336.0), dc6 = c6 - T(0.25);
+
+    Vec4T<T> k1_pos = state.vel;
+    Vec4T<T> k1_vel = geodesicDerivatives(state.pos, state.vel, a);
+
+    Vec4T<T> pos2 = state.pos + dlambda * (b21 * k1_pos);
+    Vec4T<T> vel2 = state.vel + dlambda * (b21 * k1_vel);
+    Vec4T<T> k2_pos = vel2;
+    Vec4T<T> k2_vel = geodesicDerivatives(pos2, vel2, a);
+
+    Vec4T<T> pos3 = state.pos + dlambda * (b31 * k1_pos + b32 * k2_pos);
+    Vec4T<T> vel3 = state.vel + dlambda * (b31 * k1_vel + b32 * k2_vel);
+    Vec4T<T> k3_pos = vel3;
+    Vec4T<T> k3_vel = geodesicDerivatives(pos3, vel3, a);
+
+    Vec4T<T> pos4 = state.pos + dlambda * (b41 * k1_pos + b42 * k2_pos + b43 * k3_pos);
+    Vec4T<T> vel4 = state.vel + dlambda * (b41 * k1_vel + b42 * k2_vel + b43 * k3_vel);
+    Vec4T<T> k4_pos = vel4;
+    Vec4T<T> k4_vel = geodesicDerivatives(pos4, vel4, a);
+
+    Vec4T<T> pos5 = state.pos + dlambda * (b51 * k1_pos + b52 * k2_pos + b53 * k3_pos + b54 * k4_pos);
+    Vec4T<T> vel5 = state.vel + dlambda * (b51 * k1_vel + b52 * k2_vel + b53 * k3_vel + b54 * k4_vel);
+    Vec4T<T> k5_pos = vel5;
+    Vec4T<T> k5_vel = geodesicDerivatives(pos5, vel5, a);
+
+    Vec4T<T> pos6 = state.pos + dlambda * (b61 * k1_pos + b62 * k2_pos + b63 * k3_pos + b64 * k4_pos + b65 * k5_pos);
+    Vec4T<T> vel6 = state.vel + dlambda * (b61 * k1_vel + b62 * k2_vel + b63 * k3_vel + b64 * k4_vel + b65 * k5_vel);
+    Vec4T<T> k6_pos = vel6;
+    Vec4T<T> k6_vel = geodesicDerivatives(pos6, vel6, a);
+
+    // 5th order solution
+    Vec4T<T> pos_new = state.pos + dlambda * (c1 * k1_pos + c3 * k3_pos + c4 * k4_pos + c6 * k6_pos);
+    Vec4T<T> vel_new = state.vel + dlambda * (c1 * k1_vel + c3 * k3_vel + c4 * k4_vel + c6 * k6_vel);
+
+    // Error estimate
+    pos_err = dlambda * (dc1 * k1_pos + dc3 * k3_pos + dc4 * k4_pos + dc5 * k5_pos + dc6 * k6_pos);
+    vel_err = dlambda * (dc1 * k1_vel + dc3 * k3_vel + dc4 * k4_vel + dc5 * k5_vel + dc6 * k6_vel);
+
+    // Update state
+    state.pos = pos_new;
+    state.vel = vel_new;
+
+    // Keep theta in range
+    state.pos.z = std::min(std::max(state.pos.z, T(EPSILON)), T(PI) - T(EPSILON));
+}
+
+// Same step, returning the unscaled error magnitude
+template <typename T>
+inline bool rk5Step(RayStateT<T>& state, T a, T dlambda, T& error) {
+    Vec4T<T> pos_err, vel_err;
+    rk5Step(state, a, dlambda, pos_err, vel_err);
+    error = length(pos_err) + length(vel_err);
+    return true;
+}
+
+// Error of one component relative to atol + rtol * |y|
+template <typename T>
+inline T scaledComponent(T err, T before, T after, float rel, float abs) {
+    return std::fabs(err) / (T(abs) + T(rel) * std::max(std::fabs(before), std::fabs(after)));
+}
+
+// Max-norm of the step error against the tolerances; <= 1 is acceptable.
+// phi is measured against a fixed one-radian scale instead of |phi|: its
+// origin is the camera azimuth, and the steps a ray takes must not depend
+// on where the camera is on its orbit (see LensingSample).
+template <typename T>
+inline T scaledStepError(const RayStateT<T>& before, const RayStateT<T>& after,
+                         const Vec4T<T>& pos_err, const Vec4T<T>& vel_err, const StepTolerances& tol) {
+    const T* e0 = &pos_err.x; const T* p0 = &before.pos.x; const T* p1 = &after.pos.x;
+    const T* e1 = &vel_err.x; const T* v0 = &before.vel.x; const T* v1 = &after.vel.x;
+    T norm = scaledComponent(e0[3], T(1), T(1), tol.relPos, tol.absPos);
+    for (int i = 0; i < 4; ++i) {
+        if (i < 3) norm = std::max(norm, scaledComponent(e0[i], p0[i], p1[i], tol.relPos, tol.absPos));
+        norm = std::max(norm, scaledComponent(e1[i], v0[i], v1[i], tol.relMom, tol.absMom));
+    }
+    return norm;
+}
+
+// ===================================================================
+// DISK MODEL - PHYSICALLY ACCURATE
+// ===================================================================
+
+// Relativistic disk thickness
+inline float diskThickness(float r, float /*a*/) {
+    // Scale height: H/R ≈ 0.01 * (r/rISCO)^(1/8)
+    float rISCO = DISK_INNER;
+    return DISK_THICKNESS_PARAM * std::pow(r / rISCO, 0.125f) * r;
+}
+
+// Thin disk in the equatorial plane: the ray crosses it where cos(theta)
+// changes sign between two accepted steps. Returns the interpolated
+// crossing radius and azimuth, and whether the crossing lies on the disk.
+inline bool crossDisk(float r0, float u0, float phi0, float r1, float u1, float phi1,
+                      float& diskR, float& diskPhi) {
+    if (u0 * u1 > 0.0f || u0 == u1) return false;
+    float f = u0 / (u0 - u1);
+    diskR = r0 + f * (r1 - r0);
+    diskPhi = phi0 + f * (phi1 - phi0);
+    return diskR >= DISK_INNER && diskR <= DISK_OUTER;
+}
+
+// Planck function for blackbody radiation (five-band RGB approximation)
+inline Vec3 planckSpectrum(float T) {
+    float t = T;
+    if (t > 0.9f) return {0.5f, 0.6f, 1.0f};    // Very hot: UV/blue-white
+    if (t > 0.7f) return {0.7f, 0.8f, 1.0f};    // Hot: blue-white
+    if (t > 0.5f) return {1.0f, 0.95f, 0.85f};  // Warm: white
+    if (t > 0.3f) return {1.0f, 0.85f, 0.6f};   // Yellow
+    return {1.0f, 0.6f, 0.3f};                  // Cool: orange-red
+}
+
+inline Vec3 diskEmission(float r, float phi, float height, float diskTime, float a) {
+    // Shakura-Sunyaev temperature profile
+    float temp = std::pow(DISK_INNER / r, 0.75f);
+
+    // Vertical temperature gradient
+    float H = diskThickness(r, a);
+    float verticalFactor = std::exp(-0.5f * (height / H) * (height / H));
+    temp *= std::sqrt(verticalFactor);
+
+    Vec3 color = planckSpectrum(temp);
+
+    // Base emission (modified blackbody)
+    float intensity = std::pow(DISK_INNER / r, 3.0f) * verticalFactor;
+
+    // MRI turbulence
+    float turbulence = 0.15f * std::sin(diskTime * 0.5f + phi * 12.0f + r * 0.8f);
+    turbulence += 0.08f * std::sin(diskTime * 0.3f - phi * 8.0f + r * 1.2f);
+    intensity *= (1.0f + turbulence);
+
+    // Spiral density waves
+    float spiral = 0.2f * std::sin(phi * 2.0f - diskTime * 0.2f + std::log(r) * 3.0f);
+    intensity *= (1.0f + spiral);
+
+    // Hot spots (magnetic reconnection events)
+    float hotspot = smoothstep(0.98f, 1.0f,
+        std::sin(diskTime * 0.4f + phi * 3.0f) * std::sin(diskTime * 0.3f + r * 0.5f));
+    intensity += hotspot * 2.0f;
+
+    return color * intensity;
+}
+
+// g = nu_obs / nu_emit for a Keplerian emitter in the equatorial plane,
+// with frame dragging; lambda = Lz / E of the photon
+inline float diskRedshift(float r, float a, float lambda) {
+    float gtt = -(1.0f - 2.0f * M / r);
+    float gtphi = -2.0f * M * a / r;
+    float r2_a2 = r * r + a * a;
+    float gphiphi = (r2_a2 * r2_a2 - a * a * delta(r, a)) / (r * r);
+
+    float omega_K = 1.0f / (r * std::sqrt(r) + a);
+    float ut = 1.0f / std::sqrt(-gtt - 2.0f * omega_K * gtphi - omega_K * omega_K * gphiphi);
+    float g = 1.0f / (ut * (1.0f - omega_K * lambda));
+    return clampf(g, 0.05f, 10.0f);
+}
+
+// ===================================================================
+// ENHANCED STARFIELD
+// ===================================================================
+
+inline Vec3 advancedStarfield(Vec3 dir) {
+    Vec3 color;
+
+    // Bright stars
+    float h1 = fract(std::sin(dir.x * 12.9898f + dir.y * 78.233f) * 43758.5453f);
+    if (h1 > 0.9985f) {
+        float brightness = (h1 - 0.9985f) / 0.0015f;
+        float temp = fract(h1 * 7.123f);
+        Vec3 starColor;
+        if (temp > 0.7f) starColor = {0.6f, 0.7f, 1.0f};        // Blue star
+        else if (temp > 0.4f) starColor = {1.0f, 0.95f, 0.9f};  // White star
+        else starColor = {1.0f, 0.7f, 0.5f};                    // Red star
+        color = starColor * brightness;
+    }
+
+    // Dim stars
+    float h2 = fract(std::sin(dir.y * 93.9898f + dir.z * 67.233f) * 23758.5453f);
+    if (h2 > 0.997f) {
+        float brightness = (h2 - 0.997f) / 0.003f * 0.4f;
+        color += Vec3{brightness * 0.9f, brightness * 0.95f, brightness};
+    }
+
+    // Milky Way structure
+    float galactic_plane = std::fabs(dir.y);
+    float galaxy_haze = std::pow(std::max(0.0f, 1.0f - galactic_plane * 2.0f), 4.0f) * 0.15f;
+    float galaxy_variation = std::sin(std::atan2(dir.z, dir.x) * 8.0f) * 0.5f + 0.5f;
+    galaxy_haze *= 0.5f + 0.5f * galaxy_variation;
+    color += Vec3{galaxy_haze * 0.6f, galaxy_haze * 0.7f, galaxy_haze * 0.9f};
+
+    // Distant galaxies
+    float h3 = fract(std::sin(dir.x * 41.123f + dir.z * 89.456f) * 33758.5453f);
+    if (h3 > 0.9995f) {
+        float size = (h3 - 0.9995f) / 0.0005f;
+        color += Vec3{size * 0.3f, size * 0.35f, size * 0.4f};
+    }
+
+    // Nebula glow
+    float nebula = smoothstep(0.3f, 0.8f,
+        std::sin(dir.x * 5.0f + dir.y * 3.0f) * std::sin(dir.z * 4.0f + dir.y * 6.0f)) * 0.1f;
+    color += Vec3{nebula * 0.8f, nebula * 0.4f, nebula * 0.6f};
+
+    // Base dark sky
+    color += Vec3{0.005f, 0.005f, 0.01f};
+
+    return color;
+}
+
+// ===================================================================
+// CAMERA AND RAY LAUNCH
+// ===================================================================
+
+// Parameters that the compute shader receives as uniforms
+struct RenderParams {
+    int width = 1920;
+    int height = 1080;
+    float time = 0.0f;
+    float spin = 0.9f;
+    float exposure = 1.0f;
+    float inclination = 85.0f;
+    float cameraDistance = 25.0f;
+    float fov = 45.0f;           // vertical field of view in degrees
+    int maxBounces = MAX_BOUNCES;
+    Integrator integrator = Integrator::Affine;
+    StepTolerances tolerances;
+    float farFieldRadius = 0.0f; // analytic outside this sphere, 0 = integrate to ESCAPE_RADIUS
+};
+
+struct Camera {
+    Vec3 position;
+    Vec3 forward, right, up;
+    float fovScale = 0.0f;
+    float aspect = 1.0f;
+};
+
+// Azimuth of the camera about the spin axis at a given animation time
+inline float cameraOrbitAngle(float time) { return time * 0.1f; }
+
+// Camera setup from main() of the compute shader
+inline Camera makeCamera(const RenderParams& p) {
+    Camera cam;
+    float orbitAngle = cameraOrbitAngle(p.time);
+    float inclinationRad = radians(p.inclination);
+
+    cam.position = {
+        p.cameraDistance * std::sin(inclinationRad) * std::cos(orbitAngle),
+        p.cameraDistance * std::cos(inclinationRad),
+        p.cameraDistance * std::sin(inclinationRad) * std::sin(orbitAngle)
+    };
+
+    Vec3 cameraTarget{0.0f, 0.0f, 0.0f};
+    Vec3 cameraUp{0.0f, 1.0f, 0.0f};
+
+    cam.forward = normalize(cameraTarget - cam.position);
+    cam.right = normalize(cross(cam.forward, cameraUp));
+    cam.up = cross(cam.right, cam.forward);
+
+    cam.fovScale = std::tan(radians(p.fov) / 2.0f);
+    cam.aspect = float(p.width) / float(p.height);
+    return cam;
+}
+
+// Normalized device coordinates of a pixel centre
+inline void pixelNdc(const RenderParams& p, float px, float py, float& ndcX, float& ndcY) {
+    ndcX = ((px + 0.5f) / float(p.width)) * 2.0f - 1.0f;
+    ndcY = ((py + 0.5f) / float(p.height)) * 2.0f - 1.0f;
+    ndcX *= float(p.width) / float(p.height);
+}
+
+inline Vec3 cameraRay(const Camera& cam, float ndcX, float ndcY) {
+    return normalize(cam.forward + cam.right * (ndcX * cam.fovScale) + cam.up * (ndcY * cam.fovScale));
+}
+
+// Camera position and ray direction in the local frame of a zero angular
+// momentum observer (ZAMO) at the camera
+struct ZamoFrame {
+    float r = 0.0f, theta = 0.0f, phi = 0.0f;
+    float cosTheta = 0.0f, sinTheta = 0.0f;
+    float n_r = 0.0f, n_theta = 0.0f, n_phi = 0.0f;   // direction cosines
+    float sig = 0.0f, dlt = 0.0f, A = 0.0f;
+    float alpha = 0.0f;    // lapse
+    float varpi = 0.0f;    // cylindrical radius
+    float omega = 0.0f;    // frame-dragging angular velocity
+};
+
+inline ZamoFrame zamoFrame(Vec3 rayOrigin, Vec3 rayDir, float a) {
+    ZamoFrame f;
+    f.r = length(rayOrigin);
+    f.cosTheta = clampf(rayOrigin.y / f.r, -1.0f, 1.0f);
+    f.theta = std::acos(f.cosTheta);
+    f.phi = std::atan2(rayOrigin.z, rayOrigin.x);
+    f.sinTheta = std::sin(f.theta);
+
+    // Orthonormal directions of increasing r, theta, phi
+    Vec3 e_r = rayOrigin * (1.0f / f.r);
+    Vec3 e_theta{f.cosTheta * std::cos(f.phi), -f.sinTheta, f.cosTheta * std::sin(f.phi)};
+    Vec3 e_phi{-std::sin(f.phi), 0.0f, std::cos(f.phi)};
+    f.n_r = dot(rayDir, e_r);
+    f.n_theta = dot(rayDir, e_theta);
+    f.n_phi = dot(rayDir, e_phi);
+
+    f.sig = sigma(f.r, f.theta, a);
+    f.dlt = delta(f.r, a);
+    f.A = A_func(f.r, f.theta, a);
+    f.alpha = std::sqrt(f.sig * f.dlt / f.A);
+    f.varpi = std::sqrt(f.A / f.sig) * f.sinTheta;
+    f.omega = 2.0f * M * a * f.r / f.A;
+    return f;
+}
+
+// Conserved quantities of the photon that reaches the camera from rayDir,
+// i.e. moving along -rayDir with unit energy in the ZAMO frame
+inline void photonConstants(const ZamoFrame& f, float a, float& E, float& Lz, float& Q) {
+    E = f.alpha - f.omega * f.varpi * f.n_phi;
+    Lz = -f.varpi * f.n_phi;
+    float p_theta = std::sqrt(f.sig) * f.n_theta;
+    Q = p_theta * p_theta + f.cosTheta * f.cosTheta * (Lz * Lz / (f.sinTheta * f.sinTheta) - a * a * E * E);
+}
+
+// Initial Boyer-Lindquist state for a camera ray: the null momentum a ZAMO
+// at the camera sees along rayDir with unit local energy, traced backwards
+// in time (dt/dlambda < 0) so the spatial components follow rayDir
+inline RayState launchRay(Vec3 rayOrigin, Vec3 rayDir, float a) {
+    ZamoFrame f = zamoFrame(rayOrigin, rayDir, a);
+
+    RayState ray;
+    ray.pos = {0.0f, f.r, f.theta, f.phi};
+    ray.vel.x = -1.0f / f.alpha;
+    ray.vel.y = std::sqrt(f.dlt / f.sig) * f.n_r;
+    ray.vel.z = f.n_theta / std::sqrt(f.sig);
+    ray.vel.w = -f.omega / f.alpha + f.n_phi / f.varpi;
+
+    photonConstants(f, a, ray.E, ray.Lz, ray.Q);
+    return ray;
+}
+
+// ===================================================================
+// LENSING SAMPLES - ORBIT-INDEPENDENT RAY GEOMETRY
+// ===================================================================
+//
+// Kerr spacetime is axisymmetric, so moving the camera around the spin axis
+// only shifts every azimuth along its rays by the same angle. A lensing
+// sample keeps the part of a traced ray that does not depend on the camera
+// azimuth or the animation time: disk hits (radius, azimuth, redshift) in
+// image order, how the ray ended and where it escaped. shadeLensing turns a
+// sample back into the colour traceRay would return.
+
+enum class RayFate : uint8_t {
+    Exhausted = 0,   // bounce or step budget used up
+    Horizon = 1,
+    Escaped = 2
+};
+
+struct LensingSample {
+    RayFate fate = RayFate::Exhausted;
+    int hits = 0;
+    float hitR[MAX_BOUNCES_LIMIT] = {};
+    float hitPhi[MAX_BOUNCES_LIMIT] = {};
+    float hitG[MAX_BOUNCES_LIMIT] = {};
+    float escapeTheta = 0.0f;
+    float escapePhi = 0.0f;
+
+    void addHit(float r, float phi, float g) {
+        if (hits >= MAX_BOUNCES_LIMIT) return;
+        hitR[hits] = r;
+        hitPhi[hits] = phi;
+        hitG[hits] = g;
+        hits++;
+    }
+};
+
+inline Vec3 escapeDirection(float theta, float phi) {
+    return normalize(Vec3{
+        std::sin(theta) * std::cos(phi),
+        std::cos(theta),
+        std::sin(theta) * std::sin(phi)
+    });
+}
+
+// Colour of a recorded ray seen from a camera rotated by phiOffset about
+// the spin axis, with the disk at the given time
+inline Vec3 shadeLensing(const LensingSample& s, float phiOffset, float a, float time, float& brightness) {
+    Vec3 color;
+    brightness = 0.0f;
+    for (int i = 0; i < s.hits; ++i) {
+        Vec3 emission = diskEmission(s.hitR[i], s.hitPhi[i] + phiOffset, 0.0f, time, a);
+        emission *= std::pow(s.hitG[i], 3.0f);
+        color += emission;
+        brightness = std::max(brightness, length(emission));
+    }
+    if (s.fate == RayFate::Horizon) {
+        color = Vec3{};
+    } else if (s.fate == RayFate::Escaped) {
+        color += advancedStarfield(escapeDirection(s.escapeTheta, s.escapePhi + phiOffset));
+    }
+    return color;
+}
+
+// ===================================================================
+// FAR FIELD - ANALYTIC PROPAGATION
+// ===================================================================
+//
+// Outside a sphere r = R >= DISK_OUTER a ray meets neither the disk nor
+// the horizon, and once outgoing it never turns back. There its path
+// follows in closed form from the Mino-time constants lambda and eta (see
+// the Mino section below). With x = 1/r,
+//
+//   dtau = dx / sqrt(X(x)),  X(x) = R(r) x^4
+//        = 1 - (eta + lambda^2 - a^2) x^2 + 2 (eta + (lambda - a)^2) x^3 - a^2 eta x^4
+//
+// is smooth over the far field and integrated by Gauss-Legendre. Near an
+// outer turning point x_t the root of X is divided out and x = x_t - c s^2
+// removes the square-root singularity. The polar equation
+// u'' = -(eta + lambda^2 - a^2) u - 2 a^2 u^3 is solved exactly by
+// u = u+ cn(omega tau | m), and phi collects
+//
+//   int (a P / Delta - a) dtau = int a x (2 - a lambda x) / (1 - 2 x + a^2 x^2) dx / sqrt(X)
+//   lambda int dtau / (1 - u^2) = lambda Pi(n; am(omega tau) | m) / (omega (1 - u+^2))
+//
+// F comes from Carlson's RF and am from the arithmetic-geometric mean.
+// Pi is integrated by Gauss-Legendre in t = atan(sqrt(1 - n) tan am),
+// which takes out its peak at the turning points of u. The tracers
+// move a camera ray that starts outside R in to R (or, if it turns back
+// before reaching R, straight out to ESCAPE_RADIUS) and move a ray that
+// leaves R after a whole step outside it out to ESCAPE_RADIUS. The
+// integrators then only run inside the sphere. Unlike an integrator,
+// which stops at its first step past ESCAPE_RADIUS, the far field lands
+// on it exactly. Rays with eta <= 0, passing within a degree of the spin
+// axis or headed almost straight for the hole (m above FAR_FIELD_MAX_M,
+// where the quadrature loses precision) are integrated as before.
+
+constexpr float FAR_FIELD_RADIUS = 30.0f;   // default interaction sphere
+
+// Smallest 1 - u+^2 of a far-field ray, about a degree from the axis
+constexpr float FAR_FIELD_MIN_POLE_GAP = 3e-4f;
+// Largest elliptic parameter m of a far-field ray; larger m only occurs
+// for impact parameters well inside the shadow
+constexpr float FAR_FIELD_MAX_M = 0.05f;
+// Rays that turn back less than this factor inside the sphere (and outside
+// the disk) stay analytic; relaunching them almost tangent to the sphere
+// would lose the radial momentum to rounding
+constexpr float FAR_FIELD_GRAZE = 1.1f;
+
+// Initial affine step of a ray launched on the sphere, per unit radius;
+// STEP_INITIAL_AFFINE would spend several steps growing back to this
+constexpr float FAR_FIELD_STEP = 0.1f;
+
+// 8-point Gauss-Legendre rule on [-1, 1], positive half
+constexpr float GAUSS8_NODE[4] = {0.1834346425f, 0.5255324099f, 0.7966664774f, 0.9602898565f};
+constexpr float GAUSS8_WEIGHT[4] = {0.3626837834f, 0.3137066459f, 0.2223810345f, 0.1012285363f};
+
+// Carlson's RF by duplication, to float precision
+inline float carlsonRF(float x, float y, float z) {
+    float dx, dy, dz, mean;
+    for (int i = 0; i < 16; ++i) {
+        float sx = std::sqrt(x), sy = std::sqrt(y), sz = std::sqrt(z);
+        float l = sx * (sy + sz) + sy * sz;
+        x = 0.25f * (x + l);
+        y = 0.25f * (y + l);
+        z = 0.25f * (z + l);
+        mean = (x + y + z) * (1.0f / 3.0f);
+        dx = (mean - x) / mean;
+        dy = (mean - y) / mean;
+        dz = (mean - z) / mean;
+        if (std::max(std::fabs(dx), std::max(std::fabs(dy), std::fabs(dz))) < 0.01f) break;
+    }
+    float e2 = dx * dy - dz * dz, e3 = dx * dy * dz;
+    return (1.0f + (e2 / 24.0f - 0.1f - 3.0f * e3 / 44.0f) * e2 + e3 / 14.0f) / std::sqrt(mean);
+}
+
+// Legendre's F(phi | m) for any phi
+inline float ellipticF(float phi, float m) {
+    float j = std::round(phi / PI);
+    float s = std::sin(phi - j * PI), c = std::cos(phi - j * PI);
+    float K = j != 0.0f ? carlsonRF(0.0f, 1.0f - m, 1.0f) : 0.0f;
+    return 2.0f * j * K + s * carlsonRF(c * c, 1.0f - m * s * s, 1.0f);
+}
+
+// Jacobi amplitude am(psi | m), continuous in psi (arithmetic-geometric mean)
+inline float jacobiAmplitude(float psi, float m) {
+    float ratio[8];
+    float a = 1.0f, b = std::sqrt(1.0f - m), c = std::sqrt(m);
+    int n = 0;
+    while (n < 8 && c > 1e-7f * a) {
+        float next = 0.5f * (a + b);
+        c = 0.5f * (a - b);
+        b = std::sqrt(a * b);
+        a = next;
+        ratio[n++] = c / a;
+    }
+    float phi = std::ldexp(a * psi, n);
+    for (int i = n - 1; i >= 0; --i) phi = 0.5f * (phi + std::asin(ratio[i] * std::sin(phi)));
+    return phi;
+}
+
+// Per-ray constants of the far-field solution
+struct FarField {
+    bool valid = false;
+    float a = 0.0f, lambda = 0.0f, eta = 0.0f;
+    float turnX = 0.0f;      // 1/r of the outer radial turning point, 0 if none
+    float uMax = 0.0f;       // polar amplitude u+
+    float omega = 0.0f;      // polar frequency in Mino time
+    float m = 0.0f;          // elliptic parameter
+    float n = 0.0f;          // Pi characteristic, -u+^2 / (1 - u+^2)
+    float polarPhi = 0.0f;   // lambda / (omega sqrt(1 - u+^2))
+};
+
+// Ray in the far field: r, u = cos(theta), phi and the signs of dr/dtau and
+// du/dtau in the traced direction
+struct FarFieldPoint {
+    float r = 0.0f, u = 0.0f, phi = 0.0f;
+    float rSign = -1.0f, uSign = 1.0f;
+};
+
+enum class FarFieldPath : uint8_t {
+    Traced = 0,   // outside the far field or not far-field capable: unchanged
+    Entered = 1,  // moved in to the interaction sphere
+    Escaped = 2   // moved out to ESCAPE_RADIUS
+};
+
+inline float farFieldX(const FarField& f, float x) {
+    float a2 = f.a * f.a, lma = f.lambda - f.a;
+    return 1.0f + x * x * (-(f.eta + f.lambda * f.lambda - a2) + x * (2.0f * (f.eta + lma * lma) - x * a2 * f.eta));
+}
+
+inline FarField makeFarField(float a, float lambda, float eta) {
+    FarField f;
+    f.a = a;
+    f.lambda = lambda;
+    f.eta = eta;
+    float alpha = eta + lambda * lambda - a * a;
+    if (eta <= 0.0f || alpha <= 0.0f) return f;
+
+    float S = std::sqrt(alpha * alpha + 4.0f * a * a * eta);
+    float u2 = 2.0f * eta / (alpha + S);
+    if (1.0f - u2 < FAR_FIELD_MIN_POLE_GAP || a * a * u2 > FAR_FIELD_MAX_M * S) return f;
+    f.uMax = std::sqrt(u2);
+    f.omega = std::sqrt(S);
+    f.m = a * a * u2 / S;
+    f.n = -u2 / (1.0f - u2);
+    f.polarPhi = lambda / (f.omega * std::sqrt(1.0f - u2));
+
+    // Outer root of X by Newton from the flat-space turning point 1/b;
+    // kept only if it lies well outside the photon orbits
+    float lma = lambda - a;
+    float x = 1.0f / std::sqrt(alpha);
+    for (int i = 0; i < 8; ++i) {
+        float dX = x * (-2.0f * alpha + x * (6.0f * (eta + lma * lma) - 4.0f * x * a * a * eta));
+        if (dX >= 0.0f) break;
+        float dx = farFieldX(f, x) / dX;
+        x -= dx;
+        if (std::fabs(dx) < 1e-6f * x) break;
+    }
+    if (x > 0.0f && x < 0.25f && std::fabs(farFieldX(f, x)) < 1e-5f) f.turnX = x;
+    f.valid = true;
+    return f;
+}
+
+// Mino time and radial phi term int a x (2 - a lambda x) / (1 - 2x + a^2 x^2) dtau
+// between xa < xb on one radial branch
+inline void farFieldRadial(const FarField& f, float xa, float xb, float& dtau, float& dphi) {
+    const float a2 = f.a * f.a, lma = f.lambda - f.a;
+    // X(x) = (x - turnX) Q(x) by synthetic division
+    const float x0 = f.turnX;
+    const float q3 = -a2 * f.eta;
+    const float q2 = 2.0f * (f.eta + lma * lma) + x0 * q3;
+    const float q1 = -(f.eta + f.lambda * f.lambda - a2) + x0 * q2;
+    const float q0 = x0 * q1;
+    const bool turning = x0 > 0.0f && xb <= x0;
+
+    // Turning branch: x = turnX - span s^2 for s in [sb, 1]
+    float span = x0 - xa;
+    float lo = turning ? std::sqrt(std::max(x0 - xb, 0.0f) / span) : xa;
+    float hi = turning ? 1.0f : xb;
+    float mid = 0.5f * (lo + hi), half = 0.5f * (hi - lo);
+
+    dtau = 0.0f;
+    dphi = 0.0f;
+    for (int i = 0; i < 8; ++i) {
+        float t = mid + half * (i < 4 ? -GAUSS8_NODE[i] : GAUSS8_NODE[i - 4]);
+        float x, g;
+        if (turning) {
+            x = x0 - span * t * t;
+            float Q = q0 + x * (q1 + x * (q2 + x * q3));
+            g = 2.0f * std::sqrt(span) / std::sqrt(std::max(-Q, 1e-12f));
+        } else {
+            x = t;
+            g = 1.0f / std::sqrt(std::max(farFieldX(f, x), 1e-12f));
+        }
+        g *= half * GAUSS8_WEIGHT[i & 3];
+        dtau += g;
+        dphi += g * f.a * x * (2.0f - f.a * f.lambda * x) / (1.0f - 2.0f * x + a2 * x * x);
+    }
+}
+
+// Polar motion over dtau of Mino time; returns lambda int dtau / (1 - u^2)
+inline float farFieldPolar(const FarField& f, float dtau, float& u, float& uSign) {
+    float am0 = std::acos(clampf(u / f.uMax, -1.0f, 1.0f));
+    if (uSign > 0.0f) am0 = -am0;
+    float am1 = jacobiAmplitude(ellipticF(am0, f.m) + f.omega * dtau, f.m);
+    u = f.uMax * std::cos(am1);
+    uSign = std::sin(am1) > 0.0f ? -1.0f : 1.0f;
+
+    // Pi(n; am1 | m) - Pi(n; am0 | m) = int dt / sqrt(1 - m sin^2 t / (1 - n cos^2 t)) / sqrt(1 - n)
+    const float stretch = std::sqrt(1.0f - f.n);
+    auto amplitudeT = [stretch](float am) {
+        float j = std::round(am / PI);
+        return j * PI + std::atan(stretch * std::tan(am - j * PI));
+    };
+    float t0 = amplitudeT(am0), t1 = amplitudeT(am1);
+    float mid = 0.5f * (t0 + t1), half = 0.5f * (t1 - t0);
+    float sum = 0.0f;
+    for (int i = 0; i < 8; ++i) {
+        float t = mid + half * (i < 4 ? -GAUSS8_NODE[i] : GAUSS8_NODE[i - 4]);
+        float s = std::sin(t), c = std::cos(t);
+        sum += GAUSS8_WEIGHT[i & 3] / std::sqrt(1.0f - f.m * s * s / (1.0f - f.n * c * c));
+    }
+    return f.polarPhi * half * sum;
+}
+
+// Moves a ray that is outside the sphere r = radius: an outgoing one to
+// ESCAPE_RADIUS, an incoming one in to radius or, if it turns back first,
+// out to ESCAPE_RADIUS
+inline FarFieldPath farFieldPropagate(const FarField& f, float radius, FarFieldPoint& p) {
+    if (!f.valid || p.r <= radius || p.r >= ESCAPE_RADIUS) return FarFieldPath::Traced;
+    const float x = 1.0f / p.r, xEscape = 1.0f / ESCAPE_RADIUS, xSphere = 1.0f / radius;
+
+    float dtau, dphi;
+    FarFieldPath path = FarFieldPath::Escaped;
+    if (p.rSign > 0.0f) {
+        farFieldRadial(f, xEscape, x, dtau, dphi);
+    } else if (f.turnX > 0.0f && f.turnX <= std::min(xSphere * FAR_FIELD_GRAZE, 1.0f / DISK_OUTER)) {
+        float tauOut, phiOut;
+        farFieldRadial(f, x, f.turnX, dtau, dphi);
+        farFieldRadial(f, xEscape, f.turnX, tauOut, phiOut);
+        dtau += tauOut;
+        dphi += phiOut;
+    } else {
+        farFieldRadial(f, x, xSphere, dtau, dphi);
+        path = FarFieldPath::Entered;
+    }
+    dphi += farFieldPolar(f, dtau, p.u, p.uSign);
+    p.phi -= dphi;
+    p.r = path == FarFieldPath::Entered ? radius : ESCAPE_RADIUS;
+    p.rSign = path == FarFieldPath::Entered ? -1.0f : 1.0f;
+    return path;
+}
+
+// Far-field constants and position of a camera ray (see launchMino)
+inline FarField farFieldLaunch(Vec3 rayOrigin, Vec3 rayDir, float a, FarFieldPoint& p) {
+    ZamoFrame f = zamoFrame(rayOrigin, rayDir, a);
+    float E, Lz, Q;
+    photonConstants(f, a, E, Lz, Q);
+    p.r = f.r;
+    p.u = f.cosTheta;
+    p.phi = f.phi;
+    p.rSign = f.n_r < 0.0f ? -1.0f : 1.0f;
+    p.uSign = f.n_theta > 0.0f ? -1.0f : 1.0f;
+    return makeFarField(a, Lz / E, Q / (E * E));
+}
+
+// Origin and direction of a camera ray at p with the far field's
+// constants, so that launchRay / launchMino continue the same geodesic
+inline void farFieldRay(const FarField& ff, const FarFieldPoint& p, Vec3& rayOrigin, Vec3& rayDir) {
+    float sinTheta = std::sqrt(std::max(1.0f - p.u * p.u, 0.0f));
+    Vec3 e_r{sinTheta * std::cos(p.phi), p.u, sinTheta * std::sin(p.phi)};
+    Vec3 e_theta{p.u * std::cos(p.phi), -sinTheta, p.u * std::sin(p.phi)};
+    Vec3 e_phi{-std::sin(p.phi), 0.0f, std::cos(p.phi)};
+    rayOrigin = e_r * p.r;
+
+    // Inverse of photonConstants: lambda fixes n_phi, eta fixes |n_theta|
+    ZamoFrame f = zamoFrame(rayOrigin, e_r, ff.a);
+    float n_phi = ff.lambda * f.alpha / (f.varpi * (ff.lambda * f.omega - 1.0f));
+    float E = f.alpha - f.omega * f.varpi * n_phi;
+    float u2 = p.u * p.u;
+    float U = ff.eta - (ff.eta + ff.lambda * ff.lambda - ff.a * ff.a) * u2 - ff.a * ff.a * u2 * u2;
+    float polar = U / std::max(1.0f - u2, 1e-8f);
+    float n_theta = -p.uSign * E * std::sqrt(std::max(polar, 0.0f) / f.sig);
+    float n_r = p.rSign * std::sqrt(std::max(1.0f - n_phi * n_phi - n_theta * n_theta, 0.0f));
+    rayDir = e_r * n_r + e_theta * n_theta + e_phi * n_phi;
+}
+
+// Far-field start of a camera ray outside the sphere r = radius. When the
+// ray enters the sphere, rayOrigin and rayDir move to where it does; when
+// it escapes without entering, the result is Escaped and p holds the
+// escape point.
+inline FarFieldPath farFieldStart(Vec3& rayOrigin, Vec3& rayDir, float a, float radius,
+                                  FarField& f, FarFieldPoint& p) {
+    f = farFieldLaunch(rayOrigin, rayDir, a, p);
+    FarFieldPath path = farFieldPropagate(f, radius, p);
+    if (path == FarFieldPath::Entered) farFieldRay(f, p, rayOrigin, rayDir);
+    return path;
+}
+
+// Escape position angles of a ray leaving the sphere outward at (r, u, phi)
+// with du/dtau of the sign of uRate; a ray already past ESCAPE_RADIUS
+// keeps its position
+inline void farFieldEscape(const FarField& f, float radius, float r, float u, float phi, float uRate,
+                           float& escapeTheta, float& escapePhi) {
+    FarFieldPoint p;
+    p.r = r;
+    p.u = u;
+    p.phi = phi;
+    p.rSign = 1.0f;
+    p.uSign = uRate > 0.0f ? 1.0f : -1.0f;
+    farFieldPropagate(f, radius, p);
+    escapeTheta = std::acos(clampf(p.u, -1.0f, 1.0f));
+    escapePhi = p.phi;
+}
+
+// ===================================================================
+// MAIN RAY TRACING WITH MULTIPLE BOUNCES
+// ===================================================================
+
+// Sky colour and lensing record of a ray escaping at the given position angles
+inline Vec3 escapeRay(float theta, float phi, LensingSample* record) {
+    if (record) {
+        record->fate = RayFate::Escaped;
+        record->escapeTheta = theta;
+        record->escapePhi = phi;
+    }
+    return advancedStarfield(escapeDirection(theta, phi));
+}
+
+// record, if given, receives the ray's lensing sample. farFieldRadius > 0
+// integrates only inside that sphere (see FAR FIELD above). maxSteps and
+// finalState (the last integrated state; E = 0 if none) serve accuracy
+// measurements, diag diagnostic images.
+inline Vec3 traceRay(Vec3 rayOrigin, Vec3 rayDir, float a, int maxBounces, float time,
+                     const StepTolerances& tol, float& brightness, StepCounts& steps,
+                     LensingSample* record = nullptr, float farFieldRadius = 0.0f,
+                     int maxSteps = MAX_STEPS, RayState* finalState = nullptr,
+                     RayDiagnostics* diag = nullptr) {
+    steps = StepCounts{};
+    if (record) *record = LensingSample{};
+    if (finalState) *finalState = RayState{};
+    if (diag) *diag = RayDiagnostics{0.0f, length(rayOrigin)};
+    brightness = 0.0f;
+
+    FarField far;
+    FarFieldPoint farPoint;
+    FarFieldPath farPath = farFieldRadius > 0.0f
+        ? farFieldStart(rayOrigin, rayDir, a, farFieldRadius, far, farPoint) : FarFieldPath::Traced;
+    if (farPath == FarFieldPath::Escaped) return escapeRay(std::acos(farPoint.u), farPoint.phi, record);
+
+    RayState ray = launchRay(rayOrigin, rayDir, a);
+    float lambda = ray.Lz / ray.E;
+
+    StepController control;
+    control.h = farPath == FarFieldPath::Entered ? FAR_FIELD_STEP * farFieldRadius : STEP_INITIAL_AFFINE;
+    float r_horizon = eventHorizon(a);
+
+    Vec3 accumulatedColor;
+    float accumulatedBrightness = 0.0f;
+    int bounceCount = 0;
+
+    while (steps.attempts() < maxSteps) {
+        // Error-controlled step, retried from the same state on rejection
+        RayState prev = ray;
+        Vec4 pos_err, vel_err;
+        rk5Step(ray, a, control.h, pos_err, vel_err);
+        float error = scaledStepError(prev, ray, pos_err, vel_err, tol);
+        if (!control.update(error)) {
+            ray = prev;
+            steps.rejected++;
+            continue;
+        }
+        steps.accepted++;
+        if (diag) {
+            diag->maxError = std::max(diag->maxError, error);
+            diag->finalR = ray.pos.y;
+        }
+
+        float r = ray.pos.y;
+        float theta = ray.pos.z;
+
+        // Check horizon
+        if (r < r_horizon * 1.01f) {
+            accumulatedColor = Vec3{};
+            if (record) record->fate = RayFate::Horizon;
+            break;
+        }
+
+        // Far field: a whole step outside the sphere, moving out
+        if (far.valid && prev.pos.y > farFieldRadius && ray.vel.y > 0.0f) {
+            // theta may have run through a pole; u and phi are those of the
+            // same point with theta in [0, pi]
+            float escapeTheta, escapePhi;
+            farFieldEscape(far, farFieldRadius, r, std::cos(theta), ray.pos.w + (std::sin(theta) < 0.0f ? PI : 0.0f),
+                           -std::sin(theta) * ray.vel.z, escapeTheta, escapePhi);
+            accumulatedColor += escapeRay(escapeTheta, escapePhi, record);
+            break;
+        }
+
+        // Escape to infinity
+        if (r > ESCAPE_RADIUS) {
+            Vec3 finalDir = normalize(Vec3{
+                std::sin(theta) * std::cos(ray.pos.w),
+                std::cos(theta),
+                std::sin(theta) * std::sin(ray.pos.w)
+            });
+            accumulatedColor += advancedStarfield(finalDir);
+            if (record) {
+                record->fate = RayFate::Escaped;
+                record->escapeTheta = theta;
+                record->escapePhi = ray.pos.w;
+            }
+            break;
+        }
+
+        // Disk crossing; the ray continues on its geodesic for higher-order images
+        float diskR, diskPhi;
+        if (crossDisk(prev.pos.y, std::cos(prev.pos.z), prev.pos.w, r, std::cos(theta), ray.pos.w, diskR, diskPhi)) {
+            float g = diskRedshift(diskR, a, lambda);
+            Vec3 emission = diskEmission(diskR, diskPhi, 0.0f, time, a);
+
+            // Doppler beaming
+            emission *= std::pow(g, 3.0f);
+            if (record) record->addHit(diskR, diskPhi, g);
+
+            accumulatedColor += emission;
+            accumulatedBrightness = std::max(accumulatedBrightness, length(emission));
+
+            bounceCount++;
+            if (bounceCount >= maxBounces) break;
+        }
+    }
+
+    if (finalState) *finalState = ray;
+    brightness = accumulatedBrightness;
+    return accumulatedColor;
+}
+
+// ===================================================================
+// CONSERVED-QUANTITY INTEGRATOR - MINO TIME
+// ===================================================================
+//
+// With E = 1, Lz = lambda and Carter constant Q = eta fixed at launch, the
+// null geodesic equations in Mino time (d/dtau = Sigma d/dlambda) separate:
+//
+//   (dr/dtau)^2 = R(r) = P^2 - Delta (eta + (lambda - a)^2),  P = r^2 + a^2 - a lambda
+//   (du/dtau)^2 = U(u) = eta - (eta + lambda^2 - a^2) u^2 - a^2 u^4,  u = cos(theta)
+//   dphi/dtau   = a P / Delta - a + lambda / (1 - u^2)
+//
+// Rays are traced backwards from the camera, so tau runs against the
+// photon's motion: dr/dtau and du/dtau are the negated photon velocities
+// (their equations are even in tau) and dphi/dtau takes the opposite sign.
+// dt/dtau is not needed for imaging and is dropped. The square roots are
+// singular at turning points, so r and u are advanced through
+// d2r/dtau2 = R'(r)/2 and d2u/dtau2 = U'(u)/2, which carry the sign of the
+// velocity through each turning point. After every step the velocities are
+// projected back onto +-sqrt(R) and +-sqrt(U), so E, Lz and Q stay exact.
+
+struct MinoConstants {
+    float a = 0.0f;
+    float lambda = 0.0f;   // Lz / E
+    float eta = 0.0f;      // Q / E^2
+};
+
+template <typename T>
+struct MinoStateT {
+    T r = 0, u = 0, phi = 0;   // position (t is not tracked)
+    T rdot = 0, udot = 0;      // dr/dtau, du/dtau
+};
+
+using MinoState = MinoStateT<float>;
+
+template <typename T>
+inline T radialPotential(T r, const MinoConstants& c) {
+    T a = T(c.a), lambda = T(c.lambda), eta = T(c.eta);
+    T P = r * r + a * a - a * lambda;
+    T K = eta + (lambda - a) * (lambda - a);
+    return P * P - delta(r, a) * K;
+}
+
+template <typename T>
+inline T polarPotential(T u, const MinoConstants& c) {
+    T a = T(c.a), lambda = T(c.lambda), eta = T(c.eta);
+    T u2 = u * u;
+    return eta - (eta + lambda * lambda - a * a) * u2 - a * a * u2 * u2;
+}
+
+template <typename T>
+inline MinoStateT<T> minoDerivatives(const MinoStateT<T>& s, const MinoConstants& c) {
+    T a = T(c.a), lambda = T(c.lambda), eta = T(c.eta);
+    T P = s.r * s.r + a * a - a * lambda;
+    T K = eta + (lambda - a) * (lambda - a);
+    T sin2 = std::max(T(1) - s.u * s.u, T(1e-8));
+
+    MinoStateT<T> d;
+    d.r = s.rdot;
+    d.u = s.udot;
+    d.phi = -(a * P / delta(s.r, a) - a + lambda / sin2);
+    d.rdot = T(2) * s.r * P - (s.r - T(M)) * K;
+    d.udot = -(eta + lambda * lambda - a * a) * s.u - T(2) * a * a * s.u * s.u * s.u;
+    return d;
+}
+
+template <typename T>
+inline MinoStateT<T> minoCombine(const MinoStateT<T>& s, T h, std::initializer_list<std::pair<T, const MinoStateT<T>*>> terms) {
+    MinoStateT<T> out = s;
+    for (const auto& term : terms) {
+        T w = h * term.first;
+        out.r += w * term.second->r;
+        out.u += w * term.second->u;
+        out.phi += w * term.second->phi;
+        out.rdot += w * term.second->rdot;
+        out.udot += w * term.second->udot;
+    }
+    return out;
+}
+
+// Put the velocities back on the constraint surface, keeping their signs.
+// Inside a turning zone (potential small against its own terms) the
+// velocity is left to the second-order dynamics, which reverse it; in
+// float, u near a pole can stall for several steps and re-projecting there
+// would pin |du/dtau| and stop the turn.
+template <typename T>
+inline void projectMino(MinoStateT<T>& s, const MinoConstants& c) {
+    const T turningZone = T(1e-4);
+    T a = T(c.a), lambda = T(c.lambda), eta = T(c.eta);
+    s.u = std::min(std::max(s.u, T(-1)), T(1));
+
+    T R = radialPotential(s.r, c);
+    T P = s.r * s.r + a * a - a * lambda;
+    T radialScale = P * P + std::fabs(delta(s.r, a)) * (eta + (lambda - a) * (lambda - a));
+    if (R > turningZone * radialScale) s.rdot = std::copysign(std::sqrt(R), s.rdot);
+
+    T U = polarPotential(s.u, c);
+    T polarScale = std::fabs(eta) + lambda * lambda + a * a;
+    if (U > turningZone * polarScale) s.udot = std::copysign(std::sqrt(U), s.udot);
+}
+
+// Cash-Karp RK5 step in Mino time (same tableau as rk5Step); err receives
+// the embedded error of each component
+template <typename T>
+inline void rk5StepMino(MinoStateT<T>& s, const MinoConstants& c, T h, MinoStateT<T>& err) {
+    const T b21 = T(0.2);
+    const T b31 = T(3.0 / 40.0), b32 = T(9.0 / 40.0);
+    const T b41 = T(0.3), b42 = T(-0.9), b43 = T(1.2);
+    const T b51 = T(-11.0 / 54.0), b52 = T(2.5), b53 = T(-70.0 / 27.0), b54 = T(35.0 / 27.0);
+    const T b61 = T(1631.0 / 55296.0), b62 = T(175.0 / 512.0), b63 = T(575.0 / 13824.0);
+    const T b64 = T(44275.0 / 110592.0), b65 = T(253.0 / 4096.0);
+    const T c1 = T(37.0 / 378.0), c3 = T(250.0 / 621.0), c4 = T(125.0 / 594.0), c6 = T(512.0 / 1771.0);
+    const T dc1 = c1 - T(2825.0 / 27648.0), dc3 = c3 - T(18575.0 / 48384.0);
+    const T dc4 = c4 - T(13525.0 / 55296.0), dc5 = T(-277.0 / 14336.0), dc6 = c6 - T(0.25);
+
+    MinoStateT<T> k1 = minoDerivatives(s, c);
+    MinoStateT<T> k2 = minoDerivatives(minoCombine(s, h, {{b21, &k1}}), c);
+    MinoStateT<T> k3 = minoDerivatives(minoCombine(s, h, {{b31, &k1}, {b32, &k2}}), c);
+    MinoStateT<T> k4 = minoDerivatives(minoCombine(s, h, {{b41, &k1}, {b42, &k2}, {b43, &k3}}), c);
+    MinoStateT<T> k5 = minoDerivatives(minoCombine(s, h, {{b51, &k1}, {b52, &k2}, {b53, &k3}, {b54, &k4}}), c);
+    MinoStateT<T> k6 = minoDerivatives(minoCombine(s, h, {{b61, &k1}, {b62, &k2}, {b63, &k3}, {b64, &k4}, {b65, &k5}}), c);
+
+    MinoStateT<T> zero{};
+    err = minoCombine(zero, h, {{dc1, &k1}, {dc3, &k3}, {dc4, &k4}, {dc5, &k5}, {dc6, &k6}});
+
+    s = minoCombine(s, h, {{c1, &k1}, {c3, &k3}, {c4, &k4}, {c6, &k6}});
+    projectMino(s, c);
+}
+
+template <typename T>
+inline void rk5StepMino(MinoStateT<T>& s, const MinoConstants& c, T h, T& error) {
+    MinoStateT<T> err;
+    rk5StepMino(s, c, h, err);
+    error = std::sqrt(err.r * err.r + err.u * err.u + err.phi * err.phi)
+          + std::sqrt(err.rdot * err.rdot + err.udot * err.udot);
+}
+
+// Max-norm of a Mino step error; (r, u, phi) use the position tolerances,
+// (dr/dtau, du/dtau) the momentum ones. phi is scaled by one radian, as in
+// the affine norm.
+template <typename T>
+inline T scaledStepError(const MinoStateT<T>& before, const MinoStateT<T>& after,
+                         const MinoStateT<T>& err, const StepTolerances& tol) {
+    T norm = scaledComponent(err.r, before.r, after.r, tol.relPos, tol.absPos);
+    norm = std::max(norm, scaledComponent(err.u, before.u, after.u, tol.relPos, tol.absPos));
+    norm = std::max(norm, scaledComponent(err.phi, T(1), T(1), tol.relPos, tol.absPos));
+    norm = std::max(norm, scaledComponent(err.rdot, before.rdot, after.rdot, tol.relMom, tol.absMom));
+    norm = std::max(norm, scaledComponent(err.udot, before.udot, after.udot, tol.relMom, tol.absMom));
+    return norm;
+}
+
+// Mino state of a camera ray: conserved quantities of the photon arriving
+// from rayDir at a ZAMO camera, velocities pointing back along rayDir
+inline void launchMino(Vec3 rayOrigin, Vec3 rayDir, float a, MinoState& s, MinoConstants& c) {
+    ZamoFrame f = zamoFrame(rayOrigin, rayDir, a);
+    float E, Lz, Q;
+    photonConstants(f, a, E, Lz, Q);
+
+    c.a = a;
+    c.lambda = Lz / E;
+    c.eta = Q / (E * E);
+
+    s.r = f.r;
+    s.u = f.cosTheta;
+    s.phi = f.phi;
+    s.rdot = std::sqrt(f.sig * f.dlt) * f.n_r / E;
+    s.udot = -f.sinTheta * std::sqrt(f.sig) * f.n_theta / E;
+    projectMino(s, c);
+}
+
+// Initial Mino-time step: a fixed fraction of r, shortened near the poles so
+// that the rapid swing of phi on near-polar orbits is resolved
+inline float minoStepSize(const MinoState& s, const MinoConstants& c) {
+    float h = MINO_STEP_SCALE / s.r;
+    float sin2 = std::max(1.0f - s.u * s.u, 1e-8f);
+    float poleLimit = MINO_POLE_STEP * sin2 / std::max(std::fabs(c.lambda), 1e-6f);
+    return std::min(h, poleLimit);
+}
+
+inline Vec3 traceRayMino(Vec3 rayOrigin, Vec3 rayDir, float a, int maxBounces, float time,
+                         const StepTolerances& tol, float& brightness, StepCounts& steps,
+                         LensingSample* record = nullptr, float farFieldRadius = 0.0f,
+                         int maxSteps = MAX_STEPS, RayDiagnostics* diag = nullptr) {
+    steps = StepCounts{};
+    if (record) *record = LensingSample{};
+    if (diag) *diag = RayDiagnostics{0.0f, length(rayOrigin)};
+    brightness = 0.0f;
+
+    FarField far;
+    FarFieldPoint farPoint;
+    FarFieldPath farPath = farFieldRadius > 0.0f
+        ? farFieldStart(rayOrigin, rayDir, a, farFieldRadius, far, farPoint) : FarFieldPath::Traced;
+    if (farPath == FarFieldPath::Escaped) return escapeRay(std::acos(farPoint.u), farPoint.phi, record);
+
+    MinoState s;
+    MinoConstants c;
+    launchMino(rayOrigin, rayDir, a, s, c);
+
+    StepController control;
+    control.h = minoStepSize(s, c);
+    float r_horizon = eventHorizon(a);
+
+    Vec3 accumulatedColor;
+    float accumulatedBrightness = 0.0f;
+    int bounceCount = 0;
+
+    while (steps.attempts() < maxSteps) {
+        MinoState prev = s;
+        MinoState err;
+        rk5StepMino(s, c, control.h, err);
+        float error = scaledStepError(prev, s, err, tol);
+        if (!control.update(error)) {
+            s = prev;
+            steps.rejected++;
+            continue;
+        }
+        steps.accepted++;
+        if (diag) {
+            diag->maxError = std::max(diag->maxError, error);
+            diag->finalR = s.r;
+        }
+
+        if (s.r < r_horizon * 1.01f) {
+            accumulatedColor = Vec3{};
+            if (record) record->fate = RayFate::Horizon;
+            break;
+        }
+
+        if (far.valid && prev.r > farFieldRadius && s.rdot > 0.0f) {
+            float escapeTheta, escapePhi;
+            farFieldEscape(far, farFieldRadius, s.r, s.u, s.phi, s.udot, escapeTheta, escapePhi);
+            accumulatedColor += escapeRay(escapeTheta, escapePhi, record);
+            break;
+        }
+
+        if (s.r > ESCAPE_RADIUS) {
+            float theta = std::acos(s.u);
+            Vec3 finalDir = normalize(Vec3{
+                std::sin(theta) * std::cos(s.phi),
+                std::cos(theta),
+                std::sin(theta) * std::sin(s.phi)
+            });
+            accumulatedColor += advancedStarfield(finalDir);
+            if (record) {
+                record->fate = RayFate::Escaped;
+                record->escapeTheta = theta;
+                record->escapePhi = s.phi;
+            }
+            break;
+        }
+
+        // Thin disk in the equatorial plane: every crossing inside the disk
+        // adds one image order and the ray continues on its geodesic
+        float diskR, diskPhi;
+        if (crossDisk(prev.r, prev.u, prev.phi, s.r, s.u, s.phi, diskR, diskPhi)) {
+            float g = diskRedshift(diskR, a, c.lambda);
+            Vec3 emission = diskEmission(diskR, diskPhi, 0.0f, time, a);
+            emission *= std::pow(g, 3.0f);
+            if (record) record->addHit(diskR, diskPhi, g);
+
+            accumulatedColor += emission;
+            accumulatedBrightness = std::max(accumulatedBrightness, length(emission));
+
+            bounceCount++;
+            if (bounceCount >= maxBounces) break;
+        }
+    }
+
+    brightness = accumulatedBrightness;
+    return accumulatedColor;
+}
+
+// ===================================================================
+// POST-PROCESSING
+// ===================================================================
+
+inline Vec3 acesToneMapping(Vec3 color) {
+    const float a = 2.51f, b = 0.03f, c = 2.43f, d = 0.59f, e = 0.14f;
+    return clamp01((color * (color * a + b)) / (color * (color * c + d) + e));
+}
+
+// Exposure, tone mapping, gamma and vignette from the end of main()
+inline Vec3 finishPixel(Vec3 color, float exposure, float ndcX, float ndcY) {
+    color *= exposure;
+    color = acesToneMapping(color);
+    color = {std::pow(color.x, 1.0f / 2.2f), std::pow(color.y, 1.0f / 2.2f), std::pow(color.z, 1.0f / 2.2f)};
+    float vignette = smoothstep(0.8f, 0.3f, std::sqrt(ndcX * ndcX + ndcY * ndcY));
+    color *= 0.4f + 0.6f * vignette;
+    return color;
+}
+
+// Full per-pixel pipeline equivalent to one compute shader invocation
+inline Vec3 renderPixel(const RenderParams& p, const Camera& cam, int x, int y, StepCounts& steps,
+                        LensingSample* record = nullptr, RayDiagnostics* diag = nullptr) {
+    float ndcX, ndcY;
+    pixelNdc(p, float(x), float(y), ndcX, ndcY);
+    Vec3 rayDir = cameraRay(cam, ndcX, ndcY);
+
+    float brightness;
+    Vec3 color = p.integrator == Integrator::Mino
+        ? traceRayMino(cam.position, rayDir, p.spin, p.maxBounces, p.time, p.tolerances, brightness, steps,
+                       record, p.farFieldRadius, MAX_STEPS, diag)
+        : traceRay(cam.position, rayDir, p.spin, p.maxBounces, p.time, p.tolerances, brightness, steps,
+                   record, p.farFieldRadius, MAX_STEPS, nullptr, diag);
+    return finishPixel(color, p.exposure, ndcX, ndcY);
+}
+
+// Same pixel shaded from its lensing sample instead of a traced ray
+inline Vec3 shadePixel(const RenderParams& p, int x, int y, const LensingSample& sample, float phiOffset) {
+    float ndcX, ndcY;
+    pixelNdc(p, float(x), float(y), ndcX, ndcY);
+
+    float brightness;
+    Vec3 color = shadeLensing(sample, phiOffset, p.spin, p.time, brightness);
+    return finishPixel(color, p.exposure, ndcX, ndcY);
+}
+
+} // namespace kerr
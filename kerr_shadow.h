@@ -0,0 +1,205 @@
+/*
+ * Analytic Kerr shadow outline
+ * C++17, header-only
+ *
+ * Rays that start inside the black hole's shadow fall through the horizon
+ * and are drawn black, whatever they met on the way. They are also the
+ * most expensive rays of a frame: they integrate all the way down to
+ * r_horizon * 1.01. The edge of the shadow is known in closed form, so
+ * these rays can be recognised before they are traced.
+ *
+ * Photons on the edge come from the spherical photon orbits at radii r
+ * between the prograde and retrograde photon orbits. Each orbit has the
+ * constants (M = 1, E = 1)
+ *
+ *   xi(r)  = Lz = (r^2 (3 - r) - a^2 (r + 1)) / (a (r - 1))
+ *   eta(r) = Q  = r^3 (4 a^2 - r (r - 3)^2) / (a^2 (r - 1)^2)
+ *
+ * Inverting photonConstants() (kerr_physics.h) for the ZAMO camera gives
+ * each orbit's direction on the sky, two directions when it reaches the
+ * camera's latitude at all. Those directions, projected onto the image
+ * plane, trace the outline. It is kept as a radius per angle about its
+ * centroid. Each bin keeps the smallest radius seen across it, so the
+ * table lies inside the shadow. A pixel is captured when it lies
+ * inside the table radius shrunk by a relative margin.
+ *
+ * The test assumes that a ray deep inside the shadow crosses the disk
+ * fewer than maxBounces times before the horizon: a ray that runs out of
+ * bounces first keeps the disk colour. With two bounces a few rays below
+ * the shadow's centre cross the disk twice, so skipping needs at least
+ * SHADOW_MIN_BOUNCES. kerr_cpu --selftest checks that every skipped pixel
+ * traces to the horizon in black.
+ */
+
+#pragma once
+
+#include "kerr_physics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace kerr {
+
+constexpr int SHADOW_OUTLINE_BINS = 256;
+// Default margin: pixels within this fraction of the outline radius of the
+// edge are traced
+constexpr float SHADOW_MARGIN = 0.05f;
+// Fewest bounces for which skipping is exact, see above
+constexpr int SHADOW_MIN_BOUNCES = 3;
+
+// Shadow outline in image-plane coordinates, i.e. pixel NDC times the
+// camera's fovScale
+struct ShadowOutline {
+    bool valid = false;
+    float centerX = 0.0f, centerY = 0.0f;
+    float radius[SHADOW_OUTLINE_BINS] = {};
+
+    static int bin(float dx, float dy) {
+        float t = (std::atan2(dy, dx) + PI) * (float(SHADOW_OUTLINE_BINS) / TWO_PI);
+        return std::min(std::max(int(t), 0), SHADOW_OUTLINE_BINS - 1);
+    }
+
+    bool captures(float x, float y, float margin = SHADOW_MARGIN) const {
+        if (!valid) return false;
+        float dx = x - centerX, dy = y - centerY;
+        float r = radius[bin(dx, dy)] * (1.0f - margin);
+        return dx * dx + dy * dy < r * r;
+    }
+};
+
+// Boyer-Lindquist radius of the circular equatorial photon orbit
+inline double photonOrbitRadius(double a, bool prograde) {
+    return 2.0 * (1.0 + std::cos(2.0 / 3.0 * std::acos(prograde ? -a : a)));
+}
+
+// Outline of the shadow seen by cam around a black hole of spin a; invalid
+// when the camera is too close for the shadow to fit in front of it
+inline ShadowOutline shadowOutline(const Camera& cam, float spin) {
+    ShadowOutline outline;
+    // The constants are singular at a = 0; the outline is continuous there
+    const double a = std::max((double)std::fabs(spin), 1e-3);
+    const double rPro = photonOrbitRadius(a, true);
+    const double rRetro = photonOrbitRadius(a, false);
+
+    ZamoFrame f = zamoFrame(cam.position, cam.forward, (float)a);
+    if (f.r < rRetro + 0.5 || f.sinTheta < 1e-3f) return outline;
+    Vec3 e_r = cam.position * (1.0f / f.r);
+    Vec3 e_theta{f.cosTheta * std::cos(f.phi), -f.sinTheta, f.cosTheta * std::sin(f.phi)};
+    Vec3 e_phi{-std::sin(f.phi), 0.0f, std::cos(f.phi)};
+    const double cos2 = (double)f.cosTheta * f.cosTheta;
+    const double sin2 = (double)f.sinTheta * f.sinTheta;
+
+    auto xi = [a](double r) { return (r * r * (3.0 - r) - a * a * (r + 1.0)) / (a * (r - 1.0)); };
+    auto eta = [a](double r) {
+        return r * r * r * (4.0 * a * a - r * (r - 3.0) * (r - 3.0)) / (a * a * (r - 1.0) * (r - 1.0));
+    };
+    // Polar potential at the camera's latitude, >= 0 where the orbit reaches it
+    auto polar = [&](double r) {
+        double x = xi(r);
+        return eta(r) - cos2 * (x * x / sin2 - a * a);
+    };
+
+    // Orbits that reach the camera form one interval of r; find its ends
+    const int SCAN = 2048;
+    int first = -1, last = -1;
+    for (int i = 0; i <= SCAN; ++i) {
+        double r = rPro + (rRetro - rPro) * i / SCAN;
+        if (polar(r) >= 0.0) {
+            if (first < 0) first = i;
+            last = i;
+        }
+    }
+    if (first < 0 || first == last) return outline;
+    auto edge = [&](int inside, int outside) {
+        double lo = rPro + (rRetro - rPro) * inside / SCAN;
+        double hi = rPro + (rRetro - rPro) * outside / SCAN;
+        for (int k = 0; k < 40; ++k) {
+            double mid = 0.5 * (lo + hi);
+            (polar(mid) >= 0.0 ? lo : hi) = mid;
+        }
+        return lo;
+    };
+    double r1 = first > 0 ? edge(first, first - 1) : rPro;
+    double r2 = last < SCAN ? edge(last, last + 1) : rRetro;
+
+    // Image-plane points of the outline, both signs of the polar direction
+    const int SAMPLES = 512;
+    std::vector<float> px, py;
+    px.reserve(2 * SAMPLES);
+    py.reserve(2 * SAMPLES);
+    for (int i = 0; i < SAMPLES; ++i) {
+        double r = r1 + (r2 - r1) * 0.5 * (1.0 - std::cos(PI * i / (SAMPLES - 1)));
+        double x = xi(r);
+        double n_phi = x * f.alpha / (f.varpi * (x * f.omega - 1.0));
+        double E = f.alpha - f.omega * f.varpi * n_phi;
+        double n_theta = E * std::sqrt(std::max(polar(r), 0.0)) / std::sqrt((double)f.sig);
+        double n_r2 = 1.0 - n_phi * n_phi - n_theta * n_theta;
+        if (n_r2 < 0.0) return outline;
+        for (int sign = -1; sign <= 1; sign += 2) {
+            Vec3 d = e_r * (float)-std::sqrt(n_r2) + e_theta * (float)(sign * n_theta) + e_phi * (float)n_phi;
+            float depth = dot(d, cam.forward);
+            if (depth < 0.1f) return outline;
+            px.push_back(dot(d, cam.right) / depth);
+            py.push_back(dot(d, cam.up) / depth);
+        }
+    }
+
+    double cx = 0.0, cy = 0.0;
+    for (size_t i = 0; i < px.size(); ++i) {
+        cx += px[i];
+        cy += py[i];
+    }
+    outline.centerX = float(cx / px.size());
+    outline.centerY = float(cy / py.size());
+
+    // Radius against angle, sorted, then the smallest radius across each
+    // bin: at both bin edges (interpolated) and at every point inside it
+    struct Polar { float angle, radius; };
+    std::vector<Polar> pts(px.size());
+    for (size_t i = 0; i < px.size(); ++i) {
+        float dx = px[i] - outline.centerX, dy = py[i] - outline.centerY;
+        pts[i] = {std::atan2(dy, dx), std::sqrt(dx * dx + dy * dy)};
+    }
+    std::sort(pts.begin(), pts.end(), [](const Polar& l, const Polar& r) { return l.angle < r.angle; });
+    auto radiusAt = [&](float angle) {
+        auto it = std::lower_bound(pts.begin(), pts.end(), angle,
+                                   [](const Polar& p, float v) { return p.angle < v; });
+        const Polar& hi = it == pts.end() ? pts.front() : *it;
+        const Polar& lo = it == pts.begin() ? pts.back() : *(it - 1);
+        float span = std::remainder(hi.angle - lo.angle, TWO_PI);
+        if (span <= 0.0f) span += TWO_PI;
+        float t = std::remainder(angle - lo.angle, TWO_PI);
+        if (t < 0.0f) t += TWO_PI;
+        return lo.radius + (hi.radius - lo.radius) * std::min(t / span, 1.0f);
+    };
+    const float binAngle = TWO_PI / SHADOW_OUTLINE_BINS;
+    for (int b = 0; b < SHADOW_OUTLINE_BINS; ++b) {
+        outline.radius[b] = std::min(radiusAt(-PI + b * binAngle), radiusAt(-PI + (b + 1) * binAngle));
+    }
+    for (const Polar& p : pts) {
+        float& r = outline.radius[ShadowOutline::bin(std::cos(p.angle), std::sin(p.angle))];
+        r = std::min(r, p.radius);
+    }
+    // Chords between the samples cut slightly inside a convex outline
+    for (float& r : outline.radius) r *= std::cos(binAngle);
+    outline.valid = true;
+    return outline;
+}
+
+// Lensing sample of a pixel inside the shadow: no disk hits, horizon
+inline LensingSample shadowSample() {
+    LensingSample s;
+    s.fate = RayFate::Horizon;
+    return s;
+}
+
+// Whether the ray through pixel (x, y) starts safely inside the shadow
+inline bool pixelInShadow(const ShadowOutline& outline, const RenderParams& p, const Camera& cam,
+                          int x, int y, float margin = SHADOW_MARGIN) {
+    float ndcX, ndcY;
+    pixelNdc(p, float(x), float(y), ndcX, ndcY);
+    return outline.captures(ndcX * cam.fovScale, ndcY * cam.fovScale, margin);
+}
+
+} // namespace kerr
@@ -0,0 +1,445 @@
+/*
+ * Lensing atlas over spin, inclination and camera distance
+ * C++17, header-only
+ *
+ * A lensing map (lensing_map.h) serves one spin, inclination and distance.
+ * The atlas holds low-resolution maps for a grid of them, so the viewer
+ * can show a new spin, inclination or distance while a key is held
+ * without tracing a single ray. A frame between grid points is
+ * interpolated from the eight surrounding maps, pixel by pixel: where all
+ * eight rays share their fate and hit count, escape direction and disk
+ * hits (radius, azimuth, redshift) are blended trilinearly, elsewhere the
+ * nearest grid point's ray is taken. Maps of another distance are read at
+ * the pixel with the same impact parameter, so the shadow and the rings
+ * line up before they are blended.
+ *
+ * Each grid point is one file in the atlas directory, written by
+ * kerr_cpu --build-atlas, next to a text manifest of the grid. Files
+ * appear only when complete (written under a temporary name, then
+ * renamed), so an interrupted build resumes with the points that are
+ * missing. A pixel is 24 bytes: fate and hit count, then the escape
+ * direction and every hit quantized to 16 bits (AtlasTexel). The maps are
+ * traced at camera azimuth 0, time 0, with the affine integrator and
+ * default tolerances.
+ *
+ * Files are native byte order, like the lensing cache.
+ */
+
+#pragma once
+
+#include "kerr_physics.h"
+#include "lensing_map.h"
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace kerr {
+
+constexpr char ATLAS_MAGIC[8] = {'K', 'E', 'R', 'R', 'A', 'T', 'L', 'S'};
+constexpr uint32_t ATLAS_VERSION = 1;
+constexpr int ATLAS_BOUNCES = 3;                // hits kept per pixel
+constexpr const char* ATLAS_MANIFEST = "atlas.txt";
+constexpr const char* ATLAS_EXTENSION = ".kla";
+constexpr float ATLAS_G_MIN = 0.05f;            // redshift clamp of the shaders
+constexpr float ATLAS_G_MAX = 10.0f;
+
+// Evenly spaced grid values lo .. hi
+struct AtlasAxis {
+    float lo = 0.0f, hi = 0.0f;
+    int count = 1;
+
+    float value(int i) const { return count > 1 ? lo + (hi - lo) * (float)i / (float)(count - 1) : lo; }
+
+    // Cell of x and its position t in it; false outside lo .. hi
+    bool locate(float x, int& i, float& t) const {
+        if (count < 2) {
+            i = 0;
+            t = 0.0f;
+            return x == lo;
+        }
+        float u = (x - lo) / (hi - lo) * (float)(count - 1);
+        if (!(u >= -1e-4f && u <= (float)(count - 1) + 1e-4f)) return false;
+        i = std::min(count - 2, std::max(0, (int)std::floor(u)));
+        t = std::min(1.0f, std::max(0.0f, u - (float)i));
+        return true;
+    }
+
+    bool operator==(const AtlasAxis& o) const { return lo == o.lo && hi == o.hi && count == o.count; }
+};
+
+struct AtlasGrid {
+    AtlasAxis spin{0.0f, 0.998f, 11};
+    AtlasAxis inclination{1.0f, 89.0f, 12};
+    AtlasAxis distance{10.0f, 50.0f, 5};
+    int width = 192;
+    int height = 108;
+    float fov = 45.0f;
+
+    int entries() const { return spin.count * inclination.count * distance.count; }
+    int index(int s, int i, int d) const { return (d * inclination.count + i) * spin.count + s; }
+    size_t pixels() const { return (size_t)width * height; }
+
+    bool operator==(const AtlasGrid& o) const {
+        return spin == o.spin && inclination == o.inclination && distance == o.distance && width == o.width &&
+               height == o.height && fov == o.fov;
+    }
+    bool operator!=(const AtlasGrid& o) const { return !(*this == o); }
+};
+
+// One pixel: fate | hits << 2, then escape theta and phi, then (r, phi, g)
+// of each hit
+struct AtlasTexel {
+    uint16_t state;
+    uint16_t escape[2];
+    uint16_t hit[ATLAS_BOUNCES][3];
+};
+
+static_assert(sizeof(AtlasTexel) == 24, "atlas texel layout");
+
+struct AtlasHeader {
+    char magic[8];
+    uint32_t version;
+    int32_t width, height;
+    float spin, inclination, distance, fov;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(AtlasHeader) % alignof(AtlasTexel) == 0, "atlas texels must stay aligned");
+
+inline uint16_t quantize(float x, float lo, float hi) {
+    float u = (x - lo) / (hi - lo);
+    if (!(u > 0.0f)) return 0;
+    return (uint16_t)std::lround(std::min(u, 1.0f) * 65535.0f);
+}
+
+inline float dequantize(uint16_t q, float lo, float hi) { return lo + (hi - lo) * (float)q / 65535.0f; }
+
+inline float wrapAngle(float phi) {
+    phi = std::fmod(phi, TWO_PI);
+    return phi < 0.0f ? phi + TWO_PI : phi;
+}
+
+inline AtlasTexel encodeAtlasTexel(const LensingSample& s) {
+    AtlasTexel t;
+    std::memset(&t, 0, sizeof(t));
+    int hits = std::min(s.hits, ATLAS_BOUNCES);
+    t.state = (uint16_t)((int)s.fate | (hits << 2));
+
+    // A ray may leave through a pole with theta outside 0 .. pi; fold it back
+    float theta = wrapAngle(s.escapeTheta), phi = s.escapePhi;
+    if (theta > PI) {
+        theta = TWO_PI - theta;
+        phi += PI;
+    }
+    t.escape[0] = quantize(theta, 0.0f, PI);
+    t.escape[1] = quantize(wrapAngle(phi), 0.0f, TWO_PI);
+    for (int i = 0; i < hits; ++i) {
+        float g = std::isfinite(s.hitG[i]) ? s.hitG[i] : ATLAS_G_MIN;
+        t.hit[i][0] = quantize(s.hitR[i], DISK_INNER, DISK_OUTER);
+        t.hit[i][1] = quantize(wrapAngle(s.hitPhi[i]), 0.0f, TWO_PI);
+        t.hit[i][2] = quantize(std::log(std::min(ATLAS_G_MAX, std::max(ATLAS_G_MIN, g))),
+                               std::log(ATLAS_G_MIN), std::log(ATLAS_G_MAX));
+    }
+    return t;
+}
+
+inline LensingSample decodeAtlasTexel(const AtlasTexel& t) {
+    LensingSample s;
+    s.fate = (RayFate)(t.state & 3);
+    s.hits = std::min((int)(t.state >> 2), ATLAS_BOUNCES);
+    s.escapeTheta = dequantize(t.escape[0], 0.0f, PI);
+    s.escapePhi = dequantize(t.escape[1], 0.0f, TWO_PI);
+    for (int i = 0; i < s.hits; ++i) {
+        s.hitR[i] = dequantize(t.hit[i][0], DISK_INNER, DISK_OUTER);
+        s.hitPhi[i] = dequantize(t.hit[i][1], 0.0f, TWO_PI);
+        s.hitG[i] = std::exp(dequantize(t.hit[i][2], std::log(ATLAS_G_MIN), std::log(ATLAS_G_MAX)));
+    }
+    return s;
+}
+
+// Manifest: one "name value..." line per field
+inline bool writeAtlasManifest(const std::string& path, const AtlasGrid& g) {
+    std::ofstream out(path);
+    if (!out) return false;
+    out.precision(9);
+    out << "version " << ATLAS_VERSION << "\n"
+        << "spin " << g.spin.lo << " " << g.spin.hi << " " << g.spin.count << "\n"
+        << "inclination " << g.inclination.lo << " " << g.inclination.hi << " " << g.inclination.count << "\n"
+        << "distance " << g.distance.lo << " " << g.distance.hi << " " << g.distance.count << "\n"
+        << "resolution " << g.width << " " << g.height << "\n"
+        << "fov " << g.fov << "\n";
+    return (bool)out;
+}
+
+inline bool readAtlasManifest(const std::string& path, AtlasGrid& g) {
+    std::ifstream in(path);
+    if (!in) return false;
+    std::string line;
+    uint32_t version = 0;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string name;
+        fields >> name;
+        if (name == "version") fields >> version;
+        else if (name == "spin") fields >> g.spin.lo >> g.spin.hi >> g.spin.count;
+        else if (name == "inclination") fields >> g.inclination.lo >> g.inclination.hi >> g.inclination.count;
+        else if (name == "distance") fields >> g.distance.lo >> g.distance.hi >> g.distance.count;
+        else if (name == "resolution") fields >> g.width >> g.height;
+        else if (name == "fov") fields >> g.fov;
+    }
+    return version == ATLAS_VERSION && g.spin.count > 0 && g.inclination.count > 0 && g.distance.count > 0 &&
+           g.width > 0 && g.height > 0;
+}
+
+inline std::string atlasEntryPath(const std::string& dir, int s, int i, int d) {
+    char name[64];
+    std::snprintf(name, sizeof(name), "a%02d_i%02d_d%02d%s", s, i, d, ATLAS_EXTENSION);
+    return (std::filesystem::path(dir) / name).string();
+}
+
+// Writes one grid point's pixels, complete or not at all
+inline bool writeAtlasEntry(const std::string& path, const AtlasGrid& g, int s, int i, int d,
+                            const std::vector<AtlasTexel>& texels) {
+    AtlasHeader h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, ATLAS_MAGIC, sizeof(h.magic));
+    h.version = ATLAS_VERSION;
+    h.width = g.width;
+    h.height = g.height;
+    h.spin = g.spin.value(s);
+    h.inclination = g.inclination.value(i);
+    h.distance = g.distance.value(d);
+    h.fov = g.fov;
+
+    // Under a name unique to this writer, renamed once complete
+    char suffix[24];
+    std::snprintf(suffix, sizeof(suffix), ".%08x.tmp", (unsigned)std::random_device{}());
+    std::string tmp = path + suffix;
+    std::error_code ec;
+    {
+        std::ofstream out(tmp, std::ios::binary);
+        out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        out.write(reinterpret_cast<const char*>(texels.data()), (std::streamsize)(texels.size() * sizeof(AtlasTexel)));
+        out.close();
+        if (!out) {
+            std::filesystem::remove(tmp, ec);
+            return false;
+        }
+    }
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) {
+        std::filesystem::remove(tmp, ec);
+        return false;
+    }
+    return true;
+}
+
+class LensingAtlas {
+public:
+    // Reads the manifest and maps every grid point file present; false
+    // without a manifest
+    bool open(const std::string& directory) {
+        close();
+        if (!readAtlasManifest((std::filesystem::path(directory) / ATLAS_MANIFEST).string(), grid)) return false;
+        dir = directory;
+        files.resize((size_t)grid.entries());
+        for (int d = 0; d < grid.distance.count; ++d) {
+            for (int i = 0; i < grid.inclination.count; ++i) {
+                for (int s = 0; s < grid.spin.count; ++s) {
+                    MappedFile& file = files[(size_t)grid.index(s, i, d)];
+                    if (file.open(atlasEntryPath(dir, s, i, d)) && !validEntry(file, s, i, d)) file.close();
+                    if (file.isOpen()) present++;
+                }
+            }
+        }
+        return true;
+    }
+
+    void close() {
+        files.clear();
+        present = 0;
+        dir.clear();
+    }
+
+    bool isOpen() const { return !files.empty(); }
+    bool complete() const { return isOpen() && present == grid.entries(); }
+    int entryCount() const { return present; }
+    const AtlasGrid& layout() const { return grid; }
+
+    const AtlasTexel* entry(int s, int i, int d) const {
+        const MappedFile& file = files[(size_t)grid.index(s, i, d)];
+        if (!file.isOpen()) return nullptr;
+        return reinterpret_cast<const AtlasTexel*>(static_cast<const char*>(file.data()) + sizeof(AtlasHeader));
+    }
+
+    // Lensing samples of a width x height frame at (spin, inclination,
+    // distance), written as lensing map texels (lensing_map.h) of
+    // 1 + maxBounces layers. False, with out untouched, if the point lies
+    // outside the grid or a surrounding map is missing.
+    bool interpolate(float spin, float inclination, float distance, int maxBounces, int width, int height,
+                     std::vector<float>& out) const {
+        if (!isOpen()) return false;
+        int cell[3];
+        float t[3];
+        if (!grid.spin.locate(spin, cell[0], t[0]) || !grid.inclination.locate(inclination, cell[1], t[1]) ||
+            !grid.distance.locate(distance, cell[2], t[2])) {
+            return false;
+        }
+
+        // The black hole's image scales as 1 / distance. Each distance of the
+        // cell is read at the screen position scaled to the same impact
+        // parameter, and weighted linearly in 1 / distance, which makes the
+        // change of ray direction between the two cancel to first order.
+        float scale[2];
+        for (int k = 0; k < 2; ++k) {
+            scale[k] = distance / grid.distance.value(std::min(cell[2] + k, grid.distance.count - 1));
+        }
+        if (grid.distance.count > 1) t[2] = (1.0f - scale[0]) / (scale[1] - scale[0]);
+
+        // The eight corners and their trilinear weights, heaviest first
+        AtlasCorner corners[8];
+        for (int c = 0; c < 8; ++c) {
+            int o[3] = {c & 1, (c >> 1) & 1, (c >> 2) & 1};
+            float w = 1.0f;
+            for (int k = 0; k < 3; ++k) w *= o[k] ? t[k] : 1.0f - t[k];
+            int s = std::min(cell[0] + o[0], grid.spin.count - 1);
+            int i = std::min(cell[1] + o[1], grid.inclination.count - 1);
+            int d = std::min(cell[2] + o[2], grid.distance.count - 1);
+            corners[c] = {entry(s, i, d), w, o[2]};
+            if (w > 0.0f && !corners[c].texels) return false;
+        }
+        std::sort(corners, corners + 8, [](const AtlasCorner& a, const AtlasCorner& b) { return a.weight > b.weight; });
+        int used = 0;
+        while (used < 8 && corners[used].weight > 1e-6f) used++;
+
+        // Atlas pixel of a screen coordinate in -1 .. 1, -1 outside the map
+        auto atlasPixel = [](float ndc, int size) {
+            float p = (ndc * 0.5f + 0.5f) * (float)size;
+            return p >= 0.0f && p < (float)size ? (int)p : -1;
+        };
+
+        int bounces = std::max(1, std::min(maxBounces, ATLAS_BOUNCES));
+        size_t layerFloats = (size_t)width * height * LENSING_TEXEL_FLOATS;
+        out.assign(layerFloats * (1 + bounces), 0.0f);
+        for (int y = 0; y < height; ++y) {
+            float ndcY = ((float)y + 0.5f) / (float)height * 2.0f - 1.0f;
+            for (int x = 0; x < width; ++x) {
+                float ndcX = ((float)x + 0.5f) / (float)width * 2.0f - 1.0f;
+                long index[2];
+                for (int k = 0; k < 2; ++k) {
+                    int ax = atlasPixel(ndcX * scale[k], grid.width), ay = atlasPixel(ndcY * scale[k], grid.height);
+                    index[k] = ax < 0 || ay < 0 ? -1 : (long)ay * grid.width + ax;
+                }
+                LensingSample s = blend(corners, used, index);
+
+                // Fewer bounces than the atlas: the ray stops at the last one
+                if (s.hits > bounces) {
+                    s.hits = bounces;
+                    s.fate = RayFate::Exhausted;
+                }
+                size_t pixel = (size_t)y * width + x;
+                float* header = &out[pixel * LENSING_TEXEL_FLOATS];
+                header[0] = float((int)s.fate | (s.hits << 2));
+                header[2] = s.escapeTheta;
+                header[3] = s.escapePhi;
+                for (int i = 0; i < s.hits; ++i) {
+                    float* h = &out[(1 + i) * layerFloats + pixel * LENSING_TEXEL_FLOATS];
+                    h[0] = s.hitR[i];
+                    h[1] = s.hitPhi[i];
+                    h[2] = s.hitG[i];
+                }
+            }
+        }
+        return true;
+    }
+
+private:
+    bool validEntry(const MappedFile& file, int s, int i, int d) const {
+        if (file.size() != sizeof(AtlasHeader) + grid.pixels() * sizeof(AtlasTexel)) return false;
+        AtlasHeader h;
+        std::memcpy(&h, file.data(), sizeof(h));
+        return std::memcmp(h.magic, ATLAS_MAGIC, sizeof(h.magic)) == 0 && h.version == ATLAS_VERSION &&
+               h.width == grid.width && h.height == grid.height && h.spin == grid.spin.value(s) &&
+               h.inclination == grid.inclination.value(i) && h.distance == grid.distance.value(d) &&
+               h.fov == grid.fov;
+    }
+
+    struct AtlasCorner {
+        const AtlasTexel* texels;
+        float weight;
+        int layer;              // 0 nearer, 1 farther distance of the cell
+    };
+
+    // Weighted blend of the corners' samples at index[layer], or the sample
+    // of the heaviest corner if they differ in fate or hit count. Escape
+    // directions are averaged as unit vectors, hit azimuths unwrapped around
+    // the heaviest corner's and redshifts in log g. Corners whose screen
+    // position falls outside their map are left out.
+    static LensingSample blend(const AtlasCorner* corners, int used, const long* index) {
+        int first = 0;
+        while (first < used && index[corners[first].layer] < 0) first++;
+        if (first == used) {
+            LensingSample none;
+            none.fate = RayFate::Escaped;
+            return none;
+        }
+        const AtlasTexel& top = corners[first].texels[index[corners[first].layer]];
+        LensingSample base = decodeAtlasTexel(top);
+        for (int c = first + 1; c < used; ++c) {
+            long i = index[corners[c].layer];
+            if (i >= 0 && corners[c].texels[i].state != top.state) return base;
+        }
+
+        auto near = [](float phi, float ref) { return ref + std::remainder(phi - ref, TWO_PI); };
+        LensingSample sum = base;
+        float dir[3] = {0.0f, 0.0f, 0.0f}, total = 0.0f;
+        for (int i = 0; i < base.hits; ++i) sum.hitR[i] = sum.hitPhi[i] = sum.hitG[i] = 0.0f;
+        for (int c = first; c < used; ++c) {
+            long i = index[corners[c].layer];
+            if (i < 0) continue;
+            LensingSample s = decodeAtlasTexel(corners[c].texels[i]);
+            float w = corners[c].weight;
+            total += w;
+            float sinTheta = std::sin(s.escapeTheta);
+            dir[0] += w * sinTheta * std::cos(s.escapePhi);
+            dir[1] += w * std::cos(s.escapeTheta);
+            dir[2] += w * sinTheta * std::sin(s.escapePhi);
+            for (int h = 0; h < base.hits; ++h) {
+                sum.hitR[h] += w * s.hitR[h];
+                sum.hitPhi[h] += w * near(s.hitPhi[h], base.hitPhi[h]);
+                sum.hitG[h] += w * std::log(s.hitG[h]);
+            }
+        }
+        float inv = 1.0f / total;
+        float len = std::sqrt(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+        if (len > 0.0f) {
+            sum.escapeTheta = std::acos(std::min(1.0f, std::max(-1.0f, dir[1] / len)));
+            sum.escapePhi = wrapAngle(std::atan2(dir[2], dir[0]));
+        }
+        for (int h = 0; h < base.hits; ++h) {
+            sum.hitR[h] *= inv;
+            sum.hitPhi[h] *= inv;
+            sum.hitG[h] = std::exp(sum.hitG[h] * inv);
+        }
+        return sum;
+    }
+
+    AtlasGrid grid;
+    std::string dir;
+    std::vector<MappedFile> files;
+    int present = 0;
+};
+
+} // namespace kerr
@@ -0,0 +1,265 @@
+/*
+ * Persistent on-disk cache of lensing maps
+ * C++17, header-only
+ *
+ * Each map is one file in the cache directory named after a hash of its
+ * key (resolution, spin, inclination, distance, field of view, bounces,
+ * integrator, tolerances and far-field radius). A file is a fixed header followed, at a
+ * page-aligned offset, by the map's texels exactly as LensingMap and the
+ * GL texture hold them (lensing_map.h). Loading maps the file and checks
+ * the header; nothing is parsed or copied, and pages are read in as the
+ * first frame touches them.
+ *
+ * The directory is kept under a size cap by evicting the least recently
+ * used files. A file's modification time is its last use: loading a map
+ * touches it.
+ *
+ * Files are written in native byte order and are only meant to be read
+ * back on the machine that wrote them; the header records the format
+ * version so older or foreign files are ignored and retraced.
+ */
+
+#pragma once
+
+#include "lensing_map.h"
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace kerr {
+
+constexpr char LENSING_CACHE_MAGIC[8] = {'K', 'E', 'R', 'R', 'L', 'M', 'A', 'P'};
+constexpr uint32_t LENSING_CACHE_VERSION = 2;
+constexpr uint32_t LENSING_CACHE_DATA_OFFSET = 4096;   // texels start on a page boundary
+constexpr const char* LENSING_CACHE_EXTENSION = ".klm";
+
+struct LensingCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t dataOffset;
+    uint64_t keyHash;
+    uint64_t dataBytes;
+    int32_t width;
+    int32_t height;
+    int32_t maxBounces;
+    int32_t integrator;
+    float spin;
+    float inclination;
+    float cameraDistance;
+    float fov;
+    float relPos, absPos, relMom, absMom;
+    float farFieldRadius;
+    float orbitAngle;
+    uint32_t layers;
+};
+
+static_assert(sizeof(LensingCacheHeader) <= LENSING_CACHE_DATA_OFFSET, "lensing cache header too large");
+
+// FNV-1a over the format version and every key field
+inline uint64_t lensingKeyHash(const LensingMapKey& k) {
+    uint64_t h = 14695981039346656037ull;
+    auto mix = [&h](const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            h ^= bytes[i];
+            h *= 1099511628211ull;
+        }
+    };
+    int32_t integrator = (int32_t)k.integrator;
+    mix(&LENSING_CACHE_VERSION, sizeof(LENSING_CACHE_VERSION));
+    mix(&k.width, sizeof(k.width));
+    mix(&k.height, sizeof(k.height));
+    mix(&k.spin, sizeof(k.spin));
+    mix(&k.inclination, sizeof(k.inclination));
+    mix(&k.cameraDistance, sizeof(k.cameraDistance));
+    mix(&k.fov, sizeof(k.fov));
+    mix(&k.maxBounces, sizeof(k.maxBounces));
+    mix(&integrator, sizeof(integrator));
+    mix(&k.tolerances.relPos, sizeof(float));
+    mix(&k.tolerances.absPos, sizeof(float));
+    mix(&k.tolerances.relMom, sizeof(float));
+    mix(&k.tolerances.absMom, sizeof(float));
+    mix(&k.farFieldRadius, sizeof(k.farFieldRadius));
+    return h;
+}
+
+class LensingCache {
+public:
+    LensingCache(std::string directory, uint64_t maxBytes)
+        : dir(std::move(directory)), capacity(maxBytes) {}
+
+    const std::string& directory() const { return dir; }
+    uint64_t maxBytes() const { return capacity; }
+
+    std::string pathFor(const LensingMapKey& key) const {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx", (unsigned long long)lensingKeyHash(key));
+        return (std::filesystem::path(dir) / (std::string(name) + LENSING_CACHE_EXTENSION)).string();
+    }
+
+    // Maps the cached file for key into map; false on a miss or a file that
+    // does not hold exactly this key in the current format
+    bool load(const LensingMapKey& key, LensingMap& map) const {
+        std::string path = pathFor(key);
+        std::error_code ec;
+        if (!std::filesystem::exists(path, ec)) return false;
+
+        MappedFile file;
+        if (!file.open(path)) return false;
+        if (file.size() < sizeof(LensingCacheHeader)) return false;
+
+        LensingCacheHeader h;
+        std::memcpy(&h, file.data(), sizeof(h));
+        LensingMap expected;
+        expected.key = key;
+        if (std::memcmp(h.magic, LENSING_CACHE_MAGIC, sizeof(h.magic)) != 0 ||
+            h.version != LENSING_CACHE_VERSION || h.keyHash != lensingKeyHash(key) ||
+            h.layers != expected.layers() || h.dataBytes != expected.bytes() ||
+            file.size() < (uint64_t)h.dataOffset + h.dataBytes || h.dataOffset % 16 != 0) {
+            return false;
+        }
+        if (headerKey(h) != key) return false;   // hash collision
+
+        touch(path);
+        map.adopt(key, h.orbitAngle, std::move(file), h.dataOffset);
+        return true;
+    }
+
+    // Writes a complete map, then evicts old files until the directory fits
+    // the size cap; the new file is never evicted
+    bool save(const LensingMap& map) const {
+        if (!map.valid) return false;
+        std::error_code ec;
+        std::filesystem::create_directories(dir, ec);
+
+        LensingCacheHeader h;
+        std::memset(&h, 0, sizeof(h));
+        std::memcpy(h.magic, LENSING_CACHE_MAGIC, sizeof(h.magic));
+        h.version = LENSING_CACHE_VERSION;
+        h.dataOffset = LENSING_CACHE_DATA_OFFSET;
+        h.keyHash = lensingKeyHash(map.key);
+        h.dataBytes = map.bytes();
+        h.width = map.key.width;
+        h.height = map.key.height;
+        h.maxBounces = map.key.maxBounces;
+        h.integrator = (int32_t)map.key.integrator;
+        h.spin = map.key.spin;
+        h.inclination = map.key.inclination;
+        h.cameraDistance = map.key.cameraDistance;
+        h.fov = map.key.fov;
+        h.relPos = map.key.tolerances.relPos;
+        h.absPos = map.key.tolerances.absPos;
+        h.relMom = map.key.tolerances.relMom;
+        h.absMom = map.key.tolerances.absMom;
+        h.farFieldRadius = map.key.farFieldRadius;
+        h.orbitAngle = map.orbitAngle;
+        h.layers = (uint32_t)map.layers();
+
+        // Written under a temporary name and renamed, so a reader never maps
+        // a partial file; the name is unique per writer, so two processes
+        // saving the same map never write into one file
+        std::string path = pathFor(map.key);
+        char suffix[24];
+        std::snprintf(suffix, sizeof(suffix), ".%08x.tmp", (unsigned)std::random_device{}());
+        std::string tmp = path + suffix;
+        {
+            std::ofstream out(tmp, std::ios::binary);
+            if (!out.is_open()) {
+                std::cerr << "Failed to write lensing cache file: " << tmp << std::endl;
+                return false;
+            }
+            std::vector<char> page(LENSING_CACHE_DATA_OFFSET, 0);
+            std::memcpy(page.data(), &h, sizeof(h));
+            out.write(page.data(), (std::streamsize)page.size());
+            out.write(reinterpret_cast<const char*>(map.texels), (std::streamsize)map.bytes());
+            // Closed before the check: the final flush can fail too
+            out.close();
+            if (!out) {
+                std::cerr << "Failed to write lensing cache file: " << tmp << std::endl;
+                std::filesystem::remove(tmp, ec);
+                return false;
+            }
+        }
+        std::filesystem::rename(tmp, path, ec);
+        if (ec) {
+            std::cerr << "Failed to store lensing cache file " << path << ": " << ec.message() << std::endl;
+            std::filesystem::remove(tmp, ec);
+            return false;
+        }
+
+        evict(path);
+        return true;
+    }
+
+    // Removes least recently used files until the cache fits its cap; files
+    // that cannot be removed (mapped on Windows) are skipped
+    uint64_t evict(const std::string& keep = std::string()) const {
+        struct Entry {
+            std::filesystem::path path;
+            std::filesystem::file_time_type used;
+            uint64_t size;
+        };
+        std::vector<Entry> entries;
+        uint64_t total = 0;
+        std::error_code ec;
+        for (const auto& e : std::filesystem::directory_iterator(dir, ec)) {
+            if (!e.is_regular_file(ec) || e.path().extension() != LENSING_CACHE_EXTENSION) continue;
+            Entry entry{e.path(), e.last_write_time(ec), e.file_size(ec)};
+            if (ec) continue;
+            total += entry.size;
+            entries.push_back(entry);
+        }
+        std::sort(entries.begin(), entries.end(),
+                  [](const Entry& a, const Entry& b) { return a.used < b.used; });
+
+        uint64_t freed = 0;
+        for (const Entry& e : entries) {
+            if (total <= capacity) break;
+            if (!keep.empty() && std::filesystem::equivalent(e.path, keep, ec)) continue;
+            if (std::filesystem::remove(e.path, ec)) {
+                total -= e.size;
+                freed += e.size;
+            }
+        }
+        return freed;
+    }
+
+private:
+    static LensingMapKey headerKey(const LensingCacheHeader& h) {
+        LensingMapKey k;
+        k.width = h.width;
+        k.height = h.height;
+        k.spin = h.spin;
+        k.inclination = h.inclination;
+        k.cameraDistance = h.cameraDistance;
+        k.fov = h.fov;
+        k.maxBounces = h.maxBounces;
+        k.integrator = (Integrator)h.integrator;
+        k.tolerances.relPos = h.relPos;
+        k.tolerances.absPos = h.absPos;
+        k.tolerances.relMom = h.relMom;
+        k.tolerances.absMom = h.absMom;
+        k.farFieldRadius = h.farFieldRadius;
+        return k;
+    }
+
+    static void touch(const std::string& path) {
+        std::error_code ec;
+        std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+    }
+
+    std::string dir;
+    uint64_t capacity;
+};
+
+} // namespace kerr
@@ -0,0 +1,154 @@
+/*
+ * Cached lensing map for the CPU renderer
+ * C++17, header-only
+ *
+ * Stores the lensing sample (kerr_physics.h) of every pixel of a frame.
+ * Kerr spacetime is axisymmetric and the camera orbits the spin axis, so a
+ * map traced once serves every animation frame with the same spin,
+ * inclination, distance and resolution: shading a frame only adds the
+ * change of camera azimuth to the recorded azimuths and evaluates the
+ * time-dependent disk emission, with no geodesic integration.
+ *
+ * Samples are kept as RGBA32F texels in the layout of the lensing map
+ * image of blackhole_improved.comp, one layer of width x height texels
+ * after the other:
+ *
+ *   layer 0      (fate | hits << 2, integration steps, escape theta, escape phi)
+ *   layer 1 + i  (r, phi, g, 0) of disk hit i
+ *
+ * The same bytes are written to the disk cache (lensing_cache.h), so a
+ * cached map is used straight from its file mapping and uploads to the
+ * GL texture with a single glTexSubImage3D.
+ */
+
+#pragma once
+
+#include "kerr_physics.h"
+#include "mapped_file.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace kerr {
+
+constexpr int LENSING_TEXEL_FLOATS = 4;
+
+// Everything a traced ray depends on apart from the camera azimuth and the
+// time; two frames can share a map only if their keys are equal
+struct LensingMapKey {
+    int width = 0;
+    int height = 0;
+    float spin = 0.0f;
+    float inclination = 0.0f;
+    float cameraDistance = 0.0f;
+    float fov = 0.0f;
+    int maxBounces = 0;
+    Integrator integrator = Integrator::Affine;
+    StepTolerances tolerances;
+    float farFieldRadius = 0.0f;
+
+    static LensingMapKey fromParams(const RenderParams& p) {
+        LensingMapKey k;
+        k.width = p.width;
+        k.height = p.height;
+        k.spin = p.spin;
+        k.inclination = p.inclination;
+        k.cameraDistance = p.cameraDistance;
+        k.fov = p.fov;
+        k.maxBounces = std::min(p.maxBounces, MAX_BOUNCES_LIMIT);
+        k.integrator = p.integrator;
+        k.tolerances = p.tolerances;
+        k.farFieldRadius = p.farFieldRadius;
+        return k;
+    }
+
+    bool operator==(const LensingMapKey& o) const {
+        return width == o.width && height == o.height && spin == o.spin &&
+               inclination == o.inclination && cameraDistance == o.cameraDistance && fov == o.fov &&
+               maxBounces == o.maxBounces && integrator == o.integrator &&
+               tolerances.relPos == o.tolerances.relPos && tolerances.absPos == o.tolerances.absPos &&
+               tolerances.relMom == o.tolerances.relMom && tolerances.absMom == o.tolerances.absMom &&
+               farFieldRadius == o.farFieldRadius;
+    }
+    bool operator!=(const LensingMapKey& o) const { return !(*this == o); }
+};
+
+struct LensingMap {
+    LensingMapKey key;
+    float orbitAngle = 0.0f;       // camera azimuth the map was traced at
+    bool valid = false;            // every pixel has been stored
+
+    std::vector<float> storage;    // texels of a map traced in this process
+    MappedFile mapping;            // texels of a map loaded from the disk cache
+    const float* texels = nullptr; // whichever of the two holds the map
+
+    void reset(const LensingMapKey& k, float angle) {
+        key = k;
+        orbitAngle = angle;
+        valid = false;
+        mapping.close();
+        storage.assign(layers() * layerFloats(), 0.0f);
+        texels = storage.data();
+    }
+
+    // Uses texels that live in a file mapping, offset bytes into the file;
+    // the caller has checked that the file holds the whole map
+    void adopt(const LensingMapKey& k, float angle, MappedFile&& file, size_t offset) {
+        key = k;
+        orbitAngle = angle;
+        storage.clear();
+        storage.shrink_to_fit();
+        mapping = std::move(file);
+        texels = reinterpret_cast<const float*>(static_cast<const char*>(mapping.data()) + offset);
+        valid = true;
+    }
+
+    size_t pixelCount() const { return (size_t)key.width * (size_t)key.height; }
+    size_t layers() const { return 1 + (size_t)key.maxBounces; }
+    size_t layerFloats() const { return pixelCount() * LENSING_TEXEL_FLOATS; }
+    size_t bytes() const { return layers() * layerFloats() * sizeof(float); }
+    bool mapped() const { return mapping.isOpen(); }
+
+    bool matches(const RenderParams& p) const { return valid && key == LensingMapKey::fromParams(p); }
+
+    // Azimuth to add to the recorded samples for a frame at this time
+    float phiOffset(float time) const { return cameraOrbitAngle(time) - orbitAngle; }
+
+    // Only valid for maps traced in this process (after reset)
+    void store(size_t pixel, const LensingSample& s, int steps) {
+        int n = std::min(s.hits, key.maxBounces);
+        float* header = &storage[pixel * LENSING_TEXEL_FLOATS];
+        header[0] = float((int)s.fate | (n << 2));
+        header[1] = float(steps);
+        header[2] = s.escapeTheta;
+        header[3] = s.escapePhi;
+        for (int i = 0; i < n; ++i) {
+            float* h = &storage[(1 + i) * layerFloats() + pixel * LENSING_TEXEL_FLOATS];
+            h[0] = s.hitR[i];
+            h[1] = s.hitPhi[i];
+            h[2] = s.hitG[i];
+        }
+    }
+
+    LensingSample load(size_t pixel) const {
+        LensingSample s;
+        const float* header = &texels[pixel * LENSING_TEXEL_FLOATS];
+        int packed = (int)header[0];
+        s.fate = (RayFate)(packed & 3);
+        s.hits = std::min(packed >> 2, key.maxBounces);
+        s.escapeTheta = header[2];
+        s.escapePhi = header[3];
+        for (int i = 0; i < s.hits; ++i) {
+            const float* h = &texels[(1 + i) * layerFloats() + pixel * LENSING_TEXEL_FLOATS];
+            s.hitR[i] = h[0];
+            s.hitPhi[i] = h[1];
+            s.hitG[i] = h[2];
+        }
+        return s;
+    }
+
+    // Accepted plus rejected integration steps the pixel's ray took
+    int stepCount(size_t pixel) const { return (int)texels[pixel * LENSING_TEXEL_FLOATS + 1]; }
+};
+
+} // namespace kerr
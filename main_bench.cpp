@@ -0,0 +1,640 @@
+/*
+ * Kerr Black Hole - Headless Benchmark Suite
+ * C++17, OpenGL 4.5 through EGL, Linux
+ *
+ * Renders a fixed set of scenarios with each compute shader and reports
+ * how fast they ran, so a shader or driver change can be checked against
+ * a stored baseline. Scenarios are every combination of
+ *
+ *   view      face-on (inclination 5; the camera basis degenerates at 0)
+ *             and edge-on (88)
+ *   spin      0, 0.9 and 0.998
+ *   camera    near (r = 12) and far (r = 60)
+ *   shader    blackhole.comp, blackhole_improved.comp and
+ *             blackhole_cinematic.comp
+ *
+ * named like "blackhole_improved/edge-on/a0.998/near". Each one renders
+ * --warmup frames, then --frames timed frames of a fixed orbit (time =
+ * frame / 30, as in kerr_headless), every dispatch followed by glFinish.
+ * Frame times are the CPU wall time of dispatch and finish; GPU times
+ * come from timer queries (frame_timing.h), where the driver times
+ * compute work. Only the compute pass is measured: no bloom, no readback.
+ *
+ * blackhole_improved.comp is built with KERR_STEP_HISTOGRAM, so it also
+ * reports steps per ray (accepted and rejected): the mean from its step
+ * counters and the 99th percentile from the histogram. The other shaders
+ * count no steps. Memory is what the scenario allocates on the GPU (image,
+ * buffers, program binary) and the process's resident set afterwards;
+ * on llvmpipe the two overlap.
+ *
+ * Results are JSON (--output, default stdout). --compare BASELINE checks
+ * them scenario by scenario against an earlier run: a median frame time or
+ * mean step count more than --tolerance above the baseline is a
+ * regression, and the exit status is 1. --results FILE compares a stored
+ * run instead of rendering. The context is surfaceless EGL as in
+ * kerr_headless, so the suite runs on Mesa llvmpipe without a GPU.
+ *
+ * Build (Linux):
+ *   g++ main_bench.cpp -o kerr_bench -std=c++17 -O3 -lEGL -lOpenGL
+ * Example:
+ *   ./kerr_bench --output baseline.json
+ *   ./kerr_bench --output bench.json --compare baseline.json
+ */
+
+#include "gl_headless.h"
+#include "frame_timing.h"  // after gl_headless.h, whose OpenGL declarations it uses
+#include "shader_params.h"
+#include "shader_variants.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+// ===================================================================
+// CONFIGURATION AND SCENARIOS
+// ===================================================================
+
+constexpr int BENCH_FORMAT_VERSION = 1;
+constexpr float BENCH_FPS = 30.0f;      // orbit time per frame, as kerr_headless
+
+struct BenchConfig {
+    int width = 256;                     // small enough for llvmpipe on one core
+    int height = 144;
+    int warmup = 1;
+    int frames = 5;
+    std::string filter;                  // run only scenarios whose name contains it
+    std::string output = "-";            // JSON results, "-" = stdout
+    std::string compare;                 // baseline JSON to compare against
+    std::string results;                 // stored results compared instead of rendering
+    float tolerance = 0.10f;             // allowed slowdown before a regression
+    bool pbuffer = false;
+    std::string programCache = "program_cache";   // "" = always compile
+};
+
+struct Scenario {
+    std::string name;
+    std::string shader;
+    float inclination = 85.0f;
+    float spin = 0.9f;
+    float distance = 25.0f;
+};
+
+// The fixed scenario set, in a stable order
+std::vector<Scenario> benchScenarios() {
+    const char* shaders[] = {"blackhole.comp", "blackhole_improved.comp", "blackhole_cinematic.comp"};
+    const struct { const char* name; float inclination; } views[] = {{"face-on", 5.0f}, {"edge-on", 88.0f}};
+    const struct { const char* name; float spin; } spins[] = {{"a0", 0.0f}, {"a0.9", 0.9f}, {"a0.998", 0.998f}};
+    const struct { const char* name; float distance; } cameras[] = {{"near", 12.0f}, {"far", 60.0f}};
+
+    std::vector<Scenario> scenarios;
+    for (const char* shader : shaders) {
+        std::string stem = shader;
+        stem = stem.substr(0, stem.find('.'));
+        for (const auto& view : views) {
+            for (const auto& spin : spins) {
+                for (const auto& camera : cameras) {
+                    Scenario s;
+                    s.name = stem + "/" + view.name + "/" + spin.name + "/" + camera.name;
+                    s.shader = shader;
+                    s.inclination = view.inclination;
+                    s.spin = spin.spin;
+                    s.distance = camera.distance;
+                    scenarios.push_back(s);
+                }
+            }
+        }
+    }
+    return scenarios;
+}
+
+void printUsage(const char* exe) {
+    std::cerr << "Usage: " << exe << " [options]\n"
+              << "  --resolution WxH     Frame size (default 256x144)\n"
+              << "  --warmup N           Untimed frames per scenario (default 1)\n"
+              << "  --frames N           Timed frames per scenario (default 5)\n"
+              << "  --filter TEXT        Only scenarios whose name contains TEXT\n"
+              << "  --list               Print the scenario names and exit\n"
+              << "  --output FILE        JSON results, - for stdout (default -)\n"
+              << "  --compare FILE       Baseline results; regressions give exit status 1\n"
+              << "  --results FILE       Compare these stored results instead of rendering\n"
+              << "  --tolerance F        Allowed slowdown against the baseline (default 0.10)\n"
+              << "  --pbuffer            Use a pbuffer surface even if surfaceless contexts are supported\n"
+              << "  --program-cache DIR  Linked program binaries (default program_cache)\n"
+              << "  --no-program-cache   Always compile the compute shaders\n"
+              << std::endl;
+}
+
+bool parseArgs(int argc, char* argv[], BenchConfig& cfg) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&](const char* name) -> const char* {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << name << std::endl;
+                return nullptr;
+            }
+            return argv[++i];
+        };
+
+        const char* value = nullptr;
+        if (arg == "--help" || arg == "-h") {
+            printUsage(argv[0]);
+            std::exit(0);
+        } else if (arg == "--list") {
+            for (const Scenario& s : benchScenarios()) std::cout << s.name << "\n";
+            std::exit(0);
+        } else if (arg == "--resolution") {
+            if (!(value = next("--resolution"))) return false;
+            if (std::sscanf(value, "%dx%d", &cfg.width, &cfg.height) != 2 || cfg.width <= 0 || cfg.height <= 0) {
+                std::cerr << "Invalid resolution: " << value << std::endl;
+                return false;
+            }
+        } else if (arg == "--warmup") {
+            if (!(value = next("--warmup"))) return false;
+            cfg.warmup = std::max(0, std::atoi(value));
+        } else if (arg == "--frames") {
+            if (!(value = next("--frames"))) return false;
+            cfg.frames = std::max(1, std::atoi(value));
+        } else if (arg == "--filter") {
+            if (!(value = next("--filter"))) return false;
+            cfg.filter = value;
+        } else if (arg == "--output") {
+            if (!(value = next("--output"))) return false;
+            cfg.output = value;
+        } else if (arg == "--compare") {
+            if (!(value = next("--compare"))) return false;
+            cfg.compare = value;
+        } else if (arg == "--results") {
+            if (!(value = next("--results"))) return false;
+            cfg.results = value;
+        } else if (arg == "--tolerance") {
+            if (!(value = next("--tolerance"))) return false;
+            cfg.tolerance = std::max(0.0f, (float)std::atof(value));
+        } else if (arg == "--pbuffer") {
+            cfg.pbuffer = true;
+        } else if (arg == "--program-cache") {
+            if (!(value = next("--program-cache"))) return false;
+            cfg.programCache = value;
+        } else if (arg == "--no-program-cache") {
+            cfg.programCache.clear();
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            printUsage(argv[0]);
+            return false;
+        }
+    }
+    if (!cfg.results.empty() && cfg.compare.empty()) {
+        std::cerr << "--results needs --compare" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// ===================================================================
+// RESULTS - JSON OUTPUT AND BASELINE COMPARISON
+// ===================================================================
+
+// Measurements of one scenario; negative values were not measured
+struct ScenarioResult {
+    Scenario scenario;
+    int frames = 0;
+    double msMean = 0.0;                 // CPU wall time per frame
+    double msMedian = 0.0;
+    double msP99 = 0.0;
+    double gpuMs = -1.0;                 // mean timer-query time per frame
+    double raysPerSecond = 0.0;          // primary rays, from the mean frame time
+    double stepsMean = -1.0;             // per traced ray, accepted and rejected
+    double acceptedMean = -1.0;
+    double rejectedMean = -1.0;
+    double stepsP99 = -1.0;              // upper edge of the histogram bin
+    uint64_t gpuBytes = 0;               // images and buffers of the scenario
+    uint64_t programBytes = 0;           // linked program binary
+    double rssMb = 0.0;                  // resident set after the scenario
+};
+
+// Resident set of this process
+double residentMegabytes() {
+    std::ifstream statm("/proc/self/statm");
+    uint64_t size = 0, resident = 0;
+    if (!(statm >> size >> resident)) return 0.0;
+    return (double)resident * (double)sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0);
+}
+
+// Steps below which a fraction q of the rays in the histogram lie, to the
+// bin's upper edge
+double histogramPercentile(const std::vector<uint64_t>& bins, double q) {
+    uint64_t total = 0;
+    for (uint64_t n : bins) total += n;
+    if (total == 0) return -1.0;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < bins.size(); ++i) {
+        seen += bins[i];
+        if ((double)seen >= q * (double)total) return (double)((i + 1) * kerr::STEP_HISTOGRAM_WIDTH);
+    }
+    return (double)(bins.size() * kerr::STEP_HISTOGRAM_WIDTH);
+}
+
+void writeNumber(std::ostream& out, double v) {
+    if (v < 0.0) out << "null";
+    else out << v;
+}
+
+void writeResults(std::ostream& out, const BenchConfig& cfg, const std::vector<ScenarioResult>& results) {
+    auto str = [](GLenum name) {
+        const GLubyte* s = glGetString(name);
+        return s ? std::string(reinterpret_cast<const char*>(s)) : std::string();
+    };
+
+    // One scenario object per line, flat, so baselines diff and parse simply
+    out << std::fixed << std::setprecision(4);
+    out << "{\n  \"version\": " << BENCH_FORMAT_VERSION << ",\n  \"renderer\": \"" << str(GL_RENDERER)
+        << "\",\n  \"gl_version\": \"" << str(GL_VERSION) << "\",\n  \"width\": " << cfg.width
+        << ",\n  \"height\": " << cfg.height << ",\n  \"warmup\": " << cfg.warmup
+        << ",\n  \"frames\": " << cfg.frames << ",\n  \"scenarios\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const ScenarioResult& r = results[i];
+        out << "    {\"name\": \"" << r.scenario.name << "\", \"shader\": \"" << r.scenario.shader
+            << "\", \"inclination\": " << r.scenario.inclination << ", \"spin\": " << r.scenario.spin
+            << ", \"distance\": " << r.scenario.distance << ", \"frames\": " << r.frames
+            << ", \"ms_per_frame\": " << r.msMean << ", \"ms_median\": " << r.msMedian << ", \"ms_p99\": " << r.msP99
+            << ", \"gpu_ms\": ";
+        writeNumber(out, r.gpuMs);
+        out << ", \"rays_per_s\": " << std::setprecision(0) << r.raysPerSecond << std::setprecision(4)
+            << ", \"steps_mean\": ";
+        writeNumber(out, r.stepsMean);
+        out << ", \"steps_accepted_mean\": ";
+        writeNumber(out, r.acceptedMean);
+        out << ", \"steps_rejected_mean\": ";
+        writeNumber(out, r.rejectedMean);
+        out << ", \"steps_p99\": ";
+        writeNumber(out, r.stepsP99);
+        out << ", \"gpu_bytes\": " << r.gpuBytes << ", \"program_bytes\": " << r.programBytes
+            << ", \"rss_mb\": " << std::setprecision(1) << r.rssMb << std::setprecision(4) << "}"
+            << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+// Members of one flat JSON object, text between its braces: strings
+// unquoted, numbers and null as written
+std::map<std::string, std::string> parseFlatObject(const std::string& text) {
+    std::map<std::string, std::string> members;
+    size_t pos = 0;
+    auto readString = [&](std::string& s) {
+        size_t end = text.find('"', pos + 1);
+        if (end == std::string::npos) return false;
+        s = text.substr(pos + 1, end - pos - 1);
+        pos = end + 1;
+        return true;
+    };
+    while ((pos = text.find('"', pos)) != std::string::npos) {
+        std::string key, value;
+        if (!readString(key)) break;
+        pos = text.find(':', pos);
+        if (pos == std::string::npos) break;
+        pos = text.find_first_not_of(" \t\r\n", pos + 1);
+        if (pos == std::string::npos) break;
+        if (text[pos] == '"') {
+            if (!readString(value)) break;
+        } else {
+            size_t end = text.find_first_of(",}\n", pos);
+            value = text.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+            value.erase(value.find_last_not_of(" \t\r") + 1);
+            pos = end == std::string::npos ? text.size() : end;
+        }
+        members[key] = value;
+    }
+    return members;
+}
+
+// A results file as written by writeResults: the header members and one
+// member map per scenario
+struct StoredResults {
+    std::map<std::string, std::string> header;
+    std::vector<std::map<std::string, std::string>> scenarios;
+};
+
+bool parseResults(const std::string& text, const std::string& source, StoredResults& stored) {
+    size_t list = text.find("\"scenarios\"");
+    if (list == std::string::npos) {
+        std::cerr << source << ": no scenarios" << std::endl;
+        return false;
+    }
+    stored.header = parseFlatObject(text.substr(0, list));
+    size_t pos = text.find('[', list);
+    while (pos != std::string::npos && (pos = text.find('{', pos)) != std::string::npos) {
+        size_t end = text.find('}', pos);
+        if (end == std::string::npos) break;
+        stored.scenarios.push_back(parseFlatObject(text.substr(pos + 1, end - pos - 1)));
+        pos = end + 1;
+    }
+    return true;
+}
+
+bool loadResults(const std::string& path, StoredResults& stored) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open results file: " << path << std::endl;
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    return parseResults(buffer.str(), path, stored);
+}
+
+// Prints one line per scenario of current that is also in baseline;
+// returns the number of regressions
+int compareResults(const StoredResults& baseline, const StoredResults& current, float tolerance) {
+    auto number = [](const std::map<std::string, std::string>& m, const char* key) {
+        auto it = m.find(key);
+        if (it == m.end() || it->second == "null") return -1.0;
+        return std::atof(it->second.c_str());
+    };
+    auto member = [](const std::map<std::string, std::string>& m, const char* key) {
+        auto it = m.find(key);
+        return it == m.end() ? std::string() : it->second;
+    };
+    if (member(baseline.header, "renderer") != member(current.header, "renderer") ||
+        member(baseline.header, "width") != member(current.header, "width") ||
+        member(baseline.header, "height") != member(current.header, "height")) {
+        std::cerr << "Warning: baseline is from " << member(baseline.header, "renderer") << " at "
+                  << member(baseline.header, "width") << "x" << member(baseline.header, "height")
+                  << "; times are only comparable on the same renderer and resolution" << std::endl;
+    }
+
+    std::map<std::string, const std::map<std::string, std::string>*> byName;
+    for (const auto& s : baseline.scenarios) byName[member(s, "name")] = &s;
+
+    std::ostringstream report;
+    report << std::fixed << std::setprecision(2);
+    report << std::left << std::setw(42) << "Scenario" << std::right << std::setw(11) << "base ms" << std::setw(11)
+           << "ms" << std::setw(9) << "change" << std::setw(11) << "base steps" << std::setw(9) << "steps"
+           << "\n";
+    int regressions = 0, compared = 0;
+    for (const auto& s : current.scenarios) {
+        std::string name = member(s, "name");
+        auto it = byName.find(name);
+        if (it == byName.end()) continue;
+        const auto& b = *it->second;
+        double baseMs = number(b, "ms_median"), ms = number(s, "ms_median");
+        double baseSteps = number(b, "steps_mean"), steps = number(s, "steps_mean");
+        bool slower = baseMs > 0.0 && ms > baseMs * (1.0 + tolerance);
+        bool moreSteps = baseSteps > 0.0 && steps > baseSteps * (1.0 + tolerance);
+        report << std::left << std::setw(42) << name << std::right << std::setw(11) << baseMs << std::setw(11) << ms
+               << std::setw(8) << (baseMs > 0.0 ? 100.0 * (ms / baseMs - 1.0) : 0.0) << "%";
+        if (steps >= 0.0) report << std::setw(11) << baseSteps << std::setw(9) << steps;
+        else report << std::setw(11) << "-" << std::setw(9) << "-";
+        if (slower || moreSteps) {
+            report << "  REGRESSION" << (slower ? " (time)" : "") << (moreSteps ? " (steps)" : "");
+            regressions++;
+        }
+        report << "\n";
+        compared++;
+    }
+    report << compared << " scenarios compared, " << regressions << " regressions (tolerance "
+           << 100.0f * tolerance << "%)\n";
+    std::cerr << report.str() << std::flush;
+    return regressions;
+}
+
+// ===================================================================
+// MAIN - SCENARIO LOOP
+// ===================================================================
+
+// Program and uniform setup of one shader. blackhole.comp reads plain
+// uniforms; the others read the KerrParams block.
+struct BenchProgram {
+    GLuint program = 0;
+    bool paramsBlock = false;
+    bool stepCounts = false;             // step counters and histogram
+    uint64_t binaryBytes = 0;
+};
+
+int main(int argc, char* argv[]) {
+    BenchConfig cfg;
+    if (!parseArgs(argc, argv, cfg)) return 1;
+
+    if (!cfg.results.empty()) {
+        StoredResults baseline, current;
+        if (!loadResults(cfg.compare, baseline) || !loadResults(cfg.results, current)) return 1;
+        return compareResults(baseline, current, cfg.tolerance) > 0 ? 1 : 0;
+    }
+
+    std::vector<Scenario> scenarios;
+    for (const Scenario& s : benchScenarios()) {
+        if (cfg.filter.empty() || s.name.find(cfg.filter) != std::string::npos) scenarios.push_back(s);
+    }
+    if (scenarios.empty()) {
+        std::cerr << "No scenario matches " << cfg.filter << std::endl;
+        return 1;
+    }
+
+    HeadlessContext gl;
+    if (!gl.create(cfg.pbuffer)) return 1;
+
+    const int W = cfg.width;
+    const int H = cfg.height;
+
+    // Resources shared by all scenarios
+    GLuint outputTexture;
+    glGenTextures(1, &outputTexture);
+    glBindTexture(GL_TEXTURE_2D, outputTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, W, H);
+    glBindImageTexture(0, outputTexture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+
+    GLuint stepStatsBuffer, histogramBuffer, paramsBuffer;
+    glGenBuffers(1, &stepStatsBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, stepStatsBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(kerr::StepStats), nullptr, GL_DYNAMIC_READ);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kerr::STEP_STATS_BINDING, stepStatsBuffer);
+    glGenBuffers(1, &histogramBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, histogramBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, kerr::STEP_HISTOGRAM_BINS * sizeof(GLuint), nullptr, GL_DYNAMIC_READ);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kerr::STEP_HISTOGRAM_BINDING, histogramBuffer);
+    glGenBuffers(1, &paramsBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, paramsBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(kerr::ShaderParams), nullptr, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, kerr::SHADER_PARAMS_BINDING, paramsBuffer);
+    const uint64_t gpuBytes = (uint64_t)W * H * 4 * sizeof(float) + sizeof(kerr::StepStats) +
+                              kerr::STEP_HISTOGRAM_BINS * sizeof(GLuint) + sizeof(kerr::ShaderParams);
+
+    kerr::GpuPassTimer gpuTimer;
+    gpuTimer.create({"compute"});
+    int gpuTimerFrame[kerr::GPU_TIMER_FRAMES];
+    std::fill(gpuTimerFrame, gpuTimerFrame + kerr::GPU_TIMER_FRAMES, -1);
+
+    // Programs are built once per shader. The improved shader gets the
+    // kerr_headless specialization plus the step histogram.
+    kerr::ProgramCache programCache(cfg.programCache);
+    std::map<std::string, BenchProgram> programs;
+    for (const Scenario& s : scenarios) {
+        if (programs.count(s.shader)) continue;
+        std::string source = loadFile(s.shader);
+        if (source.empty()) return 1;
+        BenchProgram p;
+        p.paramsBlock = source.find("KerrParams") != std::string::npos;
+        p.stepCounts = source.find("KERR_STEP_HISTOGRAM") != std::string::npos;
+        kerr::ShaderVariant variant;
+        if (p.stepCounts) {
+            variant.integrator = 0;
+            variant.farField = false;
+            variant.lensingMap = false;
+            variant.adaptive = false;
+            variant.stepHistogram = true;
+        }
+        auto buildStart = std::chrono::steady_clock::now();
+        bool fromCache = false;
+        p.program = kerr::buildComputeProgram(s.shader, source, variant, &programCache, &fromCache);
+        if (!p.program) return 1;
+        GLint length = 0;
+        glGetProgramiv(p.program, GL_PROGRAM_BINARY_LENGTH, &length);
+        p.binaryBytes = (uint64_t)std::max(length, 0);
+        std::cerr << s.shader << (fromCache ? " loaded from " + programCache.directory() : std::string(" compiled"))
+                  << " in " << kerr::msSince(buildStart) * 1e-3 << " s" << std::endl;
+        programs[s.shader] = p;
+    }
+
+    std::cerr << "Running " << scenarios.size() << " scenarios at " << W << "x" << H << ", " << cfg.warmup
+              << " warmup + " << cfg.frames << " timed frames each" << std::endl;
+
+    std::vector<ScenarioResult> results;
+    for (const Scenario& s : scenarios) {
+        const BenchProgram& p = programs[s.shader];
+        glUseProgram(p.program);
+
+        kerr::ShaderParams params;
+        params.resolution[0] = (float)W;
+        params.resolution[1] = (float)H;
+        params.spinParameter = s.spin;
+        params.inclination = s.inclination;
+        params.cameraDistance = s.distance;
+
+        std::vector<double> frameMs, gpuMs;
+        std::vector<uint64_t> histogram(kerr::STEP_HISTOGRAM_BINS, 0);
+        uint64_t accepted = 0, rejected = 0, rays = 0;
+
+        // Timer results arrive GPU_TIMER_FRAMES frames late; only timed
+        // frames count
+        auto collectGpu = [&]() {
+            std::vector<double> ms;
+            int frame = gpuTimerFrame[(gpuTimer.slot() + 1) % kerr::GPU_TIMER_FRAMES];
+            if (gpuTimer.beginFrame(ms) && frame >= cfg.warmup && ms[0] >= 0.0) gpuMs.push_back(ms[0]);
+            gpuTimerFrame[gpuTimer.slot()] = -1;
+        };
+
+        for (int frame = 0; frame < cfg.warmup + cfg.frames; ++frame) {
+            params.time = (float)frame / BENCH_FPS;
+            if (p.paramsBlock) {
+                glBindBuffer(GL_UNIFORM_BUFFER, paramsBuffer);
+                glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(params), &params);
+            } else {
+                glUniform1f(glGetUniformLocation(p.program, "uTime"), params.time);
+                glUniform1f(glGetUniformLocation(p.program, "uSpinParameter"), params.spinParameter);
+                glUniform1f(glGetUniformLocation(p.program, "uExposure"), params.exposure);
+                glUniform1f(glGetUniformLocation(p.program, "uInclination"), params.inclination);
+                glUniform1f(glGetUniformLocation(p.program, "uCameraDistance"), params.cameraDistance);
+                glUniform2f(glGetUniformLocation(p.program, "uResolution"), (float)W, (float)H);
+            }
+            if (p.stepCounts) {
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, stepStatsBuffer);
+                glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, histogramBuffer);
+                glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+            }
+            glFinish();
+
+            collectGpu();
+            gpuTimerFrame[gpuTimer.slot()] = frame;
+            auto start = std::chrono::steady_clock::now();
+            gpuTimer.begin(0);
+            glDispatchCompute((W + 15) / 16, (H + 15) / 16, 1);
+            gpuTimer.end();
+            glFinish();
+            double ms = kerr::msSince(start);
+            if (frame < cfg.warmup) continue;
+            frameMs.push_back(ms);
+
+            // Counters are read per frame; a run's steps would overflow 32 bits
+            if (p.stepCounts) {
+                kerr::StepStats stepStats;
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, stepStatsBuffer);
+                glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(stepStats), &stepStats);
+                accepted += stepStats.acceptedSteps;
+                rejected += stepStats.rejectedSteps;
+                rays += stepStats.tracedRays - stepStats.skippedRays;
+                std::vector<GLuint> bins(kerr::STEP_HISTOGRAM_BINS);
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, histogramBuffer);
+                glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, bins.size() * sizeof(GLuint), bins.data());
+                for (size_t i = 0; i < bins.size(); ++i) histogram[i] += bins[i];
+            }
+        }
+        for (int i = 0; i < kerr::GPU_TIMER_FRAMES; ++i) collectGpu();
+
+        ScenarioResult r;
+        r.scenario = s;
+        r.frames = cfg.frames;
+        kerr::TimingStats stats = kerr::timingStats(frameMs);
+        r.msMean = stats.mean;
+        r.msP99 = stats.p99;
+        std::vector<double> sorted = frameMs;
+        std::sort(sorted.begin(), sorted.end());
+        r.msMedian = sorted[sorted.size() / 2];
+        // Drivers that do not time compute work (llvmpipe) report zero
+        if (!gpuMs.empty() && kerr::timingStats(gpuMs).mean > 0.0) r.gpuMs = kerr::timingStats(gpuMs).mean;
+        r.raysPerSecond = (double)W * H / (stats.mean * 1e-3);
+        if (p.stepCounts && rays > 0) {
+            r.acceptedMean = (double)accepted / rays;
+            r.rejectedMean = (double)rejected / rays;
+            r.stepsMean = (double)(accepted + rejected) / rays;
+            r.stepsP99 = histogramPercentile(histogram, 0.99);
+        }
+        r.gpuBytes = gpuBytes;
+        r.programBytes = p.binaryBytes;
+        r.rssMb = residentMegabytes();
+        results.push_back(r);
+
+        std::cerr << std::fixed << std::setprecision(2) << std::left << std::setw(42) << s.name << std::right
+                  << std::setw(9) << r.msMedian << " ms  " << std::setw(7) << r.raysPerSecond * 1e-6 << " Mrays/s";
+        if (r.stepsMean >= 0.0) std::cerr << "  steps " << r.stepsMean << " mean, " << r.stepsP99 << " p99";
+        std::cerr << std::defaultfloat << std::endl;
+    }
+
+    gpuTimer.destroy();
+    for (auto& entry : programs) glDeleteProgram(entry.second.program);
+    glDeleteBuffers(1, &stepStatsBuffer);
+    glDeleteBuffers(1, &histogramBuffer);
+    glDeleteBuffers(1, &paramsBuffer);
+    glDeleteTextures(1, &outputTexture);
+
+    std::ostringstream json;
+    writeResults(json, cfg, results);
+    if (cfg.output == "-") {
+        std::cout << json.str() << std::flush;
+    } else {
+        std::ofstream file(cfg.output);
+        if (!(file << json.str())) {
+            std::cerr << "Failed to write results: " << cfg.output << std::endl;
+            return 1;
+        }
+        std::cerr << "Results written to " << cfg.output << std::endl;
+    }
+
+    // The run is compared in the form it was stored in
+    if (!cfg.compare.empty()) {
+        StoredResults baseline, current;
+        if (!loadResults(cfg.compare, baseline) || !parseResults(json.str(), "results", current)) return 1;
+        return compareResults(baseline, current, cfg.tolerance) > 0 ? 1 : 0;
+    }
+    return 0;
+}
@@ -0,0 +1,763 @@
+/*
+ * Kerr Black Hole - Multi-Process Tile Render Farm
+ * C++17, Linux
+ *
+ * Renders long stills and frame sequences as tiles across local worker
+ * processes, with every finished tile kept on disk so that a crashed or
+ * interrupted job resumes where it stopped.
+ *
+ * The coordinator lays a job out in a job directory:
+ *
+ *   job.txt          parameters of the job; a resumed run must match them
+ *   framebuffer.bin  every tile of every frame, tile-major RGB float32, mapped
+ *                    shared into all workers
+ *   tiles.log        one "frame tile" line per finished tile
+ *
+ * and forks the workers. Workers claim tiles from a queue in anonymous
+ * shared memory (an atomic cursor over per-tile states), render them
+ * straight into their slot of the mapped framebuffer, flush the slot with
+ * msync and only then append the tile to the log. On start, tiles in the
+ * log are marked done and skipped. A worker that dies has its tile put
+ * back in the queue and is restarted. Once every tile is done, the
+ * coordinator assembles the frames into PPM or PFM files.
+ *
+ * Workers render on the CPU (kerr_physics.h / kerr_simd.h, one process per
+ * core) or with a compute shader through a headless EGL context
+ * (gl_headless.h); the shader renders one tile per dispatch via
+ * uTileOffset. It is specialized for the job's integrator and bounces
+ * (shader_variants.h), and the first worker to link it stores the binary
+ * in program_cache for the others.
+ *
+ * Build (Linux):
+ *   g++ main_farm.cpp -o kerr_farm -std=c++17 -O3 -march=native -pthread -lEGL -lOpenGL
+ * Example:
+ *   ./kerr_farm --resolution 7680x4320 --bounces 5 --job still_8k --output still_8k.ppm
+ */
+
+#include "kerr_physics.h"
+#include "kerr_simd.h"
+#include "frame_path.h"
+#include "gl_headless.h"
+#include "shader_params.h"
+#include "shader_variants.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// ===================================================================
+// CONFIGURATION
+// ===================================================================
+
+enum class Backend { Cpu, Gl };
+enum class OutputFormat { PPM, PFM };
+
+constexpr int MAX_WORKERS = 256;
+
+struct FarmConfig {
+    kerr::RenderParams params;
+    int frames = 1;
+    float fps = 30.0f;
+    int tileSize = 256;
+    int workers = 0;                 // 0 = all hardware threads (cpu) or 1 (gl)
+    Backend backend = Backend::Cpu;
+    std::string shader = "blackhole_improved.comp";
+    bool pbuffer = false;
+    std::string jobDir = "farm_job";
+    std::string output = "farm.ppm";
+    OutputFormat format = OutputFormat::PPM;
+    bool restart = false;            // discard an existing job instead of resuming it
+    int retries = 3;                 // restarts per worker after a crash
+};
+
+// Tile grid of one frame; tile slots are tileSize x tileSize even at the
+// right and top edges, where only part of the slot is used
+struct TileLayout {
+    int tileSize = 0;
+    int tilesX = 0;
+    int tilesY = 0;
+    int frames = 0;
+
+    int tilesPerFrame() const { return tilesX * tilesY; }
+    int totalTiles() const { return tilesPerFrame() * frames; }
+    size_t slotFloats() const { return (size_t)tileSize * tileSize * 3; }
+    size_t slotBytes() const { return slotFloats() * sizeof(float); }
+    size_t framebufferBytes() const { return slotBytes() * (size_t)totalTiles(); }
+};
+
+void printUsage(const char* exe) {
+    std::cout << "Usage: " << exe << " [options]\n"
+              << "  --spin A             Kerr spin parameter (default 0.9)\n"
+              << "  --inclination DEG    Observer inclination (default 85)\n"
+              << "  --distance R         Camera distance in M (default 25)\n"
+              << "  --time T             Animation time of the first frame (default 0)\n"
+              << "  --exposure E         Exposure (default 1.0)\n"
+              << "  --bounces N          Maximum disk bounces (default 3)\n"
+              << "  --integrator MODE    affine (default) or mino\n"
+              << "  --resolution WxH     Image size (default 1920x1080)\n"
+              << "  --frames N           Frames in the sequence (default 1)\n"
+              << "  --fps F              Animation frames per time unit (default 30)\n"
+              << "  --tile N             Tile edge in pixels (default 256)\n"
+              << "  --workers N          Worker processes (default: all cores for cpu, 1 for gl)\n"
+              << "  --backend B          cpu (default) or gl\n"
+              << "  --shader FILE        Compute shader of the gl backend (default blackhole_improved.comp)\n"
+              << "  --pbuffer            gl backend: pbuffer surface instead of a surfaceless context\n"
+              << "  --job DIR            Job directory (default farm_job); an existing job is resumed\n"
+              << "  --restart            Discard the job in DIR and start over\n"
+              << "  --output FILE        Output image (default farm.ppm; frames get _0000 suffixes)\n"
+              << "  --format FMT         ppm (default) or pfm\n"
+              << std::endl;
+}
+
+bool parseArgs(int argc, char* argv[], FarmConfig& cfg) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&](const char* name) -> const char* {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << name << std::endl;
+                return nullptr;
+            }
+            return argv[++i];
+        };
+
+        const char* value = nullptr;
+        if (arg == "--help" || arg == "-h") {
+            printUsage(argv[0]);
+            std::exit(0);
+        } else if (arg == "--spin") {
+            if (!(value = next("--spin"))) return false;
+            cfg.params.spin = std::min(0.998f, std::max(0.0f, (float)std::atof(value)));
+        } else if (arg == "--inclination") {
+            if (!(value = next("--inclination"))) return false;
+            cfg.params.inclination = (float)std::atof(value);
+        } else if (arg == "--distance") {
+            if (!(value = next("--distance"))) return false;
+            cfg.params.cameraDistance = (float)std::atof(value);
+        } else if (arg == "--time") {
+            if (!(value = next("--time"))) return false;
+            cfg.params.time = (float)std::atof(value);
+        } else if (arg == "--exposure") {
+            if (!(value = next("--exposure"))) return false;
+            cfg.params.exposure = (float)std::atof(value);
+        } else if (arg == "--bounces") {
+            if (!(value = next("--bounces"))) return false;
+            cfg.params.maxBounces = std::min(kerr::MAX_BOUNCES_LIMIT, std::max(1, std::atoi(value)));
+        } else if (arg == "--integrator") {
+            if (!(value = next("--integrator"))) return false;
+            if (std::strcmp(value, "affine") == 0) {
+                cfg.params.integrator = kerr::Integrator::Affine;
+            } else if (std::strcmp(value, "mino") == 0) {
+                cfg.params.integrator = kerr::Integrator::Mino;
+            } else {
+                std::cerr << "Unknown integrator: " << value << std::endl;
+                return false;
+            }
+        } else if (arg == "--resolution") {
+            if (!(value = next("--resolution"))) return false;
+            if (std::sscanf(value, "%dx%d", &cfg.params.width, &cfg.params.height) != 2 ||
+                cfg.params.width <= 0 || cfg.params.height <= 0) {
+                std::cerr << "Invalid resolution: " << value << std::endl;
+                return false;
+            }
+        } else if (arg == "--frames") {
+            if (!(value = next("--frames"))) return false;
+            cfg.frames = std::max(1, std::atoi(value));
+        } else if (arg == "--fps") {
+            if (!(value = next("--fps"))) return false;
+            cfg.fps = std::max(1e-3f, (float)std::atof(value));
+        } else if (arg == "--tile") {
+            if (!(value = next("--tile"))) return false;
+            cfg.tileSize = std::max(16, std::atoi(value));
+        } else if (arg == "--workers") {
+            if (!(value = next("--workers"))) return false;
+            cfg.workers = std::min(MAX_WORKERS, std::max(0, std::atoi(value)));
+        } else if (arg == "--backend") {
+            if (!(value = next("--backend"))) return false;
+            if (std::strcmp(value, "cpu") == 0) {
+                cfg.backend = Backend::Cpu;
+            } else if (std::strcmp(value, "gl") == 0) {
+                cfg.backend = Backend::Gl;
+            } else {
+                std::cerr << "Unknown backend: " << value << std::endl;
+                return false;
+            }
+        } else if (arg == "--shader") {
+            if (!(value = next("--shader"))) return false;
+            cfg.shader = value;
+        } else if (arg == "--pbuffer") {
+            cfg.pbuffer = true;
+        } else if (arg == "--job") {
+            if (!(value = next("--job"))) return false;
+            cfg.jobDir = value;
+        } else if (arg == "--restart") {
+            cfg.restart = true;
+        } else if (arg == "--output") {
+            if (!(value = next("--output"))) return false;
+            cfg.output = value;
+        } else if (arg == "--format") {
+            if (!(value = next("--format"))) return false;
+            if (std::strcmp(value, "ppm") == 0) {
+                cfg.format = OutputFormat::PPM;
+            } else if (std::strcmp(value, "pfm") == 0) {
+                cfg.format = OutputFormat::PFM;
+            } else {
+                std::cerr << "Unknown format: " << value << std::endl;
+                return false;
+            }
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            printUsage(argv[0]);
+            return false;
+        }
+    }
+    if (cfg.workers == 0) {
+        cfg.workers = cfg.backend == Backend::Gl ? 1 : (int)std::max(1u, std::thread::hardware_concurrency());
+        cfg.workers = std::min(cfg.workers, MAX_WORKERS);
+    }
+    return true;
+}
+
+// Everything that determines the job's pixels; a resumed job must match
+std::string jobDescription(const FarmConfig& cfg) {
+    const kerr::RenderParams& p = cfg.params;
+    std::ostringstream out;
+    out.precision(9);
+    out << "version 1\n"
+        << "resolution " << p.width << "x" << p.height << "\n"
+        << "frames " << cfg.frames << "\n"
+        << "fps " << cfg.fps << "\n"
+        << "tile " << cfg.tileSize << "\n"
+        << "time " << p.time << "\n"
+        << "spin " << p.spin << "\n"
+        << "inclination " << p.inclination << "\n"
+        << "distance " << p.cameraDistance << "\n"
+        << "exposure " << p.exposure << "\n"
+        << "bounces " << p.maxBounces << "\n"
+        << "integrator " << (p.integrator == kerr::Integrator::Mino ? "mino" : "affine") << "\n"
+        << "tolerances " << p.tolerances.relPos << " " << p.tolerances.absPos << " "
+        << p.tolerances.relMom << " " << p.tolerances.absMom << "\n"
+        << "backend " << (cfg.backend == Backend::Gl ? "gl " + cfg.shader : std::string("cpu")) << "\n";
+    return out.str();
+}
+
+// ===================================================================
+// SHARED TILE QUEUE
+// ===================================================================
+
+// A claimed tile records its worker, TILE_CLAIMED + index, so the
+// supervisor requeues a crashed worker's tile only while that worker still
+// holds it
+enum TileState : uint16_t {
+    TILE_PENDING = 0,
+    TILE_DONE = 1,
+    TILE_CLAIMED = 2
+};
+
+inline uint16_t claimedBy(int index) { return (uint16_t)(TILE_CLAIMED + index); }
+
+// Lives in anonymous shared memory created before the workers are forked;
+// the per-tile states follow the struct
+struct FarmShared {
+    std::atomic<uint32_t> cursor;               // next tile of the first pass
+    std::atomic<uint32_t> completed;            // tiles finished by this run
+    std::atomic<int32_t> current[MAX_WORKERS];  // tile a worker holds or is claiming, -1 if none
+    std::atomic<uint32_t> rendered[MAX_WORKERS];
+    std::atomic<uint64_t> steps[MAX_WORKERS];   // integration steps (cpu backend)
+
+    std::atomic<uint16_t>* states() { return reinterpret_cast<std::atomic<uint16_t>*>(this + 1); }
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint16_t>::is_always_lock_free,
+              "tile queue atomics must be lock-free to work across processes");
+static_assert(TILE_CLAIMED + MAX_WORKERS - 1 <= UINT16_MAX, "tile state cannot hold every worker index");
+
+// Claims the next pending tile for worker `index`: first in order through
+// the shared cursor, then by sweeping for tiles a crashed worker gave back.
+// -1 when none is left. Each candidate is published in current[index]
+// before the claim, so a worker killed at any point leaves behind the tile
+// it may hold; the supervisor releases it only if its state names this
+// worker.
+int claimTile(FarmShared* shared, int totalTiles, int index) {
+    std::atomic<uint16_t>* states = shared->states();
+    auto claim = [&](int t) {
+        shared->current[index].store(t);
+        uint16_t expected = TILE_PENDING;
+        return states[t].compare_exchange_strong(expected, claimedBy(index));
+    };
+    for (;;) {
+        uint32_t t = shared->cursor.fetch_add(1);
+        if (t >= (uint32_t)totalTiles) break;
+        if (claim((int)t)) return (int)t;
+    }
+    for (int t = 0; t < totalTiles; ++t) {
+        if (claim(t)) return t;
+    }
+    shared->current[index].store(-1);
+    return -1;
+}
+
+// ===================================================================
+// WORKERS - CPU AND GL TILE RENDERING
+// ===================================================================
+
+struct TileRect {
+    int frame, x0, y0, x1, y1;
+};
+
+TileRect tileRect(const TileLayout& layout, const kerr::RenderParams& p, int tile) {
+    TileRect r;
+    r.frame = tile / layout.tilesPerFrame();
+    int t = tile % layout.tilesPerFrame();
+    r.x0 = (t % layout.tilesX) * layout.tileSize;
+    r.y0 = (t / layout.tilesX) * layout.tileSize;
+    r.x1 = std::min(r.x0 + layout.tileSize, p.width);
+    r.y1 = std::min(r.y0 + layout.tileSize, p.height);
+    return r;
+}
+
+kerr::RenderParams frameParams(const FarmConfig& cfg, int frame) {
+    kerr::RenderParams p = cfg.params;
+    p.time = cfg.params.time + (float)frame / cfg.fps;
+    return p;
+}
+
+// SIMD packets over one tile, as traceTilePackets in main_cpu.cpp; rows of
+// the slot are tileSize pixels apart. Returns the integration steps taken.
+uint64_t renderTileCpu(const kerr::RenderParams& p, const TileRect& r, int tileSize, float* slot) {
+    constexpr int W = kerr::simd::WIDTH;
+    const kerr::Camera cam = kerr::makeCamera(p);
+    const int tileW = r.x1 - r.x0;
+    const int count = tileW * (r.y1 - r.y0);
+    uint64_t steps = 0;
+
+    kerr::simd::PacketResult result;
+    for (int base = 0; base < count; base += W) {
+        int n = std::min(W, count - base);
+        int xs[W], ys[W];
+        float ndcX[W], ndcY[W];
+        kerr::Vec3 dirs[W];
+        for (int i = 0; i < n; ++i) {
+            xs[i] = r.x0 + (base + i) % tileW;
+            ys[i] = r.y0 + (base + i) / tileW;
+            kerr::pixelNdc(p, float(xs[i]), float(ys[i]), ndcX[i], ndcY[i]);
+            dirs[i] = kerr::cameraRay(cam, ndcX[i], ndcY[i]);
+        }
+
+        if (p.integrator == kerr::Integrator::Mino) {
+            kerr::simd::traceRayMinoPacket(cam.position, dirs, n, p.spin, p.maxBounces, p.time, p.tolerances, result);
+        } else {
+            kerr::simd::traceRayPacket(cam.position, dirs, n, p.spin, p.maxBounces, p.time, p.tolerances, result);
+        }
+
+        for (int i = 0; i < n; ++i) {
+            kerr::Vec3 color = kerr::finishPixel(result.color[i], p.exposure, ndcX[i], ndcY[i]);
+            float* dst = &slot[((size_t)(ys[i] - r.y0) * tileSize + (xs[i] - r.x0)) * 3];
+            dst[0] = color.x;
+            dst[1] = color.y;
+            dst[2] = color.z;
+            steps += (uint64_t)result.steps[i].attempts();
+        }
+    }
+    return steps;
+}
+
+// Headless context and a tile-sized output image for the gl backend
+struct GlTileRenderer {
+    HeadlessContext context;
+    GLuint program = 0;
+    GLuint textures[2] = {0, 0};
+    GLuint stepStatsBuffer = 0;
+    GLuint paramsBuffer = 0;   // shader_params.h block
+    std::vector<float> texels;
+    int tileSize = 0;
+
+    bool create(const FarmConfig& cfg) {
+        if (!context.create(cfg.pbuffer)) return false;
+        std::string source = loadFile(cfg.shader);
+        if (source.empty()) return false;
+        kerr::ShaderVariant variant;
+        variant.maxBounces = cfg.params.maxBounces;
+        variant.integrator = cfg.params.integrator == kerr::Integrator::Mino ? 1 : 0;
+        variant.farField = false;
+        variant.lensingMap = false;
+        variant.adaptive = false;
+        kerr::ProgramCache programCache("program_cache");
+        program = kerr::buildComputeProgram(cfg.shader, source, variant, &programCache);
+        if (!program) return false;
+
+        tileSize = cfg.tileSize;
+        texels.resize((size_t)tileSize * tileSize * 4);
+        glGenTextures(2, textures);
+        for (int i = 0; i < 2; ++i) {
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+            glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, tileSize, tileSize);
+            glBindImageTexture(i, textures[i], 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+        }
+        glGenBuffers(1, &stepStatsBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, stepStatsBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(kerr::StepStats), nullptr, GL_DYNAMIC_READ);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kerr::STEP_STATS_BINDING, stepStatsBuffer);
+        glGenBuffers(1, &paramsBuffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, paramsBuffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(kerr::ShaderParams), nullptr, GL_DYNAMIC_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, kerr::SHADER_PARAMS_BINDING, paramsBuffer);
+        return true;
+    }
+
+    void render(const kerr::RenderParams& p, const TileRect& r, float* slot) {
+        kerr::ShaderParams params;
+        params.resolution[0] = (float)p.width;
+        params.resolution[1] = (float)p.height;
+        params.tileOffset[0] = r.x0;
+        params.tileOffset[1] = r.y0;
+        params.time = p.time;
+        params.spinParameter = p.spin;
+        params.exposure = p.exposure;
+        params.inclination = p.inclination;
+        params.cameraDistance = p.cameraDistance;
+        params.maxBounces = p.maxBounces;
+        params.integrator = p.integrator == kerr::Integrator::Mino ? 1 : 0;
+        params.relTolPos = p.tolerances.relPos;
+        params.absTolPos = p.tolerances.absPos;
+        params.relTolMom = p.tolerances.relMom;
+        params.absTolMom = p.tolerances.absMom;
+        glBindBuffer(GL_UNIFORM_BUFFER, paramsBuffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(params), &params);
+        glUseProgram(program);
+
+        glDispatchCompute((r.x1 - r.x0 + 15) / 16, (r.y1 - r.y0 + 15) / 16, 1);
+        glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+        glBindTexture(GL_TEXTURE_2D, textures[0]);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, texels.data());
+
+        for (int y = 0; y < r.y1 - r.y0; ++y) {
+            for (int x = 0; x < r.x1 - r.x0; ++x) {
+                const float* src = &texels[((size_t)y * tileSize + x) * 4];
+                float* dst = &slot[((size_t)y * tileSize + x) * 3];
+                dst[0] = src[0];
+                dst[1] = src[1];
+                dst[2] = src[2];
+            }
+        }
+    }
+};
+
+// Flushes a framebuffer slot to disk; msync needs a page-aligned start
+bool flushSlot(char* framebuffer, size_t offset, size_t bytes) {
+    static const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t start = offset / page * page;
+    return msync(framebuffer + start, offset + bytes - start, MS_SYNC) == 0;
+}
+
+// Body of a forked worker process; returns its exit code
+int runWorker(const FarmConfig& cfg, const TileLayout& layout, FarmShared* shared, char* framebuffer,
+              int logFd, int index) {
+    GlTileRenderer gl;
+    if (cfg.backend == Backend::Gl && !gl.create(cfg)) return 2;
+
+    int tile;
+    while ((tile = claimTile(shared, layout.totalTiles(), index)) >= 0) {
+        TileRect r = tileRect(layout, cfg.params, tile);
+        kerr::RenderParams p = frameParams(cfg, r.frame);
+        size_t offset = layout.slotBytes() * (size_t)tile;
+        float* slot = reinterpret_cast<float*>(framebuffer + offset);
+
+        if (cfg.backend == Backend::Gl) {
+            gl.render(p, r, slot);
+        } else {
+            shared->steps[index] += renderTileCpu(p, r, layout.tileSize, slot);
+        }
+
+        // The tile is logged only once its pixels are on disk
+        if (!flushSlot(framebuffer, offset, layout.slotBytes())) {
+            std::cerr << "Worker " << index << ": msync failed for tile " << tile << std::endl;
+            return 3;
+        }
+        char line[32];
+        int length = std::snprintf(line, sizeof(line), "%d %d\n", r.frame, tile % layout.tilesPerFrame());
+        if (write(logFd, line, (size_t)length) != length) {
+            std::cerr << "Worker " << index << ": failed to log tile " << tile << std::endl;
+            return 3;
+        }
+
+        shared->states()[tile].store(TILE_DONE);
+        shared->current[index].store(-1);
+        shared->rendered[index]++;
+        shared->completed++;
+    }
+    return 0;
+}
+
+// ===================================================================
+// COORDINATOR - JOB DIRECTORY, PROCESSES, ASSEMBLY
+// ===================================================================
+
+// Creates the job directory, or checks that an existing one holds this job
+bool prepareJob(const FarmConfig& cfg) {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    fs::path dir(cfg.jobDir);
+    if (cfg.restart) {
+        fs::remove(dir / "job.txt", ec);
+        fs::remove(dir / "tiles.log", ec);
+        fs::remove(dir / "framebuffer.bin", ec);
+    }
+    fs::create_directories(dir, ec);
+
+    std::string description = jobDescription(cfg);
+    std::ifstream existing(dir / "job.txt");
+    if (existing.is_open()) {
+        std::stringstream buffer;
+        buffer << existing.rdbuf();
+        if (buffer.str() != description) {
+            std::cerr << "Job directory " << cfg.jobDir << " holds a different job:\n" << buffer.str()
+                      << "Use --restart to discard it, or --job to pick another directory." << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // A new job: the log must not outlive its framebuffer
+    fs::remove(dir / "tiles.log", ec);
+    fs::remove(dir / "framebuffer.bin", ec);
+    std::ofstream out(dir / "job.txt");
+    out << description;
+    if (!out) {
+        std::cerr << "Failed to write " << (dir / "job.txt").string() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Marks every logged tile done; returns how many there were
+int replayLog(const std::string& path, const TileLayout& layout, FarmShared* shared) {
+    std::ifstream log(path);
+    int frame, tile, resumed = 0;
+    while (log >> frame >> tile) {
+        if (frame < 0 || frame >= layout.frames || tile < 0 || tile >= layout.tilesPerFrame()) continue;
+        std::atomic<uint16_t>& state = shared->states()[frame * layout.tilesPerFrame() + tile];
+        if (state.load() != TILE_DONE) {
+            state.store(TILE_DONE);
+            resumed++;
+        }
+    }
+    return resumed;
+}
+
+// Frame assembled from its tiles: PPM top row first, PFM bottom row first
+bool writeFrame(const FarmConfig& cfg, const TileLayout& layout, const char* framebuffer, int frame,
+                const std::string& path) {
+    const int W = cfg.params.width;
+    const int H = cfg.params.height;
+    std::vector<float> rgb((size_t)W * H * 3);
+    for (int t = 0; t < layout.tilesPerFrame(); ++t) {
+        TileRect r = tileRect(layout, cfg.params, frame * layout.tilesPerFrame() + t);
+        const float* slot = reinterpret_cast<const float*>(
+            framebuffer + layout.slotBytes() * (size_t)(frame * layout.tilesPerFrame() + t));
+        for (int y = r.y0; y < r.y1; ++y) {
+            std::memcpy(&rgb[((size_t)y * W + r.x0) * 3], &slot[(size_t)(y - r.y0) * layout.tileSize * 3],
+                        (size_t)(r.x1 - r.x0) * 3 * sizeof(float));
+        }
+    }
+
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open()) {
+        std::cerr << "Failed to open output file: " << path << std::endl;
+        return false;
+    }
+    if (cfg.format == OutputFormat::PFM) {
+        out << "PF\n" << W << " " << H << "\n-1.0\n";   // negative scale: little endian
+        out.write(reinterpret_cast<const char*>(rgb.data()), (std::streamsize)(rgb.size() * sizeof(float)));
+    } else {
+        out << "P6\n" << W << " " << H << "\n255\n";
+        std::vector<unsigned char> bytes(rgb.size());
+        for (int y = 0; y < H; ++y) {
+            const float* src = &rgb[(size_t)(H - 1 - y) * W * 3];
+            for (int i = 0; i < W * 3; ++i) {
+                bytes[(size_t)y * W * 3 + i] = (unsigned char)(kerr::clampf(src[i], 0.0f, 1.0f) * 255.0f);
+            }
+        }
+        out.write(reinterpret_cast<const char*>(bytes.data()), (std::streamsize)bytes.size());
+    }
+    return (bool)out;
+}
+
+int main(int argc, char* argv[]) {
+    FarmConfig cfg;
+    if (!parseArgs(argc, argv, cfg)) return 1;
+
+    TileLayout layout;
+    layout.tileSize = cfg.tileSize;
+    layout.tilesX = (cfg.params.width + cfg.tileSize - 1) / cfg.tileSize;
+    layout.tilesY = (cfg.params.height + cfg.tileSize - 1) / cfg.tileSize;
+    layout.frames = cfg.frames;
+    const int total = layout.totalTiles();
+
+    if (!prepareJob(cfg)) return 1;
+    const std::string framebufferPath = (std::filesystem::path(cfg.jobDir) / "framebuffer.bin").string();
+    const std::string logPath = (std::filesystem::path(cfg.jobDir) / "tiles.log").string();
+
+    // The framebuffer file is sparse until tiles land in it
+    int fbFd = open(framebufferPath.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fbFd < 0 || ftruncate(fbFd, (off_t)layout.framebufferBytes()) != 0) {
+        std::cerr << "Failed to create " << framebufferPath << std::endl;
+        return 1;
+    }
+    char* framebuffer = (char*)mmap(nullptr, layout.framebufferBytes(), PROT_READ | PROT_WRITE, MAP_SHARED, fbFd, 0);
+    close(fbFd);
+    if (framebuffer == MAP_FAILED) {
+        std::cerr << "Failed to map " << framebufferPath << std::endl;
+        return 1;
+    }
+
+    size_t sharedBytes = sizeof(FarmShared) + (size_t)total * sizeof(std::atomic<uint16_t>);
+    void* sharedMemory = mmap(nullptr, sharedBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (sharedMemory == MAP_FAILED) {
+        std::cerr << "Failed to allocate the shared tile queue" << std::endl;
+        return 1;
+    }
+    FarmShared* shared = new (sharedMemory) FarmShared();
+    for (int t = 0; t < total; ++t) new (&shared->states()[t]) std::atomic<uint16_t>(TILE_PENDING);
+    for (int w = 0; w < MAX_WORKERS; ++w) shared->current[w].store(-1);
+
+    const int resumed = replayLog(logPath, layout, shared);
+    int logFd = open(logPath.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (logFd < 0) {
+        std::cerr << "Failed to open " << logPath << std::endl;
+        return 1;
+    }
+
+    std::cout << "========================================\n"
+              << "Kerr Black Hole - Tile Render Farm\n"
+              << "========================================\n"
+              << "Resolution: " << cfg.params.width << "x" << cfg.params.height
+              << " | Frames: " << cfg.frames << " | Bounces: " << cfg.params.maxBounces << "\n"
+              << "Tiles: " << total << " of " << cfg.tileSize << "px (" << resumed << " already done)\n"
+              << "Workers: " << cfg.workers << " x "
+              << (cfg.backend == Backend::Gl ? "gl (" + cfg.shader + ")" : std::string("cpu ") + kerr::simd::BACKEND_NAME) << "\n"
+              << "Job: " << cfg.jobDir << " (" << layout.framebufferBytes() / (1024.0 * 1024.0) << " MiB framebuffer)\n"
+              << "========================================" << std::endl;
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<pid_t> pids(cfg.workers, -1);
+    std::vector<int> restarts(cfg.workers, 0);
+    int running = 0;
+
+    auto spawn = [&](int index) {
+        std::cout.flush();
+        pid_t pid = fork();
+        if (pid == 0) {
+            signal(SIGINT, SIG_DFL);
+            _exit(runWorker(cfg, layout, shared, framebuffer, logFd, index));
+        }
+        if (pid < 0) {
+            std::cerr << "fork failed for worker " << index << std::endl;
+            return;
+        }
+        pids[index] = pid;
+        running++;
+    };
+
+    if (resumed < total) {
+        for (int w = 0; w < cfg.workers; ++w) spawn(w);
+    }
+
+    // Progress once a second; crashed workers give their tile back and are
+    // restarted while tiles remain
+    uint32_t lastCompleted = 0;
+    auto lastReport = start;
+    while (running > 0) {
+        int status = 0;
+        pid_t pid = waitpid(-1, &status, WNOHANG);
+        if (pid > 0) {
+            int index = (int)(std::find(pids.begin(), pids.end(), pid) - pids.begin());
+            if (index >= cfg.workers) continue;
+            pids[index] = -1;
+            running--;
+            bool crashed = !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+            int tile = shared->current[index].exchange(-1);
+            if (crashed) {
+                bool requeued = false;
+                if (tile >= 0) {
+                    uint16_t claimed = claimedBy(index);
+                    requeued = shared->states()[tile].compare_exchange_strong(claimed, TILE_PENDING);
+                }
+                std::cerr << "Worker " << index << " "
+                          << (WIFSIGNALED(status) ? "killed by signal " + std::to_string(WTERMSIG(status))
+                                                  : "exited with status " + std::to_string(WEXITSTATUS(status)))
+                          << (requeued ? ", tile " + std::to_string(tile) + " requeued" : std::string()) << std::endl;
+                if (restarts[index] < cfg.retries && (int)shared->completed.load() + resumed < total) {
+                    restarts[index]++;
+                    spawn(index);
+                }
+            }
+            continue;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        auto now = std::chrono::steady_clock::now();
+        double interval = std::chrono::duration<double>(now - lastReport).count();
+        if (interval >= 1.0) {
+            uint32_t completed = shared->completed.load();
+            double elapsed = std::chrono::duration<double>(now - start).count();
+            double rate = completed / std::max(elapsed, 1e-9);
+            int remaining = total - resumed - (int)completed;
+            std::cout << "Tiles: " << resumed + (int)completed << "/" << total
+                      << " | " << (completed - lastCompleted) / interval << " tiles/s now, " << rate << " tiles/s mean"
+                      << " | ETA " << (rate > 0.0 ? (int)(remaining / rate) : -1) << " s" << std::endl;
+            lastCompleted = completed;
+            lastReport = now;
+        }
+    }
+    close(logFd);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    uint32_t completed = shared->completed.load();
+    uint64_t steps = 0;
+    std::cout << "Rendered " << completed << " tiles in " << seconds << " s ("
+              << completed / std::max(seconds, 1e-9) << " tiles/s)" << std::endl;
+    for (int w = 0; w < cfg.workers; ++w) {
+        steps += shared->steps[w].load();
+        if (shared->rendered[w].load() > 0) {
+            std::cout << "  worker " << w << ": " << shared->rendered[w].load() << " tiles" << std::endl;
+        }
+    }
+    if (steps > 0) std::cout << "Steps/s: " << (uint64_t)(steps / std::max(seconds, 1e-9)) << std::endl;
+
+    int missing = total - resumed - (int)completed;
+    if (missing > 0) {
+        std::cerr << missing << " tiles unfinished; run the same command again to resume" << std::endl;
+        return 1;
+    }
+
+    for (int f = 0; f < cfg.frames; ++f) {
+        std::string path = cfg.frames > 1 ? kerr::framePath(cfg.output, f) : cfg.output;
+        if (!writeFrame(cfg, layout, framebuffer, f, path)) return 1;
+    }
+    std::cout << "Done! Output saved to "
+              << (cfg.frames > 1
+                      ? kerr::framePath(cfg.output, 0) + " ... " + kerr::framePath(cfg.output, cfg.frames - 1)
+                      : cfg.output)
+              << std::endl;
+
+    munmap(framebuffer, layout.framebufferBytes());
+    munmap(sharedMemory, sharedBytes);
+    return 0;
+}
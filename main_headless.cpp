@@ -0,0 +1,918 @@
+/*
+ * Kerr Black Hole - Headless Batch Renderer
+ * C++17, OpenGL 4.5 through EGL, no display required
+ *
+ * Renders a range of animation frames with blackhole_improved.comp for
+ * video assets. The context is created without a window (EGL surfaceless,
+ * or a pbuffer where that is unavailable), so it runs on render nodes and
+ * on Mesa llvmpipe.
+ *
+ * Frames are read back through a ring of pixel-buffer objects: each
+ * dispatch is followed by an asynchronous glGetTexImage into the next PBO
+ * and a fence, and a frame is only mapped once the ring wraps around to
+ * it. While frame N is mapped and converted, frames N+1 .. N+ring-1 are
+ * already queued on the GPU. Converted frames go to a writer thread, so
+ * disk or pipe I/O never stalls the render loop.
+ *
+ * Camera and spin follow a keyframe file (--path), linearly interpolated
+ * by frame number; the orbit angle follows time = frame / fps as in the
+ * viewer.
+ *
+ * --adaptive renders each frame as a grid pass and a fill pass that
+ * interpolates smooth cells instead of tracing them (adaptive_sampling.h).
+ * --shadow-skip computes each frame's shadow outline (kerr_shadow.h) and
+ * leaves the pixels inside it black without tracing them.
+ * --far-field integrates only inside r = 30 (--far-field-radius) and
+ * moves rays outside that sphere analytically (kerr_physics.h).
+ * Bloom (bloom.comp, bloom.h) is added into each frame before readback;
+ * --bloom 0 turns it off. --emission-lut shades disk hits from tabulated
+ * blackbody colours and disk structure (emission_lut.h). --sky-cubemap
+ * bakes the starfield into a cube map once, with the stars of
+ * --star-catalog if given (sky_cubemap.h); --write-star-catalog writes a
+ * synthetic catalog in that format and exits. --aov PREFIX builds the
+ * shader with its diagnostic images (aov.h) and writes them for every
+ * frame; they are read back synchronously, so this is for diagnosis only.
+ *
+ * The compute shader is specialized for the run (shader_variants.h):
+ * integrator, bounces, step budget and starfield are compiled in, and the
+ * lensing map and any pass not requested are compiled out. The linked
+ * program is kept in --program-cache, so later runs skip compiling it.
+ *
+ * Output: Y4M (4:2:0, full range) streamed to stdout or a file, or
+ * numbered PPM / PFM files (frame_0000.ppm, ...). Progress goes to stderr.
+ *
+ * Build (Linux):
+ *   g++ main_headless.cpp -o kerr_headless -std=c++17 -O3 -pthread -lEGL -lOpenGL
+ * Example:
+ *   ./kerr_headless --frames 240 --path orbit.txt | ffmpeg -i - -c:v libx264 kerr.mp4
+ */
+
+#include "adaptive_sampling.h"
+#include "aov.h"
+#include "gl_headless.h"
+#include "bloom.h"  // after gl_headless.h, whose OpenGL declarations it uses
+#include "emission_lut.h"
+#include "frame_path.h"
+#include "kerr_shadow.h"
+#include "shader_params.h"
+#include "shader_variants.h"
+#include "sky_cubemap.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ===================================================================
+// CONFIGURATION AND KEYFRAMES
+// ===================================================================
+
+// Scene parameters that may be keyframed
+struct Keyframe {
+    float frame = 0.0f;
+    float spin = 0.9f;
+    float inclination = 85.0f;
+    float cameraDistance = 25.0f;
+    float exposure = 1.0f;
+};
+
+enum class OutputFormat { Y4M, PPM, PFM };
+
+struct BatchConfig {
+    std::string shader = "blackhole_improved.comp";
+    int width = 1920;
+    int height = 1080;
+    int firstFrame = 0;
+    int frames = 1;
+    float fps = 30.0f;
+    Keyframe scene;                  // used when there is no --path
+    std::string pathFile;
+    int maxBounces = 3;
+    int integrator = 0;              // 0 = affine, 1 = Mino
+    float bloomStrength = 0.5f;
+    OutputFormat format = OutputFormat::Y4M;
+    std::string output = "-";        // "-" = stdout (Y4M only)
+    int ring = 3;                    // PBOs in flight
+    bool pbuffer = false;            // force a pbuffer surface instead of surfaceless
+    bool adaptive = false;           // edge-adaptive grid and fill passes
+    bool shadowSkip = false;         // do not trace pixels inside the analytic shadow
+    float shadowMargin = kerr::SHADOW_MARGIN;
+    float farFieldRadius = 0.0f;     // analytic outside this sphere, 0 = off
+    int maxSteps = 0;                // step budget per ray, 0 = the shader's
+    int starfield = -1;              // starfield quality 0-2, -1 = the shader's
+    bool emissionLut = false;        // disk emission from tables (emission_lut.h)
+    bool skyCubemap = false;         // starfield from a baked cube map (sky_cubemap.h)
+    kerr::SkySettings sky;           // its face size and catalog; quality follows starfield
+    std::string programCache = "program_cache";   // "" = always compile
+    std::string aovPrefix;           // diagnostic images PREFIX_<channel>.pfm/.ppm; "" = none
+};
+
+// Keyframe file: one "frame spin inclination distance [exposure]" per line,
+// '#' starts a comment. Keys are sorted by frame.
+bool loadKeyframes(const std::string& path, std::vector<Keyframe>& keys) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open keyframe file: " << path << std::endl;
+        return false;
+    }
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        line = line.substr(0, line.find('#'));
+        if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+        std::istringstream in(line);
+        Keyframe k;
+        if (!(in >> k.frame >> k.spin >> k.inclination >> k.cameraDistance)) {
+            std::cerr << path << ":" << lineNumber << ": expected frame spin inclination distance [exposure]" << std::endl;
+            return false;
+        }
+        if (!(in >> k.exposure)) k.exposure = 1.0f;
+        k.spin = std::min(0.998f, std::max(0.0f, k.spin));
+        keys.push_back(k);
+    }
+    if (keys.empty()) {
+        std::cerr << "No keyframes in " << path << std::endl;
+        return false;
+    }
+    std::sort(keys.begin(), keys.end(), [](const Keyframe& a, const Keyframe& b) { return a.frame < b.frame; });
+    return true;
+}
+
+// Linear interpolation between the surrounding keys; held outside them
+Keyframe sceneAt(const std::vector<Keyframe>& keys, const Keyframe& fallback, float frame) {
+    if (keys.empty()) return fallback;
+    if (frame <= keys.front().frame) return keys.front();
+    if (frame >= keys.back().frame) return keys.back();
+    size_t i = 1;
+    while (keys[i].frame < frame) ++i;
+    const Keyframe& a = keys[i - 1];
+    const Keyframe& b = keys[i];
+    float t = (frame - a.frame) / std::max(b.frame - a.frame, 1e-6f);
+    auto lerp = [t](float x, float y) { return x + (y - x) * t; };
+    Keyframe k;
+    k.frame = frame;
+    k.spin = lerp(a.spin, b.spin);
+    k.inclination = lerp(a.inclination, b.inclination);
+    k.cameraDistance = lerp(a.cameraDistance, b.cameraDistance);
+    k.exposure = lerp(a.exposure, b.exposure);
+    return k;
+}
+
+void printUsage(const char* exe) {
+    std::cerr << "Usage: " << exe << " [options]\n"
+              << "  --frames N           Number of frames (default 1)\n"
+              << "  --first F            First frame number (default 0)\n"
+              << "  --fps F              Frames per time unit (default 30)\n"
+              << "  --path FILE          Keyframes: frame spin inclination distance [exposure] per line\n"
+              << "  --spin A             Spin without --path (default 0.9)\n"
+              << "  --inclination DEG    Inclination without --path (default 85)\n"
+              << "  --distance R         Camera distance without --path (default 25)\n"
+              << "  --exposure E         Exposure without --path (default 1.0)\n"
+              << "  --bounces N          Maximum disk bounces, 1-3 (default 3)\n"
+              << "  --integrator MODE    affine (default) or mino\n"
+              << "  --resolution WxH     Frame size (default 1920x1080)\n"
+              << "  --format FMT         y4m (default), ppm or pfm\n"
+              << "  --output PATH        y4m: file or - for stdout (default -); ppm/pfm: name of frame 0\n"
+              << "  --ring N             Pixel-buffer objects in flight (default 3)\n"
+              << "  --shader FILE        Compute shader (default blackhole_improved.comp)\n"
+              << "  --pbuffer            Use a pbuffer surface even if surfaceless contexts are supported\n"
+              << "  --adaptive           Trace a coarse grid and interpolate smooth cells\n"
+              << "  --shadow-skip        Do not trace pixels inside the analytic shadow\n"
+              << "  --shadow-margin F    Keep tracing within F of the shadow radius of its edge (default 0.05)\n"
+              << "  --far-field          Integrate only inside r = 30; move rays outside it analytically\n"
+              << "  --far-field-radius R Radius of --far-field, from the disk edge (15) to 100 (default 30)\n"
+              << "  --bloom S            Bloom strength, 0 for none (default 0.5)\n"
+              << "  --max-steps N        Step budget per ray (default: the shader's, 768)\n"
+              << "  --starfield Q        Starfield quality: 0 sky, 1 stars, 2 full (default 2)\n"
+              << "  --emission-lut       Shade disk hits from blackbody and disk structure tables\n"
+              << "  --sky-cubemap        Bake the starfield into a cube map once\n"
+              << "  --sky-size N         Cube map face size, 16-4096 (default 2048)\n"
+              << "  --star-catalog FILE  Stars of the cube map from a catalog (implies --sky-cubemap)\n"
+              << "  --write-star-catalog FILE N  Write N synthetic stars as a catalog and exit\n"
+              << "  --program-cache DIR  Linked program binaries (default program_cache)\n"
+              << "  --no-program-cache   Always compile the compute shader\n"
+              << "  --aov PREFIX         Also write each frame's diagnostic images PREFIX_<channel>.pfm (raw) and\n"
+              << "                       .ppm (false colour): steps, termination, bounces, max error, final r\n"
+              << std::endl;
+}
+
+bool parseArgs(int argc, char* argv[], BatchConfig& cfg) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&](const char* name) -> const char* {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << name << std::endl;
+                return nullptr;
+            }
+            return argv[++i];
+        };
+
+        const char* value = nullptr;
+        if (arg == "--help" || arg == "-h") {
+            printUsage(argv[0]);
+            std::exit(0);
+        } else if (arg == "--frames") {
+            if (!(value = next("--frames"))) return false;
+            cfg.frames = std::max(1, std::atoi(value));
+        } else if (arg == "--first") {
+            if (!(value = next("--first"))) return false;
+            cfg.firstFrame = std::atoi(value);
+        } else if (arg == "--fps") {
+            if (!(value = next("--fps"))) return false;
+            cfg.fps = std::max(1e-3f, (float)std::atof(value));
+        } else if (arg == "--path") {
+            if (!(value = next("--path"))) return false;
+            cfg.pathFile = value;
+        } else if (arg == "--spin") {
+            if (!(value = next("--spin"))) return false;
+            cfg.scene.spin = std::min(0.998f, std::max(0.0f, (float)std::atof(value)));
+        } else if (arg == "--inclination") {
+            if (!(value = next("--inclination"))) return false;
+            cfg.scene.inclination = (float)std::atof(value);
+        } else if (arg == "--distance") {
+            if (!(value = next("--distance"))) return false;
+            cfg.scene.cameraDistance = (float)std::atof(value);
+        } else if (arg == "--exposure") {
+            if (!(value = next("--exposure"))) return false;
+            cfg.scene.exposure = (float)std::atof(value);
+        } else if (arg == "--bounces") {
+            if (!(value = next("--bounces"))) return false;
+            cfg.maxBounces = std::min(kerr::SHADER_MAX_BOUNCES, std::max(1, std::atoi(value)));
+        } else if (arg == "--integrator") {
+            if (!(value = next("--integrator"))) return false;
+            if (std::strcmp(value, "affine") == 0) {
+                cfg.integrator = 0;
+            } else if (std::strcmp(value, "mino") == 0) {
+                cfg.integrator = 1;
+            } else {
+                std::cerr << "Unknown integrator: " << value << std::endl;
+                return false;
+            }
+        } else if (arg == "--resolution") {
+            if (!(value = next("--resolution"))) return false;
+            if (std::sscanf(value, "%dx%d", &cfg.width, &cfg.height) != 2 || cfg.width <= 0 || cfg.height <= 0) {
+                std::cerr << "Invalid resolution: " << value << std::endl;
+                return false;
+            }
+        } else if (arg == "--format") {
+            if (!(value = next("--format"))) return false;
+            if (std::strcmp(value, "y4m") == 0) {
+                cfg.format = OutputFormat::Y4M;
+            } else if (std::strcmp(value, "ppm") == 0) {
+                cfg.format = OutputFormat::PPM;
+            } else if (std::strcmp(value, "pfm") == 0) {
+                cfg.format = OutputFormat::PFM;
+            } else {
+                std::cerr << "Unknown format: " << value << std::endl;
+                return false;
+            }
+        } else if (arg == "--output") {
+            if (!(value = next("--output"))) return false;
+            cfg.output = value;
+        } else if (arg == "--ring") {
+            if (!(value = next("--ring"))) return false;
+            cfg.ring = std::min(16, std::max(1, std::atoi(value)));
+        } else if (arg == "--shader") {
+            if (!(value = next("--shader"))) return false;
+            cfg.shader = value;
+        } else if (arg == "--pbuffer") {
+            cfg.pbuffer = true;
+        } else if (arg == "--adaptive") {
+            cfg.adaptive = true;
+        } else if (arg == "--shadow-skip") {
+            cfg.shadowSkip = true;
+        } else if (arg == "--far-field") {
+            cfg.farFieldRadius = kerr::FAR_FIELD_RADIUS;
+        } else if (arg == "--far-field-radius") {
+            if (!(value = next("--far-field-radius"))) return false;
+            cfg.farFieldRadius = (float)std::atof(value);
+            if (cfg.farFieldRadius < kerr::DISK_OUTER || cfg.farFieldRadius >= kerr::ESCAPE_RADIUS) {
+                std::cerr << "Far-field radius must lie between the disk edge (" << kerr::DISK_OUTER
+                          << ") and the escape radius (" << kerr::ESCAPE_RADIUS << "): " << value << std::endl;
+                return false;
+            }
+        } else if (arg == "--shadow-margin") {
+            if (!(value = next("--shadow-margin"))) return false;
+            cfg.shadowMargin = std::min(0.9f, std::max(0.0f, (float)std::atof(value)));
+            cfg.shadowSkip = true;
+        } else if (arg == "--max-steps") {
+            if (!(value = next("--max-steps"))) return false;
+            cfg.maxSteps = std::max(1, std::atoi(value));
+        } else if (arg == "--starfield") {
+            if (!(value = next("--starfield"))) return false;
+            cfg.starfield = std::min(2, std::max(0, std::atoi(value)));
+        } else if (arg == "--emission-lut") {
+            cfg.emissionLut = true;
+        } else if (arg == "--sky-cubemap") {
+            cfg.skyCubemap = true;
+        } else if (arg == "--sky-size") {
+            if (!(value = next("--sky-size"))) return false;
+            cfg.sky.faceSize = std::min(kerr::SKY_FACE_SIZE_MAX, std::max(16, std::atoi(value)));
+        } else if (arg == "--star-catalog") {
+            if (!(value = next("--star-catalog"))) return false;
+            cfg.sky.catalog = value;
+            cfg.skyCubemap = true;
+        } else if (arg == "--write-star-catalog") {
+            if (!(value = next("--write-star-catalog"))) return false;
+            std::string path = value;
+            if (!(value = next("--write-star-catalog"))) return false;
+            int count = std::max(1, std::atoi(value));
+            auto start = std::chrono::steady_clock::now();
+            if (!kerr::writeStarCatalog(path, kerr::syntheticStars(count, 14.0f, 0x5747u))) std::exit(1);
+            std::cerr << "Wrote " << count << " stars to " << path << " in "
+                      << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s"
+                      << std::endl;
+            std::exit(0);
+        } else if (arg == "--program-cache") {
+            if (!(value = next("--program-cache"))) return false;
+            cfg.programCache = value;
+        } else if (arg == "--no-program-cache") {
+            cfg.programCache.clear();
+        } else if (arg == "--bloom") {
+            if (!(value = next("--bloom"))) return false;
+            cfg.bloomStrength = std::min(4.0f, std::max(0.0f, (float)std::atof(value)));
+        } else if (arg == "--aov") {
+            if (!(value = next("--aov"))) return false;
+            cfg.aovPrefix = value;
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            printUsage(argv[0]);
+            return false;
+        }
+    }
+    if (cfg.format != OutputFormat::Y4M && cfg.output == "-") {
+        cfg.output = cfg.format == OutputFormat::PFM ? "frame.pfm" : "frame.ppm";
+    }
+    return true;
+}
+
+// ===================================================================
+// FRAME CONVERSION AND WRITER THREAD
+// ===================================================================
+
+// A converted frame waiting for the writer. Buffers are recycled through the
+// writer's free list, so steady-state rendering does not allocate.
+struct OutputFrame {
+    int number = 0;
+    std::vector<uint8_t> bytes;
+};
+
+// Same rounding as the other writers: clamp to [0, 1], scale, truncate
+inline uint8_t toByte(float v) {
+    return (uint8_t)(std::min(1.0f, std::max(0.0f, v)) * 255.0f);
+}
+
+// RGBA float texels (bottom row first, as stored in the texture) to the
+// payload of one output frame. PPM and Y4M are top row first; PFM is
+// bottom row first by definition.
+void convertFrame(const float* rgba, int width, int height, OutputFormat format, std::vector<uint8_t>& out) {
+    const size_t pixels = (size_t)width * height;
+    if (format == OutputFormat::PFM) {
+        out.resize(pixels * 3 * sizeof(float));
+        float* dst = reinterpret_cast<float*>(out.data());
+        for (size_t i = 0; i < pixels; ++i) {
+            dst[i * 3 + 0] = rgba[i * 4 + 0];
+            dst[i * 3 + 1] = rgba[i * 4 + 1];
+            dst[i * 3 + 2] = rgba[i * 4 + 2];
+        }
+        return;
+    }
+
+    if (format == OutputFormat::PPM) {
+        out.resize(pixels * 3);
+        for (int y = 0; y < height; ++y) {
+            const float* src = rgba + (size_t)(height - 1 - y) * width * 4;
+            uint8_t* dst = out.data() + (size_t)y * width * 3;
+            for (int x = 0; x < width; ++x) {
+                dst[x * 3 + 0] = toByte(src[x * 4 + 0]);
+                dst[x * 3 + 1] = toByte(src[x * 4 + 1]);
+                dst[x * 3 + 2] = toByte(src[x * 4 + 2]);
+            }
+        }
+        return;
+    }
+
+    // Y4M C420jpeg: full-range BT.601 luma per pixel, chroma averaged over
+    // 2x2 blocks (partial blocks at odd edges)
+    const int chromaW = (width + 1) / 2;
+    const int chromaH = (height + 1) / 2;
+    out.resize(pixels + 2 * (size_t)chromaW * chromaH);
+    uint8_t* lumaPlane = out.data();
+    uint8_t* cbPlane = lumaPlane + pixels;
+    uint8_t* crPlane = cbPlane + (size_t)chromaW * chromaH;
+
+    for (int cy = 0; cy < chromaH; ++cy) {
+        for (int cx = 0; cx < chromaW; ++cx) {
+            float cb = 0.0f, cr = 0.0f;
+            int count = 0;
+            for (int dy = 0; dy < 2; ++dy) {
+                int y = cy * 2 + dy;
+                if (y >= height) break;
+                const float* src = rgba + (size_t)(height - 1 - y) * width * 4;
+                for (int dx = 0; dx < 2; ++dx) {
+                    int x = cx * 2 + dx;
+                    if (x >= width) break;
+                    float r = toByte(src[x * 4 + 0]);
+                    float g = toByte(src[x * 4 + 1]);
+                    float b = toByte(src[x * 4 + 2]);
+                    float luma = 0.299f * r + 0.587f * g + 0.114f * b;
+                    lumaPlane[(size_t)y * width + x] = (uint8_t)std::min(255.0f, luma + 0.5f);
+                    cb += -0.168736f * r - 0.331264f * g + 0.5f * b;
+                    cr += 0.5f * r - 0.418688f * g - 0.081312f * b;
+                    count++;
+                }
+            }
+            cbPlane[(size_t)cy * chromaW + cx] = (uint8_t)std::min(255.0f, std::max(0.0f, 128.0f + cb / count + 0.5f));
+            crPlane[(size_t)cy * chromaW + cx] = (uint8_t)std::min(255.0f, std::max(0.0f, 128.0f + cr / count + 0.5f));
+        }
+    }
+}
+
+class FrameWriter {
+public:
+    FrameWriter(const BatchConfig& config, size_t maxQueued) : cfg(config), capacity(maxQueued) {}
+
+    ~FrameWriter() { finish(); }
+
+    bool start() {
+        if (cfg.format == OutputFormat::Y4M) {
+            stream = cfg.output == "-" ? stdout : std::fopen(cfg.output.c_str(), "wb");
+            if (!stream) {
+                std::cerr << "Failed to open output file: " << cfg.output << std::endl;
+                return false;
+            }
+            // Frame rate as a rational with millisecond resolution
+            std::fprintf(stream, "YUV4MPEG2 W%d H%d F%d:1000 Ip A1:1 C420jpeg XCOLORRANGE=FULL\n",
+                         cfg.width, cfg.height, (int)(cfg.fps * 1000.0f + 0.5f));
+        }
+        thread = std::thread(&FrameWriter::run, this);
+        return true;
+    }
+
+    // A buffer for the next frame, reused from a written one if possible.
+    // Blocks while maxQueued frames are waiting to be written.
+    OutputFrame acquire() {
+        std::unique_lock<std::mutex> lock(mutex);
+        spaceAvailable.wait(lock, [this] { return queue.size() < capacity || failed; });
+        if (freeList.empty()) return OutputFrame();
+        OutputFrame frame = std::move(freeList.back());
+        freeList.pop_back();
+        return frame;
+    }
+
+    void submit(OutputFrame&& frame) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(std::move(frame));
+        }
+        frameReady.notify_one();
+    }
+
+    // Waits for every queued frame; false if any write failed
+    bool finish() {
+        if (thread.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                done = true;
+            }
+            frameReady.notify_one();
+            thread.join();
+        }
+        if (stream && stream != stdout) std::fclose(stream);
+        if (stream == stdout) std::fflush(stdout);
+        stream = nullptr;
+        return !failed;
+    }
+
+    bool hasFailed() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return failed;
+    }
+
+    double busySeconds() const { return busy; }
+
+private:
+    void run() {
+        for (;;) {
+            OutputFrame frame;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                frameReady.wait(lock, [this] { return !queue.empty() || done; });
+                if (queue.empty()) return;
+                frame = std::move(queue.front());
+                queue.pop_front();
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            bool ok = write(frame);
+            busy += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!ok) failed = true;
+                freeList.push_back(std::move(frame));
+            }
+            spaceAvailable.notify_one();
+        }
+    }
+
+    bool write(const OutputFrame& frame) {
+        if (cfg.format == OutputFormat::Y4M) {
+            if (std::fputs("FRAME\n", stream) == EOF) return false;
+            return std::fwrite(frame.bytes.data(), 1, frame.bytes.size(), stream) == frame.bytes.size();
+        }
+
+        std::string path = kerr::framePath(cfg.output, frame.number);
+        FILE* file = std::fopen(path.c_str(), "wb");
+        if (!file) {
+            std::cerr << "Failed to open output file: " << path << std::endl;
+            return false;
+        }
+        if (cfg.format == OutputFormat::PFM) {
+            std::fprintf(file, "PF\n%d %d\n-1.0\n", cfg.width, cfg.height);   // negative scale: little endian
+        } else {
+            std::fprintf(file, "P6\n%d %d\n255\n", cfg.width, cfg.height);
+        }
+        bool ok = std::fwrite(frame.bytes.data(), 1, frame.bytes.size(), file) == frame.bytes.size();
+        ok = std::fclose(file) == 0 && ok;
+        return ok;
+    }
+
+    const BatchConfig& cfg;
+    const size_t capacity;
+    FILE* stream = nullptr;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable frameReady;
+    std::condition_variable spaceAvailable;
+    std::deque<OutputFrame> queue;
+    std::vector<OutputFrame> freeList;
+    bool done = false;
+    bool failed = false;
+    double busy = 0.0;
+};
+
+// ===================================================================
+// MAIN - DISPATCH, PBO RING, CONVERSION
+// ===================================================================
+
+int main(int argc, char* argv[]) {
+    BatchConfig cfg;
+    if (!parseArgs(argc, argv, cfg)) return 1;
+
+    std::vector<Keyframe> keys;
+    if (!cfg.pathFile.empty() && !loadKeyframes(cfg.pathFile, keys)) return 1;
+
+    // A closed pipe (the encoder exited) shows up as a failed write instead
+    // of killing the process
+    std::signal(SIGPIPE, SIG_IGN);
+
+    HeadlessContext gl;
+    if (!gl.create(cfg.pbuffer)) return 1;
+
+    // Compute program specialized for this run; the lensing map is never used
+    kerr::ShaderVariant variant;
+    variant.maxSteps = cfg.maxSteps;
+    variant.maxBounces = cfg.maxBounces;
+    variant.integrator = cfg.integrator;
+    variant.starfield = cfg.starfield;
+    variant.farField = cfg.farFieldRadius > 0.0f;
+    variant.lensingMap = false;
+    variant.adaptive = cfg.adaptive;
+    variant.emissionLut = cfg.emissionLut;
+    variant.skyCubemap = cfg.skyCubemap;
+    variant.aov = !cfg.aovPrefix.empty();
+    kerr::ProgramCache programCache(cfg.programCache);
+    std::string source = loadFile(cfg.shader);
+    if (source.empty()) return 1;
+    auto buildStart = std::chrono::steady_clock::now();
+    bool fromCache = false;
+    GLuint program = kerr::buildComputeProgram(cfg.shader, source, variant, &programCache, &fromCache);
+    if (!program) return 1;
+    std::cerr << cfg.shader << (fromCache ? " loaded from " + programCache.directory() : std::string(" compiled"))
+              << " in " << std::chrono::duration<double>(std::chrono::steady_clock::now() - buildStart).count()
+              << " s" << std::endl;
+
+    const int W = cfg.width;
+    const int H = cfg.height;
+
+    // Output image, step statistics; the lensing map stays unused
+    GLuint outputTexture;
+    glGenTextures(1, &outputTexture);
+    glBindTexture(GL_TEXTURE_2D, outputTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, W, H);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindImageTexture(0, outputTexture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+
+    // Diagnostic images, cleared before each frame so that pixels no ray
+    // was traced for read as AOV_END_NONE. Bloom uses the same image unit,
+    // so it is bound per frame.
+    GLuint aovTexture = 0;
+    kerr::AovImage aov;
+    if (variant.aov) {
+        glGenTextures(1, &aovTexture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, aovTexture);
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGBA32F, W, H, kerr::AOV_LAYERS);
+        aov.reset(W, H);
+    }
+
+    // Bloom passes (bloom.h), added into each frame before readback
+    kerr::BloomChain bloom;
+    GLuint bloomProgram = 0;
+    if (cfg.bloomStrength > 0.0f) {
+        std::string bloomSource = loadFile("bloom.comp");
+        if (bloomSource.empty()) return 1;
+        bloomProgram = kerr::buildComputeProgram("bloom.comp", bloomSource, kerr::ShaderVariant(), &programCache);
+        if (!bloom.create(bloomProgram, W, H)) return 1;
+    }
+    GLuint stepStatsBuffer;
+    glGenBuffers(1, &stepStatsBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, stepStatsBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(kerr::StepStats), nullptr, GL_DYNAMIC_READ);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kerr::STEP_STATS_BINDING, stepStatsBuffer);
+
+    // Lensing samples of the adaptive grid points (1 + MAX_BOUNCES texels each)
+    kerr::AdaptiveGrid grid(W, H);
+    GLuint coarseSamplesBuffer = 0;
+    if (cfg.adaptive) {
+        glGenBuffers(1, &coarseSamplesBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, coarseSamplesBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)grid.points() * 4 * 4 * sizeof(float), nullptr,
+                     GL_DYNAMIC_COPY);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, coarseSamplesBuffer);
+    }
+
+    // Emission tables; the disk model is fixed for the run
+    kerr::EmissionTextures emission;
+    if (cfg.emissionLut) {
+        auto tableStart = std::chrono::steady_clock::now();
+        if (!emission.create()) return 1;
+        emission.update(kerr::DiskModel());
+        std::cerr << "Emission tables built in "
+                  << std::chrono::duration<double>(std::chrono::steady_clock::now() - tableStart).count() << " s ("
+                  << emission.bytes() / 1024 << " KiB)" << std::endl;
+    }
+
+    // Baked sky, built once; the starfield quality is applied by the bake
+    kerr::SkyCubemap sky;
+    if (cfg.skyCubemap) {
+        cfg.sky.quality = cfg.starfield >= 0 ? cfg.starfield : 2;
+        kerr::SkyBakeStats bake;
+        if (!sky.bake(cfg.sky, &bake)) return 1;
+        std::cerr << "Sky cube map " << cfg.sky.faceSize << "^2 x 6 baked: sky " << bake.skySeconds << " s, "
+                  << bake.stars << " stars and mips " << bake.starSeconds << " s, upload " << bake.uploadSeconds
+                  << " s (" << bake.bytes / (1024 * 1024) << " MiB)" << std::endl;
+    }
+
+    // Radius table of the frame's shadow outline
+    GLuint shadowBuffer = 0;
+    if (cfg.shadowSkip) {
+        glGenBuffers(1, &shadowBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, shadowBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, kerr::SHADOW_OUTLINE_BINS * sizeof(float), nullptr, GL_DYNAMIC_DRAW);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kerr::SHADOW_OUTLINE_BINDING, shadowBuffer);
+    }
+
+    // Readback ring: one PBO and fence per frame in flight, and a copy of
+    // the frame's step counters, which are 32 bits and cleared per frame
+    const size_t frameBytes = (size_t)W * H * 4 * sizeof(float);
+    std::vector<GLuint> pbos(cfg.ring), statsCopies(cfg.ring);
+    std::vector<GLsync> fences(cfg.ring, nullptr);
+    std::vector<int> slotFrame(cfg.ring, -1);
+    glGenBuffers(cfg.ring, pbos.data());
+    for (GLuint pbo : pbos) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)frameBytes, nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glGenBuffers(cfg.ring, statsCopies.data());
+    for (GLuint copy : statsCopies) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, copy);
+        glBufferData(GL_COPY_WRITE_BUFFER, sizeof(kerr::StepStats), nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    // Parameter block (shader_params.h); only the scene changes per frame
+    kerr::ShaderParams params;
+    params.resolution[0] = (float)W;
+    params.resolution[1] = (float)H;
+    params.maxBounces = cfg.maxBounces;
+    params.integrator = cfg.integrator;
+    params.farFieldRadius = cfg.farFieldRadius;
+    params.bloomStrength = cfg.bloomStrength;
+    if (cfg.adaptive) {
+        kerr::RenderParams view;
+        view.height = H;
+        params.adaptiveCell = grid.cell;
+        params.adaptiveEscapeTol = kerr::adaptiveEscapeTolerance(view, grid.cell);
+        params.adaptiveHitTol = kerr::ADAPTIVE_HIT_TOLERANCE;
+    }
+    GLuint paramsBuffer;
+    glGenBuffers(1, &paramsBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, paramsBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(params), nullptr, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, kerr::SHADER_PARAMS_BINDING, paramsBuffer);
+    glUseProgram(program);
+
+    FrameWriter writer(cfg, (size_t)cfg.ring * 2);
+    if (!writer.start()) return 1;
+
+    std::cerr << "Rendering frames " << cfg.firstFrame << ".." << cfg.firstFrame + cfg.frames - 1
+              << " at " << W << "x" << H << ", ring of " << cfg.ring << " PBOs" << std::endl;
+
+    double fenceWait = 0.0, convertTime = 0.0;
+    uint64_t acceptedSteps = 0, tracedRays = 0, skippedRays = 0;   // over all retired frames
+    bool ok = true;
+
+    // Maps the slot's PBO once its fence has signalled, converts it and
+    // hands the frame to the writer
+    auto retire = [&](int slot) {
+        auto start = std::chrono::steady_clock::now();
+        glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(fences[slot]);
+        fences[slot] = nullptr;
+        auto mapped = std::chrono::steady_clock::now();
+
+        OutputFrame frame = writer.acquire();
+        frame.number = slotFrame[slot];
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[slot]);
+        const float* texels = (const float*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)frameBytes,
+                                                             GL_MAP_READ_BIT);
+        if (!texels) {
+            std::cerr << "Failed to map the readback buffer of frame " << frame.number << std::endl;
+            ok = false;
+            return;
+        }
+        convertFrame(texels, W, H, cfg.format, frame.bytes);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        writer.submit(std::move(frame));
+
+        kerr::StepStats stats;
+        glBindBuffer(GL_COPY_READ_BUFFER, statsCopies[slot]);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(stats), &stats);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        acceptedSteps += stats.acceptedSteps;
+        tracedRays += stats.tracedRays;
+        skippedRays += stats.skippedRays;
+        slotFrame[slot] = -1;
+
+        auto end = std::chrono::steady_clock::now();
+        fenceWait += std::chrono::duration<double>(mapped - start).count();
+        convertTime += std::chrono::duration<double>(end - mapped).count();
+    };
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < cfg.frames && ok && !writer.hasFailed(); ++i) {
+        int slot = i % cfg.ring;
+        if (slotFrame[slot] >= 0) retire(slot);
+        if (!ok) break;
+
+        int frame = cfg.firstFrame + i;
+        Keyframe scene = sceneAt(keys, cfg.scene, (float)frame);
+        params.time = (float)frame / cfg.fps;
+        params.spinParameter = scene.spin;
+        params.inclination = scene.inclination;
+        params.cameraDistance = scene.cameraDistance;
+        params.exposure = scene.exposure;
+        // Skipping is exact only when rays trace enough bounces to reach the
+        // disk behind the shadow edge
+        if (cfg.shadowSkip && cfg.maxBounces >= kerr::SHADOW_MIN_BOUNCES) {
+            kerr::RenderParams view;
+            view.width = W;
+            view.height = H;
+            view.time = params.time;
+            view.inclination = scene.inclination;
+            view.cameraDistance = scene.cameraDistance;
+            kerr::ShadowOutline shadow = kerr::shadowOutline(kerr::makeCamera(view), scene.spin);
+            params.shadowSkip = shadow.valid ? 1 : 0;
+            params.shadowCenter[0] = shadow.centerX;
+            params.shadowCenter[1] = shadow.centerY;
+            params.shadowMargin = cfg.shadowMargin;
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, shadowBuffer);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(shadow.radius), shadow.radius);
+        }
+        if (cfg.emissionLut) emission.bind();
+        if (cfg.skyCubemap) sky.bind();
+        if (aovTexture) {
+            glClearTexImage(aovTexture, 0, GL_RGBA, GL_FLOAT, nullptr);
+            glBindImageTexture(kerr::AOV_IMAGE_UNIT, aovTexture, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, stepStatsBuffer);
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+        glBindBuffer(GL_UNIFORM_BUFFER, paramsBuffer);
+        if (cfg.adaptive) {
+            params.adaptivePass = 1;  // ADAPTIVE_GRID
+            glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(params), &params);
+            glDispatchCompute((grid.pointsX + 15) / 16, (grid.pointsY + 15) / 16, 1);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+            params.adaptivePass = 2;  // ADAPTIVE_FILL
+        }
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(params), &params);
+        glDispatchCompute((W + 15) / 16, (H + 15) / 16, 1);
+        glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+        glBindBuffer(GL_COPY_READ_BUFFER, stepStatsBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, statsCopies[slot]);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(kerr::StepStats));
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        if (aovTexture) {
+            glBindTexture(GL_TEXTURE_2D_ARRAY, aovTexture);
+            glGetTexImage(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, GL_FLOAT, aov.texels.data());
+            std::string prefix = cfg.frames > 1 ? kerr::framePath(cfg.aovPrefix, frame) : cfg.aovPrefix;
+            if (!kerr::writeAovImages(prefix, aov)) {
+                ok = false;
+                break;
+            }
+            if (cfg.frames == 1) kerr::printAovSummary(std::cerr, aov);
+        }
+        if (bloomProgram) {
+            bloom.apply(outputTexture, cfg.bloomStrength, true);
+            glUseProgram(program);
+        }
+
+        // Asynchronous copy into the slot's PBO; the fence marks its completion
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[slot]);
+        glBindTexture(GL_TEXTURE_2D, outputTexture);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slotFrame[slot] = frame;
+        glFlush();
+    }
+
+    // Drain the ring in frame order
+    for (int i = 0; i < cfg.ring && ok; ++i) {
+        int slot = (cfg.frames + i) % cfg.ring;
+        if (slotFrame[slot] >= 0) retire(slot);
+    }
+    for (GLsync fence : fences) {
+        if (fence) glDeleteSync(fence);
+    }
+
+    ok = writer.finish() && ok;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cerr << "Frames: " << cfg.frames << " in " << seconds << " s (" << cfg.frames / seconds << " fps)\n"
+              << "Render thread: " << fenceWait << " s waiting on fences, " << convertTime << " s converting\n"
+              << "Writer thread: " << writer.busySeconds() << " s writing" << std::endl;
+    if (cfg.adaptive || cfg.shadowSkip || cfg.farFieldRadius > 0.0f) {
+        double pixels = (double)W * H * cfg.frames;
+        uint64_t traced = tracedRays - std::min(skippedRays, tracedRays);
+        if (cfg.shadowSkip) {
+            std::cerr << "Shadow: skipped " << skippedRays << " pixels (" << 100.0 * (double)skippedRays / pixels
+                      << "%)";
+            if (cfg.maxBounces < kerr::SHADOW_MIN_BOUNCES) {
+                std::cerr << ", needs --bounces " << kerr::SHADOW_MIN_BOUNCES << " or more";
+            }
+            std::cerr << std::endl;
+        }
+        std::cerr << "Traced " << traced << " of " << (uint64_t)pixels << " pixels ("
+                  << pixels / (double)std::max<uint64_t>(traced, 1) << "x fewer), "
+                  << (double)acceptedSteps / (double)std::max<uint64_t>(traced, 1) << " steps per traced pixel"
+                  << std::endl;
+    }
+
+    glDeleteBuffers(cfg.ring, pbos.data());
+    glDeleteBuffers(cfg.ring, statsCopies.data());
+    glDeleteBuffers(1, &stepStatsBuffer);
+    glDeleteBuffers(1, &paramsBuffer);
+    if (coarseSamplesBuffer) glDeleteBuffers(1, &coarseSamplesBuffer);
+    if (shadowBuffer) glDeleteBuffers(1, &shadowBuffer);
+    if (aovTexture) glDeleteTextures(1, &aovTexture);
+    bloom.destroy();
+    emission.destroy();
+    sky.destroy();
+    if (bloomProgram) glDeleteProgram(bloomProgram);
+    glDeleteTextures(1, &outputTexture);
+    glDeleteProgram(program);
+
+    if (!ok) {
+        std::cerr << "Output incomplete" << std::endl;
+        return 1;
+    }
+    if (cfg.format == OutputFormat::Y4M) {
+        std::cerr << "Done! Output written to " << (cfg.output == "-" ? "stdout" : cfg.output) << std::endl;
+    } else {
+        std::cerr << "Done! Frames saved to " << kerr::framePath(cfg.output, cfg.firstFrame) << " ... "
+                  << kerr::framePath(cfg.output, cfg.firstFrame + cfg.frames - 1) << std::endl;
+    }
+    return 0;
+}
@@ -12,6 +12,9 @@
 
 #include <SDL2/SDL.h>
 #include <GL/glew.h>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -19,11 +22,67 @@
 #include <cmath>
 #include <algorithm>
 
+#include "adaptive_sampling.h"
+#include "bloom.h"
+#include "emission_lut.h"
+#include "frame_timing.h"
+#include "kerr_shadow.h"
+#include "lensing_atlas.h"
+#include "lensing_cache.h"
+#include "quality_governor.h"
+#include "aov.h"
+#include "shader_params.h"
+#include "shader_variants.h"
+#include "sky_cubemap.h"
+
 // Configuration
 const int WINDOW_WIDTH = 1920;
 const int WINDOW_HEIGHT = 1080;
 const char* WINDOW_TITLE = "Kerr Black Hole v2.0 - Enhanced Ray Tracing";
 
+// Lensing map modes and layer count (1 + MAX_BOUNCES) of blackhole_improved.comp
+const int LENSING_OFF = 0;
+const int LENSING_BUILD = 1;
+const int LENSING_CACHED = 2;
+const int LENSING_ATLAS = 3;
+const int LENSING_MAP_LAYERS = 4;
+
+// Progressive refinement: while parameters change, one pixel in
+// INTERACTIVE_STRIDE^2 is traced and upscaled. Once they have been still
+// for SETTLE_MS, the image is refined pass by pass to full resolution and
+// then to ACCUMULATION_SAMPLES jittered samples per pixel.
+const int INTERACTIVE_STRIDE = 4;
+const Uint32 SETTLE_MS = 250;
+const int ACCUMULATION_SAMPLES = 16;
+
+// Edge-adaptive tracing passes of blackhole_improved.comp (adaptive_sampling.h)
+const int ADAPTIVE_GRID = 1;
+const int ADAPTIVE_FILL = 2;
+
+// Traced lensing maps are kept on disk across runs (lensing_cache.h)
+const char* LENSING_CACHE_DIR = "lensing_cache";
+const uint64_t LENSING_CACHE_MAX_BYTES = 2048ull << 20;
+
+// Lensing atlas (lensing_atlas.h) built by kerr_cpu --build-atlas, shown
+// while a parameter is being changed
+const char* LENSING_ATLAS_DIR = "lensing_atlas";
+
+// Linked compute programs are kept on disk across runs (shader_variants.h)
+const char* PROGRAM_CACHE_DIR = "program_cache";
+
+// Timed GPU passes and CPU stages of a frame (frame_timing.h). update covers
+// everything between input and the dispatch: shader variant, shadow
+// outline, lensing map and parameter uploads.
+const int GPU_COMPUTE = 0;
+const int GPU_BLOOM = 1;
+const int GPU_DISPLAY = 2;
+const std::vector<std::string> GPU_PASS_NAMES = {"compute", "bloom", "display"};
+const int CPU_INPUT = 0;
+const int CPU_UPDATE = 1;
+const int CPU_SWAP = 2;
+const int CPU_FRAME = 3;
+const std::vector<std::string> CPU_STAGE_NAMES = {"input", "update", "swap", "frame"};
+
 // Enhanced global state
 struct AppState {
     float time = 0.0f;
@@ -32,13 +91,91 @@ struct AppState {
     float inclination = 85.0f;
     float cameraDistance = 25.0f;
     int maxBounces = 3;
+    int integrator = 0;           // 0 = affine RK5, 1 = Mino time with E, Lz, Q
+    float relTolPos = 1e-4f;      // step controller tolerances
+    float absTolPos = 1e-5f;
+    float relTolMom = 1e-4f;
+    float absTolMom = 1e-5f;
+    float toleranceScale = 1.0f;  // multiplies all four tolerances
+    bool lensingCache = false;    // shade animation frames from a cached lensing map
+    bool atlas = false;           // interactive frames from the lensing atlas instead of tracing
+    std::string atlasDir = LENSING_ATLAS_DIR;
+    bool progressive = true;      // reduced resolution while interacting, refine when still
+    bool adaptive = false;        // trace a coarse grid and interpolate smooth cells
+    bool shadowSkip = true;       // leave pixels inside the analytic shadow black untraced
+    bool farField = false;        // integrate only inside FAR_FIELD_RADIUS, analytic outside
+    bool emissionLut = false;     // disk emission from blackbody and disk structure tables
+    bool skyCubemap = false;      // starfield from a cube map baked on first use
+    std::string starCatalog;      // its stars, "" = synthetic
     float bloomStrength = 0.5f;
     bool enableBloom = true;
+    bool vsync = true;            // off for measuring frame times above the refresh rate
+    bool showTiming = false;      // print the timing summary every second
+    bool governor = false;        // hold the GPU frame time of the animation near governorTargetMs
+    float governorTargetMs = 16.6f;
+    int aovView = 0;              // 0 = image, 1 + the AOV channel shown instead (aov.h)
     bool paused = false;
     bool running = true;
     bool showHelp = false;
 } state;
 
+// Parameters the lensing map is traced with; any change retraces or loads
+// another map from the disk cache. The shader records the hits of its
+// variant's bounce count and uses a 45 degree field of view.
+kerr::LensingMapKey currentLensingKey() {
+    kerr::LensingMapKey key;
+    key.width = WINDOW_WIDTH;
+    key.height = WINDOW_HEIGHT;
+    key.spin = state.spinParameter;
+    key.inclination = state.inclination;
+    key.cameraDistance = state.cameraDistance;
+    key.fov = 45.0f;
+    key.maxBounces = std::min(state.maxBounces, LENSING_MAP_LAYERS - 1);
+    key.integrator = state.integrator ? kerr::Integrator::Mino : kerr::Integrator::Affine;
+    key.tolerances.relPos = state.relTolPos * state.toleranceScale;
+    key.tolerances.absPos = state.absTolPos * state.toleranceScale;
+    key.tolerances.relMom = state.relTolMom * state.toleranceScale;
+    key.tolerances.absMom = state.absTolMom * state.toleranceScale;
+    key.farFieldRadius = state.farField ? kerr::FAR_FIELD_RADIUS : 0.0f;
+    return key;
+}
+
+// Compute shader variant for the current state: bounces and integrator are
+// compiled in, as is the choice of emission model; everything toggled per
+// frame stays selectable by uniforms
+kerr::ShaderVariant currentShaderVariant() {
+    kerr::ShaderVariant v;
+    v.maxBounces = std::min(state.maxBounces, kerr::SHADER_MAX_BOUNCES);
+    v.integrator = state.integrator;
+    v.emissionLut = state.emissionLut;
+    v.skyCubemap = state.skyCubemap;
+    v.aov = state.aovView > 0;
+    return v;
+}
+
+// Shader parameter block for the current state. Time only enters it while
+// the animation runs, so a paused view produces the same block every frame.
+kerr::ShaderParams currentShaderParams() {
+    kerr::ShaderParams p;
+    p.resolution[0] = (float)WINDOW_WIDTH;
+    p.resolution[1] = (float)WINDOW_HEIGHT;
+    p.time = state.time;
+    p.spinParameter = state.spinParameter;
+    p.exposure = state.exposure;
+    p.inclination = state.inclination;
+    p.cameraDistance = state.cameraDistance;
+    p.bloomStrength = state.enableBloom ? state.bloomStrength : 0.0f;
+    p.maxBounces = state.maxBounces;
+    p.integrator = state.integrator;
+    p.relTolPos = state.relTolPos * state.toleranceScale;
+    p.absTolPos = state.absTolPos * state.toleranceScale;
+    p.relTolMom = state.relTolMom * state.toleranceScale;
+    p.absTolMom = state.absTolMom * state.toleranceScale;
+    p.farFieldRadius = state.farField ? kerr::FAR_FIELD_RADIUS : 0.0f;
+    p.aovView = state.aovView;
+    return p;
+}
+
 // Shader utility functions
 std::string loadShaderSource(const char* filepath) {
     std::ifstream file(filepath);
@@ -92,27 +229,6 @@ GLuint createShaderProgram(const char* vertSource, const char* fragSource) {
     return program;
 }
 
-GLuint createComputeShader(const char* source) {
-    GLuint shader = compileShader(GL_COMPUTE_SHADER, source);
-    if (shader == 0) return 0;
-    
-    GLuint program = glCreateProgram();
-    glAttachShader(program, shader);
-    glLinkProgram(program);
-    
-    GLint success;
-    glGetProgramiv(program, GL_LINK_STATUS, &success);
-    if (!success) {
-        char infoLog[2048];
-        glGetProgramInfoLog(program, 2048, nullptr, infoLog);
-        std::cerr << "Compute shader linking error:\n" << infoLog << std::endl;
-        return 0;
-    }
-    
-    glDeleteShader(shader);
-    return program;
-}
-
 // Create fullscreen quad
 GLuint createFullscreenQuad() {
     float vertices[] = {
@@ -177,6 +293,20 @@ void handleInput(SDL_Event& event) {
                               << "1/2:     Ray bounces ±\n"
                               << "3/4:     Bloom strength ±\n"
                               << "B:       Toggle bloom\n"
+                              << "I:       Toggle integrator (affine / Mino)\n"
+                              << "5/6:     Step tolerance tighter/looser\n"
+                              << "L:       Toggle cached lensing map\n"
+                              << "P:       Toggle progressive refinement\n"
+                              << "G:       Toggle edge-adaptive tracing\n"
+                              << "C:       Toggle skipping captured rays in the shadow\n"
+                              << "F:       Toggle analytic far field outside r = 30\n"
+                              << "K:       Toggle tabulated disk emission\n"
+                              << "M:       Toggle the baked sky cube map\n"
+                              << "X:       Toggle the lensing atlas while changing parameters\n"
+                              << "O:       Toggle the frame-time governor (animation only)\n"
+                              << "N:       Cycle the diagnostic views (steps, termination, error...)\n"
+                              << "V:       Toggle vsync\n"
+                              << "T:       Toggle the per-second timing summary\n"
                               << "R:       Reset to defaults\n"
                               << "=======================\n" << std::endl;
                 }
@@ -218,7 +348,7 @@ void handleInput(SDL_Event& event) {
                 std::cout << "Max bounces: " << state.maxBounces << std::endl;
                 break;
             case SDLK_2:
-                state.maxBounces = std::min(5, state.maxBounces + 1);
+                state.maxBounces = std::min(kerr::SHADER_MAX_BOUNCES, state.maxBounces + 1);
                 std::cout << "Max bounces: " << state.maxBounces << std::endl;
                 break;
             case SDLK_3:
@@ -233,6 +363,71 @@ void handleInput(SDL_Event& event) {
                 state.enableBloom = !state.enableBloom;
                 std::cout << "Bloom " << (state.enableBloom ? "enabled" : "disabled") << std::endl;
                 break;
+            case SDLK_v:
+                state.vsync = !state.vsync;
+                if (SDL_GL_SetSwapInterval(state.vsync ? 1 : 0) != 0) {
+                    std::cerr << "Swap interval not supported: " << SDL_GetError() << std::endl;
+                }
+                std::cout << "VSync " << (state.vsync ? "on" : "off") << std::endl;
+                break;
+            case SDLK_t:
+                state.showTiming = !state.showTiming;
+                std::cout << "Timing summary " << (state.showTiming ? "on" : "off") << std::endl;
+                break;
+            case SDLK_i:
+                state.integrator = 1 - state.integrator;
+                std::cout << "Integrator: " << (state.integrator ? "Mino (E, Lz, Q)" : "affine") << std::endl;
+                break;
+            case SDLK_5:
+                state.toleranceScale = std::max(0.01f, state.toleranceScale * 0.5f);
+                std::cout << "Tolerance scale: " << state.toleranceScale << std::endl;
+                break;
+            case SDLK_6:
+                state.toleranceScale = std::min(100.0f, state.toleranceScale * 2.0f);
+                std::cout << "Tolerance scale: " << state.toleranceScale << std::endl;
+                break;
+            case SDLK_l:
+                state.lensingCache = !state.lensingCache;
+                std::cout << "Lensing map cache " << (state.lensingCache ? "enabled" : "disabled") << std::endl;
+                break;
+            case SDLK_p:
+                state.progressive = !state.progressive;
+                std::cout << "Progressive refinement " << (state.progressive ? "enabled" : "disabled") << std::endl;
+                break;
+            case SDLK_g:
+                state.adaptive = !state.adaptive;
+                std::cout << "Edge-adaptive tracing " << (state.adaptive ? "enabled" : "disabled") << std::endl;
+                break;
+            case SDLK_c:
+                state.shadowSkip = !state.shadowSkip;
+                std::cout << "Shadow skip " << (state.shadowSkip ? "enabled" : "disabled") << std::endl;
+                break;
+            case SDLK_f:
+                state.farField = !state.farField;
+                std::cout << "Far field " << (state.farField ? "enabled" : "disabled") << std::endl;
+                break;
+            case SDLK_k:
+                state.emissionLut = !state.emissionLut;
+                std::cout << "Disk emission: " << (state.emissionLut ? "tables" : "analytic") << std::endl;
+                break;
+            case SDLK_m:
+                state.skyCubemap = !state.skyCubemap;
+                std::cout << "Sky: " << (state.skyCubemap ? "baked cube map" : "procedural") << std::endl;
+                break;
+            case SDLK_x:
+                state.atlas = !state.atlas;
+                std::cout << "Lensing atlas " << (state.atlas ? "enabled" : "disabled") << std::endl;
+                break;
+            case SDLK_o:
+                state.governor = !state.governor;
+                std::cout << "Frame-time governor " << (state.governor ? "enabled" : "disabled") << ", target "
+                          << state.governorTargetMs << " ms" << std::endl;
+                break;
+            case SDLK_n:
+                state.aovView = (state.aovView + 1) % (kerr::AOV_CHANNEL_COUNT + 1);
+                std::cout << "View: " << (state.aovView ? kerr::AOV_CHANNELS[state.aovView - 1].name : "image")
+                          << std::endl;
+                break;
             case SDLK_r:
                 state.spinParameter = 0.9f;
                 state.exposure = 1.2f;
@@ -240,6 +435,7 @@ void handleInput(SDL_Event& event) {
                 state.cameraDistance = 25.0f;
                 state.maxBounces = 3;
                 state.bloomStrength = 0.5f;
+                state.toleranceScale = 1.0f;
                 std::cout << "Reset to defaults" << std::endl;
                 break;
         }
@@ -259,6 +455,28 @@ void printSystemInfo() {
 }
 
 int main(int argc, char* argv[]) {
+    std::string telemetryPath;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--no-vsync") == 0) {
+            state.vsync = false;
+        } else if (std::strcmp(argv[i], "--telemetry") == 0 && i + 1 < argc) {
+            telemetryPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--star-catalog") == 0 && i + 1 < argc) {
+            state.starCatalog = argv[++i];
+            state.skyCubemap = true;
+        } else if (std::strcmp(argv[i], "--atlas") == 0 && i + 1 < argc) {
+            state.atlasDir = argv[++i];
+            state.atlas = true;
+        } else if (std::strcmp(argv[i], "--target-ms") == 0 && i + 1 < argc) {
+            state.governorTargetMs = std::max(1.0f, (float)std::atof(argv[++i]));
+            state.governor = true;
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--no-vsync] [--telemetry FILE.csv|FILE.json] [--star-catalog FILE]"
+                      << " [--atlas DIR] [--target-ms MS]" << std::endl;
+            return std::strcmp(argv[i], "--help") == 0 ? 0 : -1;
+        }
+    }
+    
     // Initialize SDL
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
         std::cerr << "SDL init failed: " << SDL_GetError() << std::endl;
@@ -293,7 +511,7 @@ int main(int argc, char* argv[]) {
         return -1;
     }
     
-    SDL_GL_SetSwapInterval(1); // VSync
+    SDL_GL_SetSwapInterval(state.vsync ? 1 : 0); // VSync
     
     glewExperimental = GL_TRUE;
     GLenum glewError = glewInit();
@@ -314,16 +532,21 @@ int main(int argc, char* argv[]) {
     }
     
     // Load shaders - try improved version first, fallback to original
-    std::string compSource = loadShaderSource("blackhole_improved.comp");
+    const char* compName = "blackhole_improved.comp";
+    std::string compSource = loadShaderSource(compName);
     if (compSource.empty()) {
         std::cout << "Loading original shader..." << std::endl;
-        compSource = loadShaderSource("blackhole.comp");
+        compName = "blackhole.comp";
+        compSource = loadShaderSource(compName);
     } else {
         std::cout << "Loaded improved shader!" << std::endl;
     }
     
     std::string vertSource = loadShaderSource("shader.vert");
-    std::string fragSource = loadShaderSource("shader.frag");
+    std::string fragSource = loadShaderSource("shader_improved.frag");
+    if (fragSource.empty()) {
+        fragSource = loadShaderSource("shader.frag");
+    }
     
     if (vertSource.empty() || fragSource.empty() || compSource.empty()) {
         std::cerr << "Failed to load shaders" << std::endl;
@@ -334,7 +557,12 @@ int main(int argc, char* argv[]) {
     }
     
     GLuint displayProgram = createShaderProgram(vertSource.c_str(), fragSource.c_str());
-    GLuint computeProgram = createComputeShader(compSource.c_str());
+    
+    // The compute program is a variant of its shader (shader_variants.h),
+    // rebuilt or loaded from the program cache when bounces or integrator change
+    kerr::ProgramCache programCache(PROGRAM_CACHE_DIR);
+    kerr::ShaderVariant programVariant = currentShaderVariant();
+    GLuint computeProgram = kerr::buildComputeProgram(compName, compSource, programVariant, &programCache);
     
     if (!displayProgram || !computeProgram) {
         std::cerr << "Shader compilation failed" << std::endl;
@@ -355,29 +583,173 @@ int main(int argc, char* argv[]) {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, WINDOW_WIDTH, WINDOW_HEIGHT, 
                  0, GL_RGBA, GL_FLOAT, nullptr);
-    glBindImageTexture(0, outputTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+    glBindImageTexture(0, outputTexture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
     
-    // Create bloom buffer
-    GLuint bloomTexture;
-    glGenTextures(1, &bloomTexture);
-    glBindTexture(GL_TEXTURE_2D, bloomTexture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, WINDOW_WIDTH, WINDOW_HEIGHT, 
+    // Bloom chain (bloom.h): half, quarter and eighth size levels built
+    // from each new image; the display pass adds the half-size one
+    kerr::BloomChain bloom;
+    GLuint bloomProgram = 0;
+    std::string bloomSource = loadShaderSource("bloom.comp");
+    if (!bloomSource.empty()) {
+        bloomProgram = kerr::buildComputeProgram("bloom.comp", bloomSource, kerr::ShaderVariant(), &programCache);
+    }
+    if (!bloomProgram || !bloom.create(bloomProgram, WINDOW_WIDTH, WINDOW_HEIGHT)) {
+        std::cerr << "Bloom disabled" << std::endl;
+    }
+    
+    // Blackbody and disk structure tables (emission_lut.h) for the
+    // KERR_EMISSION_LUT variant; the disk structure follows the variant's
+    // disk detail and is rebuilt only when that changes
+    kerr::EmissionTextures emission;
+    if (!emission.create()) {
+        std::cerr << "Tabulated disk emission unavailable" << std::endl;
+    }
+    
+    // Sky cube map (sky_cubemap.h), baked the first time the variant is used
+    kerr::SkyCubemap sky;
+    
+    // Cached lensing map: per-pixel ray geometry, one layer per disk hit
+    GLuint lensingMapTexture;
+    glGenTextures(1, &lensingMapTexture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, lensingMapTexture);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA32F, WINDOW_WIDTH, WINDOW_HEIGHT, LENSING_MAP_LAYERS,
+                 0, GL_RGBA, GL_FLOAT, nullptr);
+    glBindImageTexture(3, lensingMapTexture, 0, GL_TRUE, 0, GL_READ_WRITE, GL_RGBA32F);
+    bool lensingMapValid = false;
+    kerr::LensingMapKey lensingMapKey;
+    float lensingMapOrbitAngle = 0.0f;
+    kerr::LensingCache lensingDiskCache(LENSING_CACHE_DIR, LENSING_CACHE_MAX_BYTES);
+    
+    // Lensing atlas, mapped once; interactive frames interpolate it into the
+    // corner of the lensing map texture, one texel per pixelStride block
+    kerr::LensingAtlas lensingAtlas;
+    if (lensingAtlas.open(state.atlasDir)) {
+        std::cout << "Lensing atlas: " << state.atlasDir << ", " << lensingAtlas.entryCount() << " of "
+                  << lensingAtlas.layout().entries() << " grid points" << std::endl;
+    } else if (state.atlas) {
+        std::cerr << "No lensing atlas in " << state.atlasDir << " (build one with kerr_cpu --build-atlas "
+                  << state.atlasDir << ")" << std::endl;
+    }
+    std::vector<float> atlasTexels;
+    
+    // Diagnostic images (aov.h) of the KERR_AOV variant, shown by the
+    // display pass instead of the image
+    GLuint aovTexture;
+    glGenTextures(1, &aovTexture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, aovTexture);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA32F, WINDOW_WIDTH, WINDOW_HEIGHT, kerr::AOV_LAYERS,
                  0, GL_RGBA, GL_FLOAT, nullptr);
-    glBindImageTexture(1, bloomTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+    kerr::LensingMapKey atlasKey;
+    bool atlasUploaded = false;
+    
+    // Step statistics written by the compute shader: accepted, rejected,
+    // shaded pixels and skipped pixels
+    GLuint stepStatsBuffer;
+    glGenBuffers(1, &stepStatsBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, stepStatsBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(kerr::StepStats), nullptr, GL_DYNAMIC_READ);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kerr::STEP_STATS_BINDING, stepStatsBuffer);
+    
+    // Radius table of the shadow outline, recomputed with every frame
+    GLuint shadowBuffer;
+    glGenBuffers(1, &shadowBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, shadowBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, kerr::SHADOW_OUTLINE_BINS * sizeof(float), nullptr, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kerr::SHADOW_OUTLINE_BINDING, shadowBuffer);
+    
+    // Lensing samples of the adaptive grid points, in the lensing map layout
+    kerr::AdaptiveGrid adaptiveGrid(WINDOW_WIDTH, WINDOW_HEIGHT);
+    kerr::RenderParams adaptiveView;
+    adaptiveView.height = WINDOW_HEIGHT;
+    float adaptiveEscapeTol = kerr::adaptiveEscapeTolerance(adaptiveView, adaptiveGrid.cell);
+    GLuint coarseSamplesBuffer;
+    glGenBuffers(1, &coarseSamplesBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, coarseSamplesBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)adaptiveGrid.points() * LENSING_MAP_LAYERS * 4 * sizeof(float),
+                 nullptr, GL_DYNAMIC_COPY);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, coarseSamplesBuffer);
+    
+    // Parameter block shared by the compute and display shaders; it is only
+    // re-uploaded, and the frame only re-rendered, when it changes
+    GLuint paramsBuffer;
+    glGenBuffers(1, &paramsBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, paramsBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(kerr::ShaderParams), nullptr, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, kerr::SHADER_PARAMS_BINDING, paramsBuffer);
+    kerr::ShaderParams uploadedParams;
+    bool imageValid = false;
+    
+    // The original blackhole.comp has no parameter block and takes its scene
+    // as plain uniforms; their locations are looked up once
+    bool legacyUniforms = glGetUniformBlockIndex(computeProgram, "KerrParams") == GL_INVALID_INDEX;
+    GLint legacyTime = glGetUniformLocation(computeProgram, "uTime");
+    GLint legacySpin = glGetUniformLocation(computeProgram, "uSpinParameter");
+    GLint legacyExposure = glGetUniformLocation(computeProgram, "uExposure");
+    GLint legacyInclination = glGetUniformLocation(computeProgram, "uInclination");
+    GLint legacyDistance = glGetUniformLocation(computeProgram, "uCameraDistance");
+    GLint legacyResolution = glGetUniformLocation(computeProgram, "uResolution");
     
     GLuint quadVAO = createFullscreenQuad();
     
     glUseProgram(displayProgram);
     glUniform1i(glGetUniformLocation(displayProgram, "screenTexture"), 0);
+    glUniform1i(glGetUniformLocation(displayProgram, "bloomTexture"), kerr::BLOOM_DISPLAY_UNIT);
+    glUniform1i(glGetUniformLocation(displayProgram, "aovTexture"), kerr::AOV_DISPLAY_UNIT);
+    
+    // Frame timing: GPU passes are read back GPU_TIMER_FRAMES frames later,
+    // when their record is completed and logged
+    kerr::GpuPassTimer gpuTimer;
+    gpuTimer.create(GPU_PASS_NAMES);
+    kerr::FrameRecord frameRecords[kerr::GPU_TIMER_FRAMES];
+    kerr::TimingSummary timingSummary(CPU_STAGE_NAMES, GPU_PASS_NAMES);
+    kerr::TelemetryLog telemetry;
+    if (!telemetryPath.empty() && telemetry.open(telemetryPath, CPU_STAGE_NAMES, GPU_PASS_NAMES)) {
+        std::cout << "Telemetry: " << telemetryPath << std::endl;
+    }
+    // Frame-time governor (quality_governor.h): each completed frame that
+    // was rendered at a governed level feeds its summed GPU time back
+    kerr::GovernorSettings governorSettings;
+    kerr::QualityGovernor governor;
+    bool governorActive = false;
+    std::vector<double> gpuSecondMs(GPU_PASS_NAMES.size(), 0.0);   // GPU time of the last second
+    std::vector<int> gpuSecondFrames(GPU_PASS_NAMES.size(), 0);
+    auto startClock = std::chrono::steady_clock::now();
+    uint64_t framesDrawn = 0;
+    auto completeFrame = [&](kerr::FrameRecord& record, const std::vector<double>& gpuMs) {
+        record.gpuMs = gpuMs;
+        for (size_t p = 0; p < gpuMs.size(); ++p) {
+            if (gpuMs[p] < 0.0) continue;
+            gpuSecondMs[p] += gpuMs[p];
+            gpuSecondFrames[p]++;
+        }
+        if (record.rendered && record.quality >= 0) {
+            double frameMs = 0.0;
+            for (double ms : gpuMs) frameMs += std::max(ms, 0.0);
+            if (governor.update(frameMs, record.quality)) {
+                std::cout << "Quality " << governor.describe() << " (GPU " << frameMs << " ms, target "
+                          << governor.targetMs() << " ms)" << std::endl;
+            }
+        }
+        timingSummary.add(record);
+        telemetry.write(record);
+    };
     
     // Main loop
     Uint32 lastTime = SDL_GetTicks();
     int frameCount = 0;
     float fpsTimer = 0.0f;
+    bool idle = false;          // last iteration neither rendered nor presented
+    bool present = true;        // the window needs the last image drawn again
+    
+    // Progressive refinement needs the uPixelStride support of the block
+    // shaders; the input watched for it is the parameter block without time
+    kerr::ShaderParams lastInput = currentShaderParams();
+    lastInput.time = 0.0f;
+    Uint32 lastInputTicks = lastTime - SETTLE_MS;
     
     std::cout << "\n=== CONTROLS ===\n"
               << "Press H for help\n"
@@ -393,54 +765,385 @@ int main(int argc, char* argv[]) {
             state.time += deltaTime;
         }
         
-        frameCount++;
         fpsTimer += deltaTime;
         if (fpsTimer >= 1.0f) {
-            float fps = frameCount / fpsTimer;
-            std::cout << "FPS: " << (int)fps 
-                      << " | Time: " << state.time 
-                      << "s | Spin: " << state.spinParameter 
-                      << " | Incl: " << state.inclination << "°"
-                      << " | Bounces: " << state.maxBounces << std::endl;
+            // An idle view renders nothing and reports nothing
+            if (frameCount > 0) {
+                float fps = frameCount / fpsTimer;
+                
+                // Counts of the previous frame; reading them waits for that dispatch
+                kerr::StepStats stepStats;
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, stepStatsBuffer);
+                glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(stepStats), &stepStats);
+                float rays = (float)std::max(stepStats.tracedRays - stepStats.skippedRays, 1u);
+                
+                std::cout << "FPS: " << (int)fps 
+                          << " | Time: " << state.time 
+                          << "s | Spin: " << state.spinParameter 
+                          << " | Incl: " << state.inclination << "°"
+                          << " | Bounces: " << state.maxBounces
+                          << " | " << (state.integrator ? "Mino" : "Affine")
+                          << (state.lensingCache ? " (cached)" : "")
+                          << " | Steps/ray: " << stepStats.acceptedSteps / rays << " acc, "
+                          << stepStats.rejectedSteps / rays << " rej";
+                if (uploadedParams.shadowSkip) {
+                    std::cout << " | Shadow: " << stepStats.skippedRays << " skipped";
+                }
+                if (uploadedParams.adaptivePass == ADAPTIVE_FILL) {
+                    std::cout << " | Traced: " << (int)(100.0f * (stepStats.tracedRays - stepStats.skippedRays) / (WINDOW_WIDTH * WINDOW_HEIGHT))
+                              << "%";
+                }
+                // Mean GPU time of the passes, which vsync does not cap
+                std::cout << " | GPU ms:";
+                for (size_t p = 0; p < GPU_PASS_NAMES.size(); ++p) {
+                    if (gpuSecondFrames[p]) std::cout << " " << GPU_PASS_NAMES[p] << " " << gpuSecondMs[p] / gpuSecondFrames[p];
+                }
+                if (state.governor) std::cout << " | Quality: " << governor.describe();
+                std::cout << std::endl;
+                if (state.showTiming) timingSummary.print(std::cout);
+            }
             frameCount = 0;
             fpsTimer = 0.0f;
+            std::fill(gpuSecondMs.begin(), gpuSecondMs.end(), 0.0);
+            std::fill(gpuSecondFrames.begin(), gpuSecondFrames.end(), 0);
         }
         
+        // While idle, sleep until input arrives instead of spinning; the
+        // timeout keeps the FPS timer ticking
         SDL_Event event;
+        if (idle && SDL_WaitEventTimeout(&event, 100)) {
+            if (event.type == SDL_WINDOWEVENT) present = true;
+            handleInput(event);
+        }
+        auto frameStart = std::chrono::steady_clock::now();   // after any sleep
         while (SDL_PollEvent(&event)) {
+            if (event.type == SDL_WINDOWEVENT) present = true;
             handleInput(event);
         }
+        double inputMs = kerr::msSince(frameStart);
+        auto updateStart = std::chrono::steady_clock::now();
+        double updateMs = -1.0;
+        
+        // Bounces or integrator changed: switch to that variant, or keep the
+        // previous program if it fails to build
+        kerr::ShaderVariant variant = currentShaderVariant();
+        if (variant.skyCubemap && !sky.valid()) {
+            kerr::SkySettings settings;
+            settings.catalog = state.starCatalog;
+            kerr::SkyBakeStats bake;
+            if (sky.bake(settings, &bake)) {
+                std::cout << "Sky baked in " << bake.skySeconds + bake.starSeconds + bake.uploadSeconds << " s ("
+                          << bake.stars << " stars, " << bake.bytes / (1024 * 1024) << " MiB)" << std::endl;
+            } else {
+                state.skyCubemap = variant.skyCubemap = false;
+            }
+        }
+        if (!legacyUniforms && variant != programVariant) {
+            Uint32 buildStart = SDL_GetTicks();
+            bool fromCache = false;
+            GLuint program = kerr::buildComputeProgram(compName, compSource, variant, &programCache, &fromCache);
+            if (program) {
+                glDeleteProgram(computeProgram);
+                computeProgram = program;
+                std::cout << "Shader variant " << (fromCache ? "loaded" : "compiled") << " in "
+                          << SDL_GetTicks() - buildStart << " ms" << std::endl;
+            }
+            programVariant = variant;
+        }
+
+        kerr::ShaderParams params = currentShaderParams();
+        
+        // Shadow outline for this frame's spin and camera. Skipping is exact
+        // only when rays trace at least SHADOW_MIN_BOUNCES bounces; with
+        // fewer, keys 5/6 trace the shadow like any other pixel.
+        kerr::ShadowOutline shadow;
+        if (state.shadowSkip && params.maxBounces >= kerr::SHADOW_MIN_BOUNCES) {
+            kerr::RenderParams view;
+            view.width = WINDOW_WIDTH;
+            view.height = WINDOW_HEIGHT;
+            view.time = state.time;
+            view.inclination = state.inclination;
+            view.cameraDistance = state.cameraDistance;
+            shadow = kerr::shadowOutline(kerr::makeCamera(view), state.spinParameter);
+            params.shadowSkip = shadow.valid ? 1 : 0;
+            params.shadowCenter[0] = shadow.centerX;
+            params.shadowCenter[1] = shadow.centerY;
+        }
+        
+        kerr::ShaderParams input = params;
+        input.time = 0.0f;
+        if (input != lastInput) {
+            lastInput = input;
+            lastInputTicks = currentTime;
+        }
+        bool progressive = state.progressive && !legacyUniforms;
+        bool interacting = progressive && imageValid && currentTime - lastInputTicks < SETTLE_MS;
         
-        // Dispatch compute shader
-        glUseProgram(computeProgram);
-        glUniform1f(glGetUniformLocation(computeProgram, "uTime"), state.time);
-        glUniform1f(glGetUniformLocation(computeProgram, "uSpinParameter"), state.spinParameter);
-        glUniform1f(glGetUniformLocation(computeProgram, "uExposure"), state.exposure);
-        glUniform1f(glGetUniformLocation(computeProgram, "uInclination"), state.inclination);
-        glUniform1f(glGetUniformLocation(computeProgram, "uCameraDistance"), state.cameraDistance);
-        glUniform2f(glGetUniformLocation(computeProgram, "uResolution"), 
-                    (float)WINDOW_WIDTH, (float)WINDOW_HEIGHT);
-        glUniform1i(glGetUniformLocation(computeProgram, "uMaxBounces"), state.maxBounces);
-        glUniform1f(glGetUniformLocation(computeProgram, "uBloomStrength"), 
-                    state.enableBloom ? state.bloomStrength : 0.0f);
+        // The map is traced once per key and then only re-shaded; the camera
+        // azimuth at tracing time is the reference for the phi offset. A map
+        // found in the disk cache is uploaded straight from its file mapping
+        // instead of being traced.
+        // Reduced-resolution frames do not use it, so dragging a parameter
+        // neither traces nor saves a map per intermediate value.
+        int lensingMode = LENSING_OFF;
+        if (state.lensingCache && !interacting) {
+            kerr::LensingMapKey key = currentLensingKey();
+            if (lensingMapValid && key == lensingMapKey) {
+                lensingMode = LENSING_CACHED;
+            } else {
+                lensingMapKey = key;
+                lensingMapValid = true;
+                kerr::LensingMap cached;
+                if (lensingDiskCache.load(key, cached)) {
+                    glBindTexture(GL_TEXTURE_2D_ARRAY, lensingMapTexture);
+                    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT, LENSING_MAP_LAYERS,
+                                    GL_RGBA, GL_FLOAT, cached.texels);
+                    lensingMode = LENSING_CACHED;
+                    lensingMapOrbitAngle = cached.orbitAngle;
+                    std::cout << "Lensing map loaded from " << lensingDiskCache.pathFor(key) << std::endl;
+                } else {
+                    lensingMode = LENSING_BUILD;
+                    lensingMapOrbitAngle = state.time * 0.1f;
+                }
+            }
+        }
+        if (lensingMode != LENSING_OFF) atlasUploaded = false;
         
-        glDispatchCompute((WINDOW_WIDTH + 15) / 16, (WINDOW_HEIGHT + 15) / 16, 1);
-        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+        // While input arrives, the lensing atlas replaces tracing where it
+        // covers the parameters: samples interpolated between its grid
+        // points, one per block of the stride that matches its resolution.
+        // The texture then no longer holds the cached map. Atlas samples are
+        // traced at camera azimuth 0.
+        int atlasStride = 0;
+        if (state.atlas && interacting && lensingAtlas.isOpen()) {
+            const kerr::AtlasGrid& grid = lensingAtlas.layout();
+            int stride = std::max(1, (WINDOW_WIDTH + grid.width - 1) / grid.width);
+            int w = (WINDOW_WIDTH + stride - 1) / stride;
+            int h = (WINDOW_HEIGHT + stride - 1) / stride;
+            kerr::LensingMapKey key = currentLensingKey();
+            if (atlasUploaded && key == atlasKey) {
+                atlasStride = stride;
+            } else if (lensingAtlas.interpolate(state.spinParameter, state.inclination, state.cameraDistance,
+                                                key.maxBounces, w, h, atlasTexels)) {
+                int layers = (int)(atlasTexels.size() / ((size_t)w * h * kerr::LENSING_TEXEL_FLOATS));
+                glBindTexture(GL_TEXTURE_2D_ARRAY, lensingMapTexture);
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, w, h, layers, GL_RGBA, GL_FLOAT, atlasTexels.data());
+                atlasKey = key;
+                atlasUploaded = true;
+                lensingMapValid = false;
+                atlasStride = stride;
+            }
+            if (atlasStride) lensingMode = LENSING_ATLAS;
+        }
+        params.lensingMode = lensingMode;
+        params.lensingOrbitAngle = lensingMode == LENSING_BUILD || lensingMode == LENSING_CACHED
+            ? lensingMapOrbitAngle : 0.0f;
         
-        // Render to screen
+        // Pick the refinement pass. A changed scene starts over at full
+        // resolution, or at INTERACTIVE_STRIDE while input is arriving; an
+        // unchanged one takes the next pass after the image on screen: halve
+        // the stride, then add jittered samples. Cached lensing samples are
+        // fixed at pixel centres, so they are not accumulated.
+        if (interacting) {
+            params.pixelStride = atlasStride ? atlasStride : INTERACTIVE_STRIDE;
+        } else if (progressive && imageValid && params.scene() == uploadedParams.scene()) {
+            if (uploadedParams.pixelStride > 1) {
+                params.pixelStride = uploadedParams.pixelStride / 2;
+                params.filledStride = uploadedParams.pixelStride;
+            } else if (lensingMode == LENSING_OFF && uploadedParams.sampleIndex + 1 < ACCUMULATION_SAMPLES) {
+                params.sampleIndex = uploadedParams.sampleIndex + 1;
+            } else {
+                params = uploadedParams;
+            }
+        }
+        
+        // The governor trades quality for GPU time only while the animation
+        // runs and every frame is traced anew; paused views refine as usual.
+        // Its level is applied on top of the refinement pass, so a view that
+        // settles renders at full quality again. Switching it on, or to
+        // another target, starts over at full quality.
+        bool governing = state.governor && !state.paused && lensingMode == LENSING_OFF && !legacyUniforms;
+        if (state.governor && (!governorActive || governor.targetMs() != state.governorTargetMs)) {
+            governorSettings.targetMs = state.governorTargetMs;
+            governor.reset(governorSettings);
+        }
+        governorActive = state.governor;
+        if (governing) {
+            const kerr::QualityLevel& q = governor.quality();
+            params.stepBudget = q.stepBudget;
+            if (q.maxBounces) params.maxBounces = std::min(params.maxBounces, q.maxBounces);
+            // Too few bounces to skip the shadow exactly: trace it instead
+            if (params.maxBounces < kerr::SHADOW_MIN_BOUNCES) params.shadowSkip = 0;
+            params.relTolPos *= q.toleranceScale;
+            params.absTolPos *= q.toleranceScale;
+            params.relTolMom *= q.toleranceScale;
+            params.absTolMom *= q.toleranceScale;
+            params.pixelStride = std::max(params.pixelStride, q.pixelStride);
+        }
+        
+        // A full-resolution first sample can be traced edge-adaptively: a
+        // grid pass, then a fill pass that interpolates smooth cells. The
+        // block keeps the fill pass, which stands for the whole frame.
+        bool adaptive = state.adaptive && !legacyUniforms && lensingMode == LENSING_OFF &&
+                        params.pixelStride == 1 && params.filledStride == 0 && params.sampleIndex == 0;
+        if (adaptive) {
+            params.adaptivePass = ADAPTIVE_FILL;
+            params.adaptiveCell = adaptiveGrid.cell;
+            params.adaptiveEscapeTol = adaptiveEscapeTol;
+            params.adaptiveHitTol = kerr::ADAPTIVE_HIT_TOLERANCE;
+        }
+        
+        // Nothing the shaders see has changed: the output image still holds
+        // this frame, so there is nothing to dispatch
+        bool render = !imageValid || params != uploadedParams;
+        
+        // Only frames that reach the screen are timed. Starting one completes
+        // the record of the frame whose query set it takes over.
+        if (render || present) {
+            std::vector<double> gpuMs;
+            kerr::FrameRecord& record = frameRecords[(gpuTimer.slot() + 1) % kerr::GPU_TIMER_FRAMES];
+            if (gpuTimer.beginFrame(gpuMs)) completeFrame(record, gpuMs);
+            record = kerr::FrameRecord();
+            record.frame = framesDrawn++;
+            record.time = kerr::msSince(startClock) * 1e-3;
+            record.rendered = render;
+            record.pixelStride = params.pixelStride;
+            record.sampleIndex = params.sampleIndex;
+            record.quality = governing ? governor.level() : -1;
+        }
+        if (render) {
+            glBindBuffer(GL_UNIFORM_BUFFER, paramsBuffer);
+            glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(params), &params);
+            uploadedParams = params;
+            if (params.shadowSkip) {
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, shadowBuffer);
+                glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(shadow.radius), shadow.radius);
+            }
+            imageValid = true;
+            
+            glUseProgram(computeProgram);
+            if (legacyUniforms) {
+                glUniform1f(legacyTime, params.time);
+                glUniform1f(legacySpin, params.spinParameter);
+                glUniform1f(legacyExposure, params.exposure);
+                glUniform1f(legacyInclination, params.inclination);
+                glUniform1f(legacyDistance, params.cameraDistance);
+                glUniform2f(legacyResolution, params.resolution[0], params.resolution[1]);
+            }
+            if (programVariant.emissionLut) {
+                kerr::DiskModel model;
+                model.detail = programVariant.diskDetail;
+                emission.update(model);
+                emission.bind();
+            }
+            if (programVariant.skyCubemap) sky.bind();
+            // Bloom shares the image unit. Refinement passes add pixels to
+            // the AOVs of the pass they start from; a new scene clears them,
+            // so pixels no ray was traced for show as such.
+            if (programVariant.aov) {
+                if (params.filledStride == 0 && params.sampleIndex == 0) {
+                    glClearTexImage(aovTexture, 0, GL_RGBA, GL_FLOAT, nullptr);
+                }
+                glBindImageTexture(kerr::AOV_IMAGE_UNIT, aovTexture, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+            }
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, stepStatsBuffer);
+            glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+            updateMs = kerr::msSince(updateStart);
+            
+            gpuTimer.begin(GPU_COMPUTE);
+            if (adaptive) {
+                kerr::ShaderParams gridPass = params;
+                gridPass.adaptivePass = ADAPTIVE_GRID;
+                glBindBuffer(GL_UNIFORM_BUFFER, paramsBuffer);
+                glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(gridPass), &gridPass);
+                glDispatchCompute((adaptiveGrid.pointsX + 15) / 16, (adaptiveGrid.pointsY + 15) / 16, 1);
+                glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+                glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(params), &params);
+            }
+            
+            int stride = params.pixelStride;
+            int groupsX = ((WINDOW_WIDTH + stride - 1) / stride + 15) / 16;
+            int groupsY = ((WINDOW_HEIGHT + stride - 1) / stride + 15) / 16;
+            glDispatchCompute(groupsX, groupsY, 1);
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT |
+                            GL_BUFFER_UPDATE_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+            gpuTimer.end();
+            frameCount++;
+            
+            if (bloom.program && params.bloomStrength > 0.0f) {
+                gpuTimer.begin(GPU_BLOOM);
+                bloom.apply(outputTexture, params.bloomStrength, false);
+                gpuTimer.end();
+            }
+            
+            // A freshly traced map is read back once and written to the disk cache
+            if (lensingMode == LENSING_BUILD) {
+                kerr::LensingMap traced;
+                traced.reset(lensingMapKey, lensingMapOrbitAngle);
+                glBindTexture(GL_TEXTURE_2D_ARRAY, lensingMapTexture);
+                glGetTexImage(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, GL_FLOAT, traced.storage.data());
+                traced.valid = true;
+                if (lensingDiskCache.save(traced)) {
+                    std::cout << "Lensing map saved to " << lensingDiskCache.pathFor(lensingMapKey) << std::endl;
+                }
+            }
+        }
+        
+        // Render to screen: a new image, or the last one again after the
+        // window was exposed, resized or otherwise damaged
+        idle = !render && !present;
+        if (idle) continue;
+        present = false;
+        if (updateMs < 0.0) updateMs = kerr::msSince(updateStart);
+        
+        gpuTimer.begin(GPU_DISPLAY);
         glClear(GL_COLOR_BUFFER_BIT);
         glUseProgram(displayProgram);
+        glActiveTexture(GL_TEXTURE0 + kerr::BLOOM_DISPLAY_UNIT);
+        glBindTexture(GL_TEXTURE_2D, bloom.levels[0]);
+        glActiveTexture(GL_TEXTURE0 + kerr::AOV_DISPLAY_UNIT);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, aovTexture);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, outputTexture);
         glBindVertexArray(quadVAO);
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+        gpuTimer.end();
         
+        auto swapStart = std::chrono::steady_clock::now();
         SDL_GL_SwapWindow(window);
+        double swapMs = kerr::msSince(swapStart);
+        
+        kerr::FrameRecord& record = frameRecords[gpuTimer.slot()];
+        record.cpuMs.assign(CPU_STAGE_NAMES.size(), -1.0);
+        record.cpuMs[CPU_INPUT] = inputMs;
+        record.cpuMs[CPU_UPDATE] = updateMs;
+        record.cpuMs[CPU_SWAP] = swapMs;
+        record.cpuMs[CPU_FRAME] = kerr::msSince(frameStart);
+    }
+    
+    // Records still waiting for their GPU times
+    for (int i = 0; i < kerr::GPU_TIMER_FRAMES; ++i) {
+        std::vector<double> gpuMs;
+        kerr::FrameRecord& record = frameRecords[(gpuTimer.slot() + 1) % kerr::GPU_TIMER_FRAMES];
+        if (gpuTimer.beginFrame(gpuMs)) completeFrame(record, gpuMs);
     }
+    telemetry.close();
+    gpuTimer.destroy();
     
     // Cleanup
     glDeleteProgram(displayProgram);
     glDeleteProgram(computeProgram);
     glDeleteTextures(1, &outputTexture);
-    glDeleteTextures(1, &bloomTexture);
+    bloom.destroy();
+    if (bloomProgram) glDeleteProgram(bloomProgram);
+    emission.destroy();
+    sky.destroy();
+    glDeleteBuffers(1, &stepStatsBuffer);
+    glDeleteBuffers(1, &paramsBuffer);
+    glDeleteBuffers(1, &coarseSamplesBuffer);
+    glDeleteBuffers(1, &shadowBuffer);
+    glDeleteTextures(1, &lensingMapTexture);
+    glDeleteTextures(1, &aovTexture);
     glDeleteVertexArrays(1, &quadVAO);
     
     SDL_GL_DeleteContext(context);
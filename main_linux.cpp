@@ -7,6 +7,8 @@
 #include <fstream>
 #include <sstream>
 #include <cstring>
+#include <vector>
+#include <algorithm>
 #include <unistd.h>
 
 const int WIDTH = 1920;
@@ -126,15 +128,18 @@ int main() {
     float* pixels = new float[WIDTH * HEIGHT * 4];
     glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, pixels);
     
-    // Save as PPM
+    // Save as PPM, clamped to [0, 1] and written in one call
     std::cout << "Saving image..." << std::endl;
+    std::vector<unsigned char> bytes(WIDTH * HEIGHT * 3);
+    for (int i = 0; i < WIDTH * HEIGHT; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            float v = std::min(1.0f, std::max(0.0f, pixels[i * 4 + c]));
+            bytes[i * 3 + c] = (unsigned char)(v * 255);
+        }
+    }
     std::ofstream out("output.ppm", std::ios::binary);
     out << "P6\n" << WIDTH << " " << HEIGHT << "\n255\n";
-    for (int i = 0; i < WIDTH * HEIGHT * 4; i += 4) {
-        out << (unsigned char)(pixels[i] * 255);
-        out << (unsigned char)(pixels[i+1] * 255);
-        out << (unsigned char)(pixels[i+2] * 255);
-    }
+    out.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
     out.close();
     
     delete[] pixels;
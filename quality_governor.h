@@ -0,0 +1,139 @@
+/*
+ * Frame-time governor
+ * C++17, header-only
+ *
+ * Holds the GPU time of a continuously rendered view near a target by
+ * stepping through a ladder of quality levels, each cheaper than the one
+ * before: looser step tolerances, a smaller step budget, fewer disk
+ * bounces, then fewer shaded pixels (a progressive refinement stride).
+ *
+ * Frame times arrive a few frames late (frame_timing.h), tagged with the
+ * level they were rendered at; times of other levels are ignored. Their
+ * exponential moving average is compared against two thresholds:
+ *
+ *   above target * dropAbove for dropFrames frames   -> one level cheaper
+ *   below target * raiseBelow for raiseFrames frames -> one level better
+ *
+ * The gap between the two thresholds is the hysteresis. A level that is
+ * left again within raiseFrames frames of being raised to was too
+ * expensive after all, so the next raise waits twice as long, up to
+ * RAISE_FRAMES_MAX. Every RAISE_FRAMES_MAX frames spent at one level
+ * halve the wait again, so a view that got cheaper is probed now and then.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+
+namespace kerr {
+
+struct QualityLevel {
+    int stepBudget;             // step attempts per ray, 0 = the shader's MAX_STEPS
+    int maxBounces;             // disk bounces, 0 = as configured
+    float toleranceScale;       // multiplies the step controller tolerances
+    int pixelStride;            // one shaded pixel per stride x stride block
+};
+
+// Best first. Tolerances go first because they cost the least image
+// quality per millisecond saved; the stride goes last because it costs
+// the most. Strides stay powers of two for progressive refinement. Levels
+// with fewer bounces than SHADOW_MIN_BOUNCES (kerr_shadow.h) also trace
+// the shadow, which skipping would leave black wrongly.
+constexpr QualityLevel QUALITY_LEVELS[] = {
+    {0, 0, 1.0f, 1},
+    {0, 0, 4.0f, 1},
+    {384, 0, 4.0f, 1},
+    {384, 2, 8.0f, 1},
+    {384, 2, 8.0f, 2},
+    {256, 1, 16.0f, 2},
+    {256, 1, 16.0f, 4},
+};
+constexpr int QUALITY_LEVEL_COUNT = (int)(sizeof(QUALITY_LEVELS) / sizeof(QUALITY_LEVELS[0]));
+constexpr int RAISE_FRAMES_MAX = 960;
+
+struct GovernorSettings {
+    double targetMs = 16.6;     // GPU time per frame to hold
+    double dropAbove = 1.10;    // fraction of targetMs
+    double raiseBelow = 0.65;
+    int dropFrames = 4;
+    int raiseFrames = 30;       // initial wait before a raise
+    double smoothing = 0.25;    // weight of the newest frame in the average
+};
+
+class QualityGovernor {
+public:
+    QualityGovernor() = default;
+    explicit QualityGovernor(const GovernorSettings& s) : settings(s), raiseWait(s.raiseFrames) {}
+
+    // Adds the GPU time of a frame rendered at level `renderedAt`; true if
+    // the level changed
+    bool update(double frameMs, int renderedAt) {
+        if (renderedAt != current || frameMs <= 0.0) return false;
+        average = samples == 0 ? frameMs : average + settings.smoothing * (frameMs - average);
+        samples++;
+        framesAtLevel++;
+        if (framesAtLevel % RAISE_FRAMES_MAX == 0) raiseWait = std::max(raiseWait / 2, settings.raiseFrames);
+
+        over = average > settings.targetMs * settings.dropAbove ? over + 1 : 0;
+        under = average < settings.targetMs * settings.raiseBelow ? under + 1 : 0;
+        if (over >= settings.dropFrames && current + 1 < QUALITY_LEVEL_COUNT) {
+            // Left soon after a raise: that raise oscillates, wait longer next time
+            if (raised && framesAtLevel < raiseWait) raiseWait = std::min(raiseWait * 2, RAISE_FRAMES_MAX);
+            setLevel(current + 1, false);
+            return true;
+        }
+        if (under >= raiseWait && current > 0) {
+            setLevel(current - 1, true);
+            return true;
+        }
+        return false;
+    }
+
+    // Back to full quality with a fresh history, e.g. for a new target
+    void reset(const GovernorSettings& s) {
+        settings = s;
+        raiseWait = s.raiseFrames;
+        setLevel(0, false);
+    }
+
+    int level() const { return current; }
+    const QualityLevel& quality() const { return QUALITY_LEVELS[current]; }
+    double averageMs() const { return average; }
+    double targetMs() const { return settings.targetMs; }
+    int changes() const { return levelChanges; }
+
+    // "L2/6 budget 384, bounces 2, tol x8, stride 1"
+    std::string describe() const {
+        const QualityLevel& q = quality();
+        char text[128];
+        std::snprintf(text, sizeof(text), "L%d/%d budget %s, bounces %s, tol x%g, stride %d", current,
+                      QUALITY_LEVEL_COUNT - 1, q.stepBudget ? std::to_string(q.stepBudget).c_str() : "full",
+                      q.maxBounces ? std::to_string(q.maxBounces).c_str() : "full", q.toleranceScale, q.pixelStride);
+        return text;
+    }
+
+private:
+    void setLevel(int level, bool up) {
+        current = level;
+        raised = up;
+        over = under = 0;
+        framesAtLevel = 0;
+        samples = 0;
+        average = 0.0;
+        levelChanges++;
+    }
+
+    GovernorSettings settings;
+    int current = 0;
+    double average = 0.0;
+    int samples = 0;
+    int over = 0, under = 0;
+    int framesAtLevel = 0;
+    int raiseWait = GovernorSettings().raiseFrames;
+    bool raised = false;
+    int levelChanges = 0;
+};
+
+} // namespace kerr
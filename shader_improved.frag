@@ -4,13 +4,94 @@ in vec2 TexCoord;
 out vec4 FragColor;
 
 uniform sampler2D screenTexture;
+// Half-size bloom of the image, built by bloom.comp (bloom.h)
+uniform sampler2D bloomTexture;
+// Diagnostic images of the KERR_AOV compute variant (aov.h)
+uniform sampler2DArray aovTexture;
 
-// Enhanced post-processing options
-uniform float uChromatic = 0.002;  // Chromatic aberration strength
-uniform float uVignette = 0.3;      // Vignette strength
-uniform float uSharpen = 0.15;      // Sharpening amount
+// Parameter block shared with blackhole_improved.comp (shader_params.h);
+// this pass reads only the post-processing options at its end
+layout(std140, binding = 0) uniform KerrParams {
+    vec2 uResolution;
+    ivec2 uTileOffset;
+    float uTime;
+    float uSpinParameter;
+    float uExposure;
+    float uInclination;
+    float uCameraDistance;
+    float uBloomStrength;
+    int uMaxBounces;
+    int uIntegrator;
+    float uRelTolPos;
+    float uAbsTolPos;
+    float uRelTolMom;
+    float uAbsTolMom;
+    int uLensingMode;
+    float uLensingOrbitAngle;
+    float uChromatic;   // Chromatic aberration strength
+    float uVignette;    // Vignette strength
+    float uSharpen;     // Sharpening amount
+    int uPixelStride;
+    int uFilledStride;
+    int uSampleIndex;
+    int uAdaptivePass;
+    int uAdaptiveCell;
+    float uAdaptiveEscapeTol;
+    float uAdaptiveHitTol;
+    vec2 uShadowCenter;
+    int uShadowSkip;
+    float uShadowMargin;
+    float uFarFieldRadius;
+    int uStepBudget;
+    int uAovView;       // 0 = image, 1 + AOV channel (aov.h)
+};
+
+// ===================================================================
+// AOV DISPLAY
+// ===================================================================
+// The false colours of aov.h: one colour per termination, everything else
+// on the Turbo map over the range AOV_CHANNELS gives the channel
+
+const int AOV_CHANNEL_COUNT = 6;
+const int AOV_TERMINATION = 2;
+const ivec2 AOV_TEXEL[AOV_CHANNEL_COUNT] = ivec2[](
+    ivec2(0, 0), ivec2(0, 1), ivec2(0, 2), ivec2(0, 3), ivec2(1, 0), ivec2(1, 1));   // layer, component
+const vec3 AOV_RANGE[AOV_CHANNEL_COUNT] = vec3[](                                    // lo, hi, log scale
+    vec3(0.0, 256.0, 0.0), vec3(0.0, 32.0, 0.0), vec3(0.0, 4.0, 0.0),
+    vec3(0.0, 3.0, 0.0), vec3(1e-2, 1.0, 1.0), vec3(1.0, 150.0, 1.0));
+const vec3 AOV_END_COLORS[5] = vec3[](
+    vec3(0.0), vec3(0.35, 0.1, 0.5), vec3(0.2, 0.45, 1.0), vec3(1.0, 0.6, 0.1), vec3(1.0, 0.1, 0.1));
+
+vec3 turbo(float t) {
+    t = clamp(t, 0.0, 1.0);
+    vec4 v4 = vec4(1.0, t, t * t, t * t * t);
+    vec2 v2 = v4.zw * v4.z;
+    return clamp(vec3(
+        dot(v4, vec4(0.13572138, 4.61539260, -42.66032258, 132.13108234)) + dot(v2, vec2(-152.94239396, 59.28637943)),
+        dot(v4, vec4(0.09140261, 2.19418839, 4.84296658, -14.18503333)) + dot(v2, vec2(4.27729857, 2.82956604)),
+        dot(v4, vec4(0.10667330, 12.64194608, -60.58204836, 110.36276771)) + dot(v2, vec2(-89.90310912, 27.34824973))),
+        0.0, 1.0);
+}
+
+// Refinement passes store the AOVs of a block at its shaded pixel
+vec3 aovColor(int channel) {
+    ivec2 texel = ivec2(TexCoord * vec2(textureSize(aovTexture, 0).xy));
+    int stride = max(uPixelStride, 1);
+    texel -= texel % stride;
+    float v = texelFetch(aovTexture, ivec3(texel, AOV_TEXEL[channel].x), 0)[AOV_TEXEL[channel].y];
+    if (channel == AOV_TERMINATION) return AOV_END_COLORS[clamp(int(round(v)), 0, 4)];
+    vec3 range = AOV_RANGE[channel];
+    float t = range.z > 0.0 ? log(max(v, range.x) / range.x) / log(range.y / range.x)
+                            : (v - range.x) / (range.y - range.x);
+    return turbo(t);
+}
 
 void main() {
+    if (uAovView > 0) {
+        FragColor = vec4(aovColor(min(uAovView, AOV_CHANNEL_COUNT) - 1), 1.0);
+        return;
+    }
+    
     vec2 uv = TexCoord;
     vec3 color = vec3(0.0);
     
@@ -41,6 +122,9 @@ void main() {
     
     color += (color - blur) * uSharpen;
     
+    // Bloom, upsampled by the linear filter
+    color += uBloomStrength * texture(bloomTexture, uv).rgb;
+    
     // Enhanced vignette (smooth falloff)
     float vignetteFactor = smoothstep(0.9, 0.3, dist * 1.4);
     vignetteFactor = mix(1.0 - uVignette, 1.0, vignetteFactor);
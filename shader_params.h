@@ -0,0 +1,140 @@
+/*
+ * Shader parameter block
+ * C++17, header-only
+ *
+ * CPU mirror of the std140 uniform block KerrParams declared in
+ * blackhole_improved.comp, blackhole_cinematic.comp and shader_improved.frag. Every program that runs
+ * those shaders fills one ShaderParams, uploads it to a uniform buffer and
+ * binds that buffer to SHADER_PARAMS_BINDING; no uniform is looked up by
+ * name. Members are ordered so that std140 adds no padding between them,
+ * and the offsets below are checked against the GLSL declaration order.
+ *
+ * The struct compares bytewise, so a program can keep the last uploaded
+ * copy and re-upload (and re-render) only when something changed.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace kerr {
+
+constexpr unsigned SHADER_PARAMS_BINDING = 0;
+// Storage buffer of the step counters below
+constexpr unsigned STEP_STATS_BINDING = 2;
+// Storage buffer of the shadow outline's radius table (kerr_shadow.h)
+constexpr unsigned SHADOW_OUTLINE_BINDING = 4;
+// Storage buffer of per-ray step counts, binned (KERR_STEP_HISTOGRAM builds
+// of blackhole_improved.comp): bin i counts rays of i * STEP_HISTOGRAM_WIDTH
+// up to (i + 1) * STEP_HISTOGRAM_WIDTH - 1 steps, the last bin all longer ones
+constexpr unsigned STEP_HISTOGRAM_BINDING = 5;
+constexpr int STEP_HISTOGRAM_BINS = 256;
+constexpr int STEP_HISTOGRAM_WIDTH = 4;
+
+struct alignas(16) ShaderParams {
+    float resolution[2] = {0.0f, 0.0f};   // vec2  uResolution
+    int32_t tileOffset[2] = {0, 0};       // ivec2 uTileOffset
+    float time = 0.0f;                    // float uTime
+    float spinParameter = 0.9f;           // float uSpinParameter
+    float exposure = 1.0f;                // float uExposure
+    float inclination = 85.0f;            // float uInclination
+    float cameraDistance = 25.0f;         // float uCameraDistance
+    float bloomStrength = 0.0f;           // float uBloomStrength
+    int32_t maxBounces = 3;               // int   uMaxBounces
+    int32_t integrator = 0;               // int   uIntegrator
+    float relTolPos = 1e-4f;              // float uRelTolPos
+    float absTolPos = 1e-5f;              // float uAbsTolPos
+    float relTolMom = 1e-4f;              // float uRelTolMom
+    float absTolMom = 1e-5f;              // float uAbsTolMom
+    int32_t lensingMode = 0;              // int   uLensingMode
+    float lensingOrbitAngle = 0.0f;       // float uLensingOrbitAngle
+
+    // Display pass (shader_improved.frag)
+    float chromatic = 0.002f;             // float uChromatic
+    float vignette = 0.3f;                // float uVignette
+    float sharpen = 0.15f;                // float uSharpen
+
+    // Progressive refinement (compute shaders). Each invocation shades one
+    // pixel per pixelStride x pixelStride block and fills the block with it.
+    // Blocks whose pixel a previous pass at filledStride already shaded reuse
+    // that value from the output image. sampleIndex > 0 shades a jittered
+    // sample and averages it into the image, which then holds the mean of
+    // sampleIndex + 1 samples.
+    int32_t pixelStride = 1;              // int   uPixelStride
+    int32_t filledStride = 0;             // int   uFilledStride
+    int32_t sampleIndex = 0;              // int   uSampleIndex
+
+    // Edge-adaptive tracing (blackhole_improved.comp, adaptive_sampling.h).
+    // A frame is a grid pass and a fill pass with the same scene; passes
+    // other than ADAPTIVE_OFF leave the progressive members at their defaults.
+    int32_t adaptivePass = 0;             // int   uAdaptivePass
+    int32_t adaptiveCell = 4;             // int   uAdaptiveCell
+    float adaptiveEscapeTol = 0.0f;       // float uAdaptiveEscapeTol
+    float adaptiveHitTol = 0.1f;          // float uAdaptiveHitTol
+
+    // Analytic shadow (blackhole_improved.comp, kerr_shadow.h). With
+    // shadowSkip set, pixels inside the outline bound at
+    // SHADOW_OUTLINE_BINDING, shrunk by shadowMargin, are black untraced.
+    float shadowCenter[2] = {0.0f, 0.0f}; // vec2  uShadowCenter
+    int32_t shadowSkip = 0;               // int   uShadowSkip
+    float shadowMargin = 0.05f;           // float uShadowMargin
+
+    // Far field (blackhole_improved.comp, kerr_physics.h): rays outside a
+    // sphere of this radius move analytically; 0 integrates everywhere
+    float farFieldRadius = 0.0f;          // float uFarFieldRadius
+
+    // Runtime step budget per ray (quality_governor.h); 0 = MAX_STEPS
+    int32_t stepBudget = 0;               // int   uStepBudget
+
+    // Display pass: 0 shows the image, 1 + n the false colours of AOV
+    // channel n (aov.h)
+    int32_t aovView = 0;                  // int   uAovView
+
+    bool operator==(const ShaderParams& o) const { return std::memcmp(this, &o, sizeof(*this)) == 0; }
+    bool operator!=(const ShaderParams& o) const { return !(*this == o); }
+
+    // The same parameters without the refinement or adaptive pass: two blocks
+    // with equal scenes shade the same image
+    ShaderParams scene() const {
+        ShaderParams s = *this;
+        s.pixelStride = 1;
+        s.filledStride = 0;
+        s.sampleIndex = 0;
+        ShaderParams defaults;
+        s.adaptivePass = defaults.adaptivePass;
+        s.adaptiveCell = defaults.adaptiveCell;
+        s.adaptiveEscapeTol = defaults.adaptiveEscapeTol;
+        s.adaptiveHitTol = defaults.adaptiveHitTol;
+        return s;
+    }
+};
+
+static_assert(offsetof(ShaderParams, tileOffset) == 8, "std140 layout mismatch");
+static_assert(offsetof(ShaderParams, time) == 16, "std140 layout mismatch");
+static_assert(offsetof(ShaderParams, maxBounces) == 40, "std140 layout mismatch");
+static_assert(offsetof(ShaderParams, relTolPos) == 48, "std140 layout mismatch");
+static_assert(offsetof(ShaderParams, lensingMode) == 64, "std140 layout mismatch");
+static_assert(offsetof(ShaderParams, chromatic) == 72, "std140 layout mismatch");
+static_assert(offsetof(ShaderParams, pixelStride) == 84, "std140 layout mismatch");
+static_assert(offsetof(ShaderParams, adaptivePass) == 96, "std140 layout mismatch");
+static_assert(offsetof(ShaderParams, shadowCenter) == 112, "std140 layout mismatch");
+static_assert(offsetof(ShaderParams, farFieldRadius) == 128, "std140 layout mismatch");
+static_assert(offsetof(ShaderParams, stepBudget) == 132, "std140 layout mismatch");
+static_assert(offsetof(ShaderParams, aovView) == 136, "std140 layout mismatch");
+static_assert(sizeof(ShaderParams) == 144, "std140 block size mismatch");
+
+// CPU mirror of the std430 buffer StepStats of blackhole_improved.comp:
+// counters summed over one dispatch, 32 bits each, so programs clear them
+// before every dispatch and add them up on the host
+struct StepStats {
+    uint32_t acceptedSteps = 0;
+    uint32_t rejectedSteps = 0;
+    uint32_t tracedRays = 0;              // shaded pixels
+    uint32_t skippedRays = 0;             // of those, inside the shadow and not traced
+};
+
+static_assert(sizeof(StepStats) == 16, "std430 layout mismatch");
+
+} // namespace kerr
@@ -0,0 +1,285 @@
+/*
+ * Shader variants and a program binary cache
+ * C++17, header-only; include after the program's OpenGL declarations
+ * (GL/glew.h or gl_headless.h)
+ *
+ * A variant is one compute shader source specialized by #define lines
+ * inserted after its #version line: step budget, bounce count, a fixed
+ * integrator and feature toggles (ShaderVariant). Only values that differ
+ * from the shader's own defaults are defined, so the same variant can be
+ * applied to blackhole_improved.comp, blackhole_cinematic.comp or a
+ * shader that knows none of the names. Features fixed off at compile time
+ * cost no registers and no code, which the per-dispatch uniforms of the
+ * default build cannot avoid.
+ *
+ * Linked programs are kept on disk with glGetProgramBinary, so a start
+ * with an unchanged shader skips compiling it. There is one file per
+ * shader name, variant and driver; its header holds a hash of the full
+ * specialized source, and a changed shader or a binary the driver
+ * rejects is rebuilt and overwrites the file. Binaries are specific to
+ * the GPU and driver that produced them and are never shared.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace kerr {
+
+// Hits the lensing map and coarse sample storage hold per ray
+constexpr int SHADER_MAX_BOUNCES = 3;
+
+// #define values of blackhole_improved.comp; zero or negative members keep the
+// shader's default
+struct ShaderVariant {
+    int maxSteps = 0;           // KERR_MAX_STEPS, step budget per ray
+    int maxBounces = 0;         // KERR_MAX_BOUNCES, 1 .. SHADER_MAX_BOUNCES
+    int integrator = -1;        // KERR_INTEGRATOR: 0 affine, 1 Mino, -1 from uIntegrator
+    int starfield = -1;         // KERR_STARFIELD: 0 sky only, 1 stars, 2 everything
+    int volumeSamples = 0;      // KERR_VOLUME_SAMPLES of blackhole_cinematic.comp
+    bool diskDetail = true;     // KERR_DISK_DETAIL
+    bool farField = true;       // KERR_FAR_FIELD
+    bool lensingMap = true;     // KERR_LENSING_MAP
+    bool adaptive = true;       // KERR_ADAPTIVE
+    bool stepHistogram = false; // KERR_STEP_HISTOGRAM, per-ray step counts (benchmarks)
+    bool emissionLut = false;   // KERR_EMISSION_LUT, disk emission from tables (emission_lut.h)
+    bool skyCubemap = false;    // KERR_SKY_CUBEMAP, starfield from a baked cube map (sky_cubemap.h)
+    bool aov = false;           // KERR_AOV, diagnostic images (aov.h)
+
+    std::string defines() const {
+        std::ostringstream out;
+        if (maxSteps > 0) out << "#define KERR_MAX_STEPS " << maxSteps << "\n";
+        if (maxBounces > 0) out << "#define KERR_MAX_BOUNCES " << std::min(maxBounces, SHADER_MAX_BOUNCES) << "\n";
+        if (integrator >= 0) out << "#define KERR_INTEGRATOR " << integrator << "\n";
+        if (starfield >= 0) out << "#define KERR_STARFIELD " << starfield << "\n";
+        if (volumeSamples > 0) out << "#define KERR_VOLUME_SAMPLES " << volumeSamples << "\n";
+        if (!diskDetail) out << "#define KERR_DISK_DETAIL 0\n";
+        if (!farField) out << "#define KERR_FAR_FIELD 0\n";
+        if (!lensingMap) out << "#define KERR_LENSING_MAP 0\n";
+        if (!adaptive) out << "#define KERR_ADAPTIVE 0\n";
+        if (stepHistogram) out << "#define KERR_STEP_HISTOGRAM 1\n";
+        if (emissionLut) out << "#define KERR_EMISSION_LUT 1\n";
+        if (skyCubemap) out << "#define KERR_SKY_CUBEMAP 1\n";
+        if (aov) out << "#define KERR_AOV 1\n";
+        return out.str();
+    }
+
+    bool operator==(const ShaderVariant& o) const { return defines() == o.defines(); }
+    bool operator!=(const ShaderVariant& o) const { return !(*this == o); }
+};
+
+// source with the variant's defines after its #version line; a #line
+// directive keeps compiler messages at the line numbers of the file
+inline std::string specializeShader(const std::string& source, const ShaderVariant& variant) {
+    std::string defines = variant.defines();
+    if (defines.empty()) return source;
+    size_t version = source.find("#version");
+    if (version == std::string::npos) return defines + "#line 1\n" + source;
+    size_t lineEnd = source.find('\n', version);
+    if (lineEnd == std::string::npos) return source + "\n" + defines;
+    int nextLine = 2 + (int)std::count(source.begin(), source.begin() + version, '\n');
+    return source.substr(0, lineEnd + 1) + defines + "#line " + std::to_string(nextLine) + "\n" +
+           source.substr(lineEnd + 1);
+}
+
+// FNV-1a, continued from h
+inline uint64_t fnv1a(const void* data, size_t size, uint64_t h = 14695981039346656037ull) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        h ^= bytes[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+inline uint64_t fnv1a(const std::string& s, uint64_t h = 14695981039346656037ull) {
+    return fnv1a(s.data(), s.size(), h);
+}
+
+constexpr char PROGRAM_CACHE_MAGIC[8] = {'K', 'E', 'R', 'R', 'P', 'R', 'O', 'G'};
+constexpr uint32_t PROGRAM_CACHE_VERSION = 1;
+constexpr const char* PROGRAM_CACHE_EXTENSION = ".kpb";
+
+struct ProgramCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t binaryFormat;      // GLenum of glGetProgramBinary
+    uint64_t sourceHash;        // specialized source and driver strings
+    uint64_t binaryBytes;
+};
+
+class ProgramCache {
+public:
+    explicit ProgramCache(std::string directory) : dir(std::move(directory)) {}
+
+    const std::string& directory() const { return dir; }
+
+    // Drivers without binary formats (or an empty directory) cache nothing
+    bool enabled() const {
+        if (dir.empty()) return false;
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }
+
+    // One file per shader name, variant and driver
+    std::string pathFor(const std::string& name, const ShaderVariant& variant) const {
+        uint64_t h = fnv1a(std::filesystem::path(name).filename().string());
+        h = fnv1a(variant.defines(), h);
+        h = fnv1a(driverString(), h);
+        char file[32];
+        std::snprintf(file, sizeof(file), "%016llx", (unsigned long long)h);
+        std::string stem = std::filesystem::path(name).stem().string();
+        return (std::filesystem::path(dir) / (stem + "-" + file + PROGRAM_CACHE_EXTENSION)).string();
+    }
+
+    static uint64_t sourceHash(const std::string& specialized) {
+        uint64_t h = fnv1a(&PROGRAM_CACHE_VERSION, sizeof(PROGRAM_CACHE_VERSION));
+        h = fnv1a(specialized, h);
+        return fnv1a(driverString(), h);
+    }
+
+    // A linked program from the file at path, or 0 on a miss, a stale file
+    // or a binary the driver no longer accepts
+    GLuint load(const std::string& path, uint64_t hash) const {
+        std::ifstream in(path, std::ios::binary);
+        if (!in.is_open()) return 0;
+        ProgramCacheHeader h;
+        if (!in.read(reinterpret_cast<char*>(&h), sizeof(h))) return 0;
+        if (std::memcmp(h.magic, PROGRAM_CACHE_MAGIC, sizeof(h.magic)) != 0 ||
+            h.version != PROGRAM_CACHE_VERSION || h.sourceHash != hash || h.binaryBytes > (1ull << 30)) {
+            return 0;
+        }
+        std::vector<char> binary((size_t)h.binaryBytes);
+        if (!in.read(binary.data(), (std::streamsize)binary.size())) return 0;
+
+        GLuint program = glCreateProgram();
+        glProgramBinary(program, (GLenum)h.binaryFormat, binary.data(), (GLsizei)binary.size());
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked) {
+            glDeleteProgram(program);
+            return 0;
+        }
+        return program;
+    }
+
+    // Written under a unique temporary name and renamed, so concurrent
+    // processes (render farm workers) never read a partial file
+    bool save(const std::string& path, uint64_t hash, GLuint program) const {
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) return false;
+        std::vector<char> binary((size_t)length);
+        GLenum format = 0;
+        glGetProgramBinary(program, length, nullptr, &format, binary.data());
+
+        ProgramCacheHeader h;
+        std::memset(&h, 0, sizeof(h));
+        std::memcpy(h.magic, PROGRAM_CACHE_MAGIC, sizeof(h.magic));
+        h.version = PROGRAM_CACHE_VERSION;
+        h.binaryFormat = format;
+        h.sourceHash = hash;
+        h.binaryBytes = binary.size();
+
+        std::error_code ec;
+        std::filesystem::create_directories(dir, ec);
+        char suffix[24];
+        std::snprintf(suffix, sizeof(suffix), ".%08x.tmp", (unsigned)std::random_device{}());
+        std::string tmp = path + suffix;
+        {
+            std::ofstream out(tmp, std::ios::binary);
+            out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+            out.write(binary.data(), (std::streamsize)binary.size());
+            if (!out) {
+                std::cerr << "Failed to write program cache file: " << tmp << std::endl;
+                out.close();
+                std::filesystem::remove(tmp, ec);
+                return false;
+            }
+        }
+        std::filesystem::rename(tmp, path, ec);
+        if (ec) {
+            std::filesystem::remove(tmp, ec);
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static std::string driverString() {
+        auto str = [](GLenum name) {
+            const GLubyte* s = glGetString(name);
+            return s ? std::string(reinterpret_cast<const char*>(s)) : std::string();
+        };
+        return str(GL_VENDOR) + "\n" + str(GL_RENDERER) + "\n" + str(GL_VERSION);
+    }
+
+    std::string dir;
+};
+
+// Compiled and linked compute program of source specialized by variant;
+// name is the shader's file name. With a cache, a stored binary is used
+// when it matches (fromCache), and a freshly linked program is stored.
+// 0 on failure, with the compiler log on stderr.
+inline GLuint buildComputeProgram(const std::string& name, const std::string& source,
+                                  const ShaderVariant& variant, const ProgramCache* cache = nullptr,
+                                  bool* fromCache = nullptr) {
+    if (fromCache) *fromCache = false;
+    std::string specialized = specializeShader(source, variant);
+    bool cached = cache && cache->enabled();
+    std::string path;
+    uint64_t hash = 0;
+    if (cached) {
+        path = cache->pathFor(name, variant);
+        hash = ProgramCache::sourceHash(specialized);
+        if (GLuint program = cache->load(path, hash)) {
+            if (fromCache) *fromCache = true;
+            return program;
+        }
+    }
+
+    const char* src = specialized.c_str();
+    GLuint shader = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(shader, 1, &src, nullptr);
+    glCompileShader(shader);
+    GLint success = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success) {
+        char log[4096];
+        glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        std::cerr << name << ": compute shader error:\n" << log << std::endl;
+        glDeleteShader(shader);
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    if (cached) glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glAttachShader(program, shader);
+    glLinkProgram(program);
+    glDeleteShader(shader);
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        char log[4096];
+        glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+        std::cerr << name << ": program link error:\n" << log << std::endl;
+        glDeleteProgram(program);
+        return 0;
+    }
+    if (cached) cache->save(path, hash, program);
+    return program;
+}
+
+} // namespace kerr
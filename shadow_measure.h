@@ -0,0 +1,245 @@
+/*
+ * Shadow measurement by image-plane bisection
+ * C++17, header-only
+ *
+ * The edge of the shadow is the critical curve: rays inside it fall into
+ * the horizon, rays outside it escape, and rays launched just outside it
+ * wind around the photon orbits first, so the photon ring's higher-order
+ * images pile up against it. Measuring it needs no image. Along each of N
+ * directions from a point inside the shadow, a captured and an escaping
+ * ray bracket the edge, and bisection narrows the bracket to a tolerance:
+ * about 15 rays per direction instead of a frame of rays.
+ *
+ * Rays are traced with traceRay() or traceRayMino() (kerr_physics.h), the
+ * metric and integrators of blackhole_improved.comp, with the same step
+ * tolerances and far field. The disk does not stop them: only the horizon
+ * or the escape radius decides a ray. Near the edge rays orbit several
+ * times, so they get a larger step budget than a frame's; a ray that still
+ * runs out of steps ends its direction's bisection early, and the point is
+ * marked unresolved.
+ *
+ * Results are in M: image-plane coordinates (tangents of the angles off
+ * the camera axis) times the camera distance. For a distant camera these
+ * are the celestial coordinates (alpha, beta); the origin is the direction
+ * of the black hole.
+ */
+
+#pragma once
+
+#include "kerr_physics.h"
+#include "kerr_shadow.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace kerr {
+
+struct ShadowMeasureSettings {
+    int angles = 360;                   // directions about the shadow centre
+    float tolerance = 1e-3f;            // bisection bracket in M at which to stop
+    int maxSteps = 16 * MAX_STEPS;      // step attempts per ray
+};
+
+// Farthest image-plane radius searched for an escaping ray, about 63
+// degrees off the camera axis
+constexpr float SHADOW_SEARCH_LIMIT = 2.0f;
+
+// One view: camera and the point inside the shadow the directions start
+// from, the centre of the analytic outline where there is one
+struct ShadowProbe {
+    RenderParams params;
+    ShadowMeasureSettings settings;
+    Camera cam;
+    ShadowOutline outline;
+    float centerX = 0.0f, centerY = 0.0f;   // image plane
+    bool valid = false;                     // the centre ray is captured
+};
+
+struct ShadowEdgePoint {
+    float angle = 0.0f;                 // direction about the probe centre, radians
+    float x = 0.0f, y = 0.0f;           // M
+    bool resolved = false;              // bracket narrowed to the tolerance
+    uint64_t rays = 0;
+    uint64_t steps = 0;                 // accepted and rejected
+};
+
+// Shape of a closed edge curve, in M
+struct ShadowMetrics {
+    bool valid = false;
+    float centroidX = 0.0f, centroidY = 0.0f;   // of the enclosed area
+    float diameterX = 0.0f, diameterY = 0.0f;   // extent along the image axes
+    float areaDiameter = 0.0f;                  // of the circle with the same area
+    float ringRadius = 0.0f;                    // mean radius about the centroid
+    float circularity = 0.0f;                   // RMS radius deviation / ringRadius
+    int unresolved = 0;
+    uint64_t rays = 0, steps = 0;
+};
+
+// Fate of the ray through image-plane point (x, y); the disk is crossed,
+// not hit
+inline RayFate shadowRayFate(const ShadowProbe& probe, float x, float y, StepCounts& steps) {
+    const RenderParams& p = probe.params;
+    Vec3 dir = normalize(probe.cam.forward + probe.cam.right * x + probe.cam.up * y);
+    const int noBounceLimit = std::numeric_limits<int>::max();
+    LensingSample record;
+    float brightness;
+    if (p.integrator == Integrator::Mino) {
+        traceRayMino(probe.cam.position, dir, p.spin, noBounceLimit, p.time, p.tolerances, brightness, steps,
+                     &record, p.farFieldRadius, probe.settings.maxSteps);
+    } else {
+        traceRay(probe.cam.position, dir, p.spin, noBounceLimit, p.time, p.tolerances, brightness, steps,
+                 &record, p.farFieldRadius, probe.settings.maxSteps);
+    }
+    return record.fate;
+}
+
+inline ShadowProbe makeShadowProbe(const RenderParams& params, const ShadowMeasureSettings& settings) {
+    ShadowProbe probe;
+    probe.params = params;
+    probe.settings = settings;
+    probe.cam = makeCamera(params);
+    probe.outline = shadowOutline(probe.cam, params.spin);
+    if (probe.outline.valid) {
+        probe.centerX = probe.outline.centerX;
+        probe.centerY = probe.outline.centerY;
+    }
+    StepCounts steps;
+    probe.valid = shadowRayFate(probe, probe.centerX, probe.centerY, steps) == RayFate::Horizon;
+    return probe;
+}
+
+// Edge point in direction `index` of settings.angles: widen the bracket
+// from the analytic outline until its outer end escapes, then bisect
+inline ShadowEdgePoint bisectShadowEdge(const ShadowProbe& probe, int index) {
+    ShadowEdgePoint point;
+    point.angle = TWO_PI * (float)index / (float)probe.settings.angles;
+    const float dx = std::cos(point.angle), dy = std::sin(point.angle);
+    const float distance = probe.params.cameraDistance;
+    const float tolerance = probe.settings.tolerance / distance;
+
+    auto fate = [&](float radius) {
+        StepCounts steps;
+        RayFate f = shadowRayFate(probe, probe.centerX + radius * dx, probe.centerY + radius * dy, steps);
+        point.rays++;
+        point.steps += steps.attempts();
+        return f;
+    };
+
+    // The outline table lies just inside the edge; without one, start from
+    // the Schwarzschild shadow radius sqrt(27)
+    float inner = 0.0f;
+    float outer = 5.2f / distance;
+    if (probe.outline.valid) {
+        float r = probe.outline.radius[ShadowOutline::bin(dx, dy)];
+        if (fate(0.97f * r) == RayFate::Horizon) inner = 0.97f * r;
+        outer = 1.03f * r;
+    }
+    for (;;) {
+        RayFate f = fate(outer);
+        if (f == RayFate::Escaped) break;
+        if (f == RayFate::Horizon) inner = outer;
+        outer *= 1.5f;
+        if (outer > SHADOW_SEARCH_LIMIT) {
+            outer = inner;
+            break;
+        }
+    }
+
+    point.resolved = outer > inner;
+    while (point.resolved && outer - inner > tolerance) {
+        float mid = 0.5f * (inner + outer);
+        RayFate f = fate(mid);
+        if (f == RayFate::Exhausted) {
+            point.resolved = false;
+            break;
+        }
+        (f == RayFate::Horizon ? inner : outer) = mid;
+    }
+
+    float radius = 0.5f * (inner + outer);
+    point.x = (probe.centerX + radius * dx) * distance;
+    point.y = (probe.centerY + radius * dy) * distance;
+    return point;
+}
+
+// Metrics of a curve ordered by angle about a point inside it, as
+// bisectShadowEdge() produces it. The circularity is that of Johannsen and
+// Psaltis (2010): the RMS deviation of the radius about the centroid from
+// its mean, over the angle about the centroid, relative to the mean.
+inline ShadowMetrics shadowMetrics(const std::vector<ShadowEdgePoint>& curve) {
+    ShadowMetrics m;
+    const size_t n = curve.size();
+    for (const ShadowEdgePoint& p : curve) {
+        m.unresolved += p.resolved ? 0 : 1;
+        m.rays += p.rays;
+        m.steps += p.steps;
+    }
+    if (n < 3) return m;
+
+    double area = 0.0, cx = 0.0, cy = 0.0;
+    float minX = curve[0].x, maxX = minX, minY = curve[0].y, maxY = minY;
+    for (size_t i = 0; i < n; ++i) {
+        const ShadowEdgePoint& a = curve[i];
+        const ShadowEdgePoint& b = curve[(i + 1) % n];
+        double cross = (double)a.x * b.y - (double)b.x * a.y;
+        area += cross;
+        cx += (a.x + b.x) * cross;
+        cy += (a.y + b.y) * cross;
+        minX = std::min(minX, a.x);
+        maxX = std::max(maxX, a.x);
+        minY = std::min(minY, a.y);
+        maxY = std::max(maxY, a.y);
+    }
+    area *= 0.5;
+    if (area <= 0.0) return m;
+    m.centroidX = (float)(cx / (6.0 * area));
+    m.centroidY = (float)(cy / (6.0 * area));
+    m.diameterX = maxX - minX;
+    m.diameterY = maxY - minY;
+    m.areaDiameter = (float)(2.0 * std::sqrt(area / PI));
+
+    // Radius against angle about the centroid, integrated with the
+    // trapezoid rule over each segment
+    std::vector<double> radius(n), angle(n);
+    for (size_t i = 0; i < n; ++i) {
+        double x = curve[i].x - m.centroidX, y = curve[i].y - m.centroidY;
+        radius[i] = std::sqrt(x * x + y * y);
+        angle[i] = std::atan2(y, x);
+    }
+    auto span = [&](size_t i) {
+        double d = std::remainder(angle[(i + 1) % n] - angle[i], 2.0 * PI);
+        return std::fabs(d);
+    };
+    double total = 0.0, sum = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        double w = span(i);
+        total += w;
+        sum += 0.5 * (radius[i] + radius[(i + 1) % n]) * w;
+    }
+    double mean = sum / total;
+    double variance = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        double a = radius[i] - mean, b = radius[(i + 1) % n] - mean;
+        variance += 0.5 * (a * a + b * b) * span(i);
+    }
+    m.ringRadius = (float)mean;
+    m.circularity = (float)(std::sqrt(variance / total) / mean);
+    m.valid = true;
+    return m;
+}
+
+// Edge curve and metrics of one view on the calling thread; kerr_cpu
+// --measure-shadow spreads the directions of many views over its pool
+inline ShadowMetrics measureShadow(const RenderParams& params, const ShadowMeasureSettings& settings,
+                                   std::vector<ShadowEdgePoint>& curve) {
+    curve.clear();
+    ShadowProbe probe = makeShadowProbe(params, settings);
+    if (!probe.valid) return ShadowMetrics();
+    for (int i = 0; i < settings.angles; ++i) curve.push_back(bisectShadowEdge(probe, i));
+    return shadowMetrics(curve);
+}
+
+} // namespace kerr
@@ -0,0 +1,493 @@
+/*
+ * Baked sky cubemap and binary star catalog
+ * C++17, header-only; include after the program's OpenGL declarations
+ * (GL/glew.h or gl_headless.h)
+ *
+ * KERR_SKY_CUBEMAP builds of blackhole_improved.comp colour an escaping
+ * ray with one filtered fetch from a cubemap instead of evaluating
+ * advancedStarfield. The cubemap is baked here once per run:
+ *
+ *   sky       the base sky, Milky Way haze and nebula of advancedStarfield,
+ *             evaluated at every texel centre
+ *   stars     point sources splatted as small Gaussians, from a star
+ *             catalog or, without one, a synthetic one; the sin() hash
+ *             stars of the shader alias and flicker as the camera moves
+ *   galaxies  faint extended sources at random positions
+ *
+ * Values are linear HDR radiance, stored as R11F_G11F_B10F with a mip
+ * chain built by 2x2 averaging on the host. A star deposits its flux
+ * divided by the texel's solid angle, so its integrated brightness is the
+ * same at every face size and on every part of a face.
+ *
+ * The starfield quality levels of the shader (KERR_STARFIELD) apply: 0 is
+ * the base sky only, 1 adds stars, 2 adds haze, galaxies and nebula.
+ *
+ * A star catalog is a StarCatalogHeader followed by count StarRecords:
+ * galactic longitude and latitude in radians, visual magnitude and B-V
+ * colour index, native byte order. It is memory-mapped and read once per
+ * face, so catalogs of millions of stars are never copied.
+ * Latitude 0 is the shader's galactic plane, y = 0.
+ */
+
+#pragma once
+
+#include "emission_lut.h"
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace kerr {
+
+constexpr char STAR_CATALOG_MAGIC[8] = {'K', 'E', 'R', 'R', 'S', 'T', 'A', 'R'};
+constexpr uint32_t STAR_CATALOG_VERSION = 1;
+
+constexpr int SKY_FACE_SIZE = 2048;             // default texels per cube face edge
+constexpr int SKY_FACE_SIZE_MAX = 4096;
+constexpr int SKY_REFERENCE_FACE = 1024;        // fluxes are in texels of this face size
+constexpr float STAR_MAG_UNIT = 5.0f;           // magnitude of a star of flux 1
+constexpr float STAR_SIGMA = 0.7f;              // star Gaussian, base level texels
+constexpr int SYNTHETIC_STARS = 60000;
+constexpr float SYNTHETIC_FAINTEST = 9.0f;      // magnitude limit of the synthetic catalog
+constexpr int SYNTHETIC_GALAXIES = 800;
+constexpr unsigned SKY_CUBEMAP_UNIT = 6;        // sampler binding in blackhole_improved.comp
+
+struct StarCatalogHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    uint64_t count;
+};
+
+struct StarRecord {
+    float longitude;            // radians
+    float latitude;             // radians, 0 in the galactic plane
+    float magnitude;            // visual
+    float colorIndex;           // B-V
+};
+
+static_assert(sizeof(StarCatalogHeader) == 24, "star catalog header layout");
+static_assert(sizeof(StarRecord) == 16, "star record layout");
+
+// A memory-mapped star catalog file
+class StarCatalog {
+public:
+    // false if path is missing or not a catalog of this format version
+    bool open(const std::string& path) {
+        close();
+        if (!file.open(path)) return false;
+        StarCatalogHeader h;
+        if (file.size() < sizeof(h)) return fail(path, "too short");
+        std::memcpy(&h, file.data(), sizeof(h));
+        if (std::memcmp(h.magic, STAR_CATALOG_MAGIC, sizeof(h.magic)) != 0 ||
+            h.version != STAR_CATALOG_VERSION || h.recordSize != sizeof(StarRecord)) {
+            return fail(path, "not a version 1 star catalog");
+        }
+        if (h.count > (file.size() - sizeof(h)) / sizeof(StarRecord)) return fail(path, "truncated");
+        records = reinterpret_cast<const StarRecord*>(static_cast<const char*>(file.data()) + sizeof(h));
+        count = (size_t)h.count;
+        return true;
+    }
+
+    void close() {
+        file.close();
+        records = nullptr;
+        count = 0;
+    }
+
+    const StarRecord* data() const { return records; }
+    size_t size() const { return count; }
+
+private:
+    bool fail(const std::string& path, const char* why) {
+        std::cerr << "Star catalog " << path << ": " << why << std::endl;
+        close();
+        return false;
+    }
+
+    MappedFile file;
+    const StarRecord* records = nullptr;
+    size_t count = 0;
+};
+
+inline bool writeStarCatalog(const std::string& path, const std::vector<StarRecord>& stars) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        std::cerr << "Cannot write " << path << std::endl;
+        return false;
+    }
+    StarCatalogHeader h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, STAR_CATALOG_MAGIC, sizeof(h.magic));
+    h.version = STAR_CATALOG_VERSION;
+    h.recordSize = sizeof(StarRecord);
+    h.count = stars.size();
+    out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    out.write(reinterpret_cast<const char*>(stars.data()), (std::streamsize)(stars.size() * sizeof(StarRecord)));
+    return (bool)out;
+}
+
+// Random stars with roughly the sky's statistics: counts growing about
+// threefold per magnitude down to faintest, concentrated towards the
+// galactic plane, colours from blue giants to red dwarfs
+inline std::vector<StarRecord> syntheticStars(int count, float faintest, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    std::vector<StarRecord> stars((size_t)std::max(0, count));
+    for (StarRecord& s : stars) {
+        s.longitude = TWO_PI * uniform(rng);
+        float z = 2.0f * uniform(rng) - 1.0f;
+        if (uniform(rng) < 0.4f) z = z * z * z;
+        s.latitude = std::asin(z);
+        s.magnitude = std::max(-1.5f, faintest + std::log10(std::max(uniform(rng), 1e-9f)) / 0.45f);
+        float c = uniform(rng);
+        s.colorIndex = -0.3f + 2.0f * c * std::sqrt(c);
+    }
+    return stars;
+}
+
+// B-V colour index to effective temperature (Ballesteros 2012)
+inline double colorIndexKelvin(double bv) {
+    return 4600.0 * (1.0 / (0.92 * bv + 1.7) + 1.0 / (0.92 * bv + 0.62));
+}
+
+// Direction of a texel centre, or of face coordinates sc, tc in [-1, 1],
+// in the face order and orientation of GL cube maps (+X -X +Y -Y +Z -Z)
+inline Vec3 cubeFaceDirection(int face, float sc, float tc) {
+    switch (face) {
+        case 0: return {1.0f, -tc, -sc};
+        case 1: return {-1.0f, -tc, sc};
+        case 2: return {sc, 1.0f, tc};
+        case 3: return {sc, -1.0f, -tc};
+        case 4: return {sc, -tc, 1.0f};
+        default: return {-sc, -tc, -1.0f};
+    }
+}
+
+// Face coordinates of dir on face, extended past the face edge; false if
+// dir points away from the face
+inline bool cubeFaceCoords(int face, Vec3 d, float& sc, float& tc) {
+    float ma;
+    switch (face) {
+        case 0: ma = d.x; sc = -d.z; tc = -d.y; break;
+        case 1: ma = -d.x; sc = d.z; tc = -d.y; break;
+        case 2: ma = d.y; sc = d.x; tc = d.z; break;
+        case 3: ma = -d.y; sc = d.x; tc = -d.z; break;
+        case 4: ma = d.z; sc = d.x; tc = -d.y; break;
+        default: ma = -d.z; sc = -d.x; tc = -d.y; break;
+    }
+    if (ma <= 1e-6f) return false;
+    sc /= ma;
+    tc /= ma;
+    return true;
+}
+
+// Diffuse part of advancedStarfield (blackhole_improved.comp)
+inline Vec3 skyRadiance(Vec3 dir, int quality) {
+    Vec3 color{0.005f, 0.005f, 0.01f};
+    if (quality < 2) return color;
+    float haze = std::pow(std::max(0.0f, 1.0f - std::abs(dir.y) * 2.0f), 4.0f) * 0.15f;
+    if (haze > 0.0f) {
+        haze *= 0.5f + 0.5f * (std::sin(std::atan2(dir.z, dir.x) * 8.0f) * 0.5f + 0.5f);
+        color = color + Vec3{haze * 0.6f, haze * 0.7f, haze * 0.9f};
+    }
+    float nebula = smoothstep(0.3f, 0.8f, std::sin(dir.x * 5.0f + dir.y * 3.0f) *
+                                          std::sin(dir.z * 4.0f + dir.y * 6.0f)) * 0.1f;
+    return color + Vec3{nebula * 0.8f, nebula * 0.4f, nebula * 0.6f};
+}
+
+// What the baked sky depends on
+struct SkySettings {
+    int faceSize = SKY_FACE_SIZE;
+    int quality = 2;                // KERR_STARFIELD
+    std::string catalog;            // star catalog file, "" = synthetic stars
+    int syntheticStars = SYNTHETIC_STARS;
+
+    bool operator==(const SkySettings& o) const {
+        return faceSize == o.faceSize && quality == o.quality && catalog == o.catalog &&
+               syntheticStars == o.syntheticStars;
+    }
+    bool operator!=(const SkySettings& o) const { return !(*this == o); }
+};
+
+struct SkyBakeStats {
+    uint64_t stars = 0;             // catalog or synthetic stars
+    double skySeconds = 0.0;        // diffuse sky
+    double starSeconds = 0.0;       // stars, galaxies and mip chain
+    double uploadSeconds = 0.0;
+    size_t bytes = 0;               // GPU storage of all levels
+};
+
+// One face of the sky, RGB floats, row t = 0 first
+class SkyFaceBaker {
+public:
+    SkyFaceBaker(const SkySettings& settings, const StarRecord* stars, size_t starCount)
+        : cfg(settings), catalog(stars), catalogSize(starCount) {
+        // Star colours by B-V, -0.4 .. 2.0 in COLOR_BINS steps
+        for (int i = 0; i < COLOR_BINS; ++i) {
+            colors[i] = blackbodyColor(colorIndexKelvin(-0.4 + 2.4 * i / (COLOR_BINS - 1)));
+        }
+        if (cfg.quality >= 2) {
+            std::vector<StarRecord> g = syntheticStars(SYNTHETIC_GALAXIES, 11.0f, 0x6a1a7u);
+            for (const StarRecord& s : g) {
+                galaxies.push_back({starDirection(s), std::pow(10.0f, -0.4f * (s.magnitude - 7.0f))});
+            }
+        }
+
+        // One pass over the catalog sorts the stars by the faces their
+        // footprints reach, so each face reads only its own
+        if (cfg.quality >= 1) {
+            float margin = 6.0f * STAR_SIGMA / (float)cfg.faceSize;
+            for (size_t i = 0; i < catalogSize; ++i) {
+                Vec3 dir = starDirection(catalog[i]);
+                for (int face = 0; face < 6; ++face) {
+                    float sc, tc;
+                    if (cubeFaceCoords(face, dir, sc, tc) && std::abs(sc) <= 1.0f + margin &&
+                        std::abs(tc) <= 1.0f + margin) {
+                        faceStars[face].push_back((uint32_t)i);
+                    }
+                }
+            }
+        }
+    }
+
+    int size() const { return cfg.faceSize; }
+
+    void bakeSky(int face, std::vector<float>& rgb) const {
+        int n = cfg.faceSize;
+        rgb.assign((size_t)n * n * 3, 0.0f);
+        unsigned threads = std::max(1u, std::min(16u, std::thread::hardware_concurrency()));
+        std::vector<std::thread> workers;
+        for (unsigned w = 0; w < threads; ++w) {
+            workers.emplace_back([&, w] {
+                for (int t = (int)w; t < n; t += (int)threads) {
+                    float tc = 2.0f * ((float)t + 0.5f) / (float)n - 1.0f;
+                    float* row = &rgb[(size_t)t * n * 3];
+                    for (int s = 0; s < n; ++s) {
+                        float sc = 2.0f * ((float)s + 0.5f) / (float)n - 1.0f;
+                        Vec3 c = skyRadiance(normalize(cubeFaceDirection(face, sc, tc)), cfg.quality);
+                        row[s * 3 + 0] = c.x;
+                        row[s * 3 + 1] = c.y;
+                        row[s * 3 + 2] = c.z;
+                    }
+                }
+            });
+        }
+        for (std::thread& worker : workers) worker.join();
+    }
+
+    // Adds every star and galaxy whose footprint reaches the face
+    void splatStars(int face, std::vector<float>& rgb) const {
+        if (cfg.quality < 1) return;
+        for (uint32_t i : faceStars[face]) {
+            const StarRecord& s = catalog[i];
+            float flux = std::pow(10.0f, -0.4f * (s.magnitude - STAR_MAG_UNIT));
+            float bv = std::min(2.0f, std::max(-0.4f, s.colorIndex));
+            int bin = (int)std::lround((bv + 0.4f) / 2.4f * (COLOR_BINS - 1));
+            splat(face, starDirection(s), colors[bin] * flux, STAR_SIGMA, rgb);
+        }
+        float scale = (float)cfg.faceSize / (float)SKY_REFERENCE_FACE;
+        for (const Galaxy& g : galaxies) {
+            splat(face, g.dir, Vec3{0.3f, 0.35f, 0.4f} * g.flux, 2.5f * scale, rgb);
+        }
+    }
+
+private:
+    static constexpr int COLOR_BINS = 256;
+    static constexpr int SPLAT_WIDTH_MAX = 64;     // texels; wider galaxies are cut off
+
+    struct Galaxy {
+        Vec3 dir;
+        float flux;
+    };
+
+    static Vec3 starDirection(const StarRecord& s) {
+        float c = std::cos(s.latitude);
+        return {c * std::cos(s.longitude), std::sin(s.latitude), c * std::sin(s.longitude)};
+    }
+
+    // Adds a Gaussian of sigma texels carrying flux reference-face texels
+    void splat(int face, Vec3 dir, Vec3 flux, float sigma, std::vector<float>& rgb) const {
+        float sc, tc;
+        if (!cubeFaceCoords(face, dir, sc, tc)) return;
+        int n = cfg.faceSize;
+        float radius = 3.0f * sigma;
+        float margin = 2.0f * radius / (float)n;
+        if (std::abs(sc) > 1.0f + margin || std::abs(tc) > 1.0f + margin) return;
+
+        // Texel solid angle here relative to the reference face's centre
+        float d2 = 1.0f + sc * sc + tc * tc;
+        float ratio = (float)n / (float)SKY_REFERENCE_FACE;
+        Vec3 total = flux * (ratio * ratio * d2 * std::sqrt(d2));
+
+        float x = (sc + 1.0f) * 0.5f * (float)n - 0.5f;
+        float y = (tc + 1.0f) * 0.5f * (float)n - 0.5f;
+        int x0 = std::max(0, (int)std::ceil(x - radius)), x1 = std::min(n - 1, (int)std::floor(x + radius));
+        int y0 = std::max(0, (int)std::ceil(y - radius)), y1 = std::min(n - 1, (int)std::floor(y + radius));
+        if (x1 < x0 || y1 < y0) return;
+
+        // The Gaussian is separable: one weight per column and per row
+        float k = 1.0f / (2.0f * sigma * sigma);
+        float wx[SPLAT_WIDTH_MAX], wy[SPLAT_WIDTH_MAX];
+        x1 = std::min(x1, x0 + SPLAT_WIDTH_MAX - 1);
+        y1 = std::min(y1, y0 + SPLAT_WIDTH_MAX - 1);
+        for (int tx = x0; tx <= x1; ++tx) wx[tx - x0] = std::exp(-((float)tx - x) * ((float)tx - x) * k);
+        for (int ty = y0; ty <= y1; ++ty) wy[ty - y0] = std::exp(-((float)ty - y) * ((float)ty - y) * k) * (k / PI);
+        for (int ty = y0; ty <= y1; ++ty) {
+            Vec3 row = total * wy[ty - y0];
+            float* texel = &rgb[((size_t)ty * n + x0) * 3];
+            for (int tx = x0; tx <= x1; ++tx, texel += 3) {
+                float w = wx[tx - x0];
+                texel[0] += row.x * w;
+                texel[1] += row.y * w;
+                texel[2] += row.z * w;
+            }
+        }
+    }
+
+    SkySettings cfg;
+    const StarRecord* catalog;
+    size_t catalogSize;
+    Vec3 colors[COLOR_BINS];
+    std::vector<Galaxy> galaxies;
+    std::vector<uint32_t> faceStars[6];
+};
+
+// The baked sky as a mipmapped cube map on SKY_CUBEMAP_UNIT
+class SkyCubemap {
+public:
+    // Bakes and uploads the sky for settings; keeps the current cube map
+    // and returns false if the catalog cannot be read
+    bool bake(const SkySettings& settings, SkyBakeStats* stats = nullptr) {
+        using clock = std::chrono::steady_clock;
+        auto seconds = [](clock::time_point start) {
+            return std::chrono::duration<double>(clock::now() - start).count();
+        };
+        SkySettings cfg = settings;
+        cfg.faceSize = std::max(16, std::min(SKY_FACE_SIZE_MAX, cfg.faceSize));
+
+        StarCatalog file;
+        std::vector<StarRecord> synthetic;
+        const StarRecord* stars = nullptr;
+        size_t starCount = 0;
+        if (!cfg.catalog.empty()) {
+            if (!file.open(cfg.catalog)) return false;
+            stars = file.data();
+            starCount = file.size();
+        } else {
+            synthetic = syntheticStars(cfg.syntheticStars, SYNTHETIC_FAINTEST, 0x5747u);
+            stars = synthetic.data();
+            starCount = synthetic.size();
+        }
+
+        SkyBakeStats st;
+        if (!texture) glGenTextures(1, &texture);
+        int levels = 1;
+        while ((cfg.faceSize >> levels) > 0) levels++;
+        glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+        if (cfg.faceSize != storageSize) {
+            // Immutable storage cannot be resized: start over with a new name
+            if (storageSize) {
+                glDeleteTextures(1, &texture);
+                glGenTextures(1, &texture);
+                glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+            }
+            glTexStorage2D(GL_TEXTURE_CUBE_MAP, levels, GL_R11F_G11F_B10F, cfg.faceSize, cfg.faceSize);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+            storageSize = cfg.faceSize;
+        }
+
+        auto sortStart = clock::now();
+        SkyFaceBaker baker(cfg, stars, starCount);
+        st.stars = cfg.quality >= 1 ? starCount : 0;
+        st.starSeconds += seconds(sortStart);
+        std::vector<float> level, next;
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        for (int face = 0; face < 6; ++face) {
+            auto start = clock::now();
+            baker.bakeSky(face, level);
+            st.skySeconds += seconds(start);
+            start = clock::now();
+            baker.splatStars(face, level);
+            st.starSeconds += seconds(start);
+
+            // Each level of the face, then the next by 2x2 averaging
+            for (int l = 0, n = cfg.faceSize; l < levels; ++l, n /= 2) {
+                start = clock::now();
+                glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, l, 0, 0, n, n, GL_RGB, GL_FLOAT, level.data());
+                st.uploadSeconds += seconds(start);
+                if (n == 1) break;
+                start = clock::now();
+                int h = n / 2;
+                next.assign((size_t)h * h * 3, 0.0f);
+                for (int y = 0; y < h; ++y) {
+                    const float* a = &level[(size_t)(2 * y) * n * 3];
+                    const float* b = a + (size_t)n * 3;
+                    float* out = &next[(size_t)y * h * 3];
+                    for (int x = 0; x < h; ++x) {
+                        for (int c = 0; c < 3; ++c) {
+                            int i = x * 6 + c;
+                            out[x * 3 + c] = 0.25f * (a[i] + a[i + 3] + b[i] + b[i + 3]);
+                        }
+                    }
+                }
+                level.swap(next);
+                st.starSeconds += seconds(start);
+            }
+        }
+        for (int l = 0; l < levels; ++l) {
+            size_t n = (size_t)(cfg.faceSize >> l);
+            st.bytes += 6 * n * n * 4;
+        }
+        current = cfg;
+        baked = true;
+        storageBytes = st.bytes;
+        if (stats) *stats = st;
+        return true;
+    }
+
+    // Bakes only if settings differ from the baked sky; true if it did
+    bool update(const SkySettings& settings, SkyBakeStats* stats = nullptr) {
+        if (baked && settings == current) return false;
+        return bake(settings, stats);
+    }
+
+    bool valid() const { return baked; }
+
+    void bind() const {
+        glActiveTexture(GL_TEXTURE0 + SKY_CUBEMAP_UNIT);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    size_t bytes() const { return baked ? storageBytes : 0; }
+
+    void destroy() {
+        if (texture) glDeleteTextures(1, &texture);
+        texture = 0;
+        storageSize = 0;
+        baked = false;
+    }
+
+private:
+    GLuint texture = 0;
+    int storageSize = 0;
+    size_t storageBytes = 0;
+    SkySettings current;
+    bool baked = false;
+};
+
+} // namespace kerr
@@ -0,0 +1,154 @@
+/*
+ * Work-stealing tile scheduler for the CPU renderer
+ * C++17, header-only
+ *
+ * Tiles are dealt round-robin into one deque per worker. A worker pops
+ * from the back of its own deque and, when that runs dry, steals from the
+ * front of another worker's deque. Tiles around the photon ring take far
+ * more integration steps than sky tiles, so static partitioning leaves
+ * most cores idle at the end of a frame; stealing keeps them busy.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkStealingPool {
+public:
+    using Job = std::function<void(int task, unsigned worker)>;
+
+    // threadCount includes the calling thread; 0 selects hardware concurrency
+    explicit WorkStealingPool(unsigned threadCount = 0) {
+        if (threadCount == 0) threadCount = std::thread::hardware_concurrency();
+        if (threadCount == 0) threadCount = 1;
+
+        for (unsigned i = 0; i < threadCount; ++i) {
+            queues.push_back(std::make_unique<WorkerQueue>());
+        }
+        for (unsigned i = 1; i < threadCount; ++i) {
+            workers.emplace_back(&WorkStealingPool::workerLoop, this, i);
+        }
+    }
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            stopping = true;
+        }
+        wakeCondition.notify_all();
+        for (std::thread& worker : workers) worker.join();
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    unsigned size() const { return (unsigned)queues.size(); }
+
+    // Number of tasks taken from another worker's queue during the last run()
+    uint64_t lastStealCount() const { return steals.load(); }
+
+    // Run job(task, worker) for every task in [0, taskCount) and block until
+    // all of them have finished. The calling thread works as worker 0.
+    void run(int taskCount, const Job& job) {
+        if (taskCount <= 0) return;
+
+        // The job pointer is published before any queue is filled; workers
+        // only read it after taking a task under that queue's mutex.
+        currentJob = &job;
+        steals = 0;
+        remaining = taskCount;
+
+        unsigned n = size();
+        for (unsigned w = 0; w < n; ++w) {
+            std::lock_guard<std::mutex> lock(queues[w]->mutex);
+            for (int task = (int)w; task < taskCount; task += (int)n) {
+                queues[w]->tasks.push_back(task);
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            ++generation;
+        }
+        wakeCondition.notify_all();
+
+        drain(0);
+
+        std::unique_lock<std::mutex> lock(stateMutex);
+        doneCondition.wait(lock, [this] { return remaining.load() == 0; });
+    }
+
+private:
+    struct alignas(64) WorkerQueue {
+        std::mutex mutex;
+        std::deque<int> tasks;
+    };
+
+    void workerLoop(unsigned index) {
+        uint64_t seenGeneration = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(stateMutex);
+                wakeCondition.wait(lock, [&] { return stopping || generation != seenGeneration; });
+                if (stopping) return;
+                seenGeneration = generation;
+            }
+            drain(index);
+        }
+    }
+
+    void drain(unsigned index) {
+        int task;
+        while (popLocal(index, task) || steal(index, task)) {
+            (*currentJob)(task, index);
+            if (remaining.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> lock(stateMutex);
+                doneCondition.notify_all();
+            }
+        }
+    }
+
+    bool popLocal(unsigned index, int& task) {
+        WorkerQueue& q = *queues[index];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (q.tasks.empty()) return false;
+        task = q.tasks.back();
+        q.tasks.pop_back();
+        return true;
+    }
+
+    bool steal(unsigned thief, int& task) {
+        unsigned n = size();
+        for (unsigned offset = 1; offset < n; ++offset) {
+            WorkerQueue& victim = *queues[(thief + offset) % n];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.tasks.empty()) continue;
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+            steals.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex stateMutex;
+    std::condition_variable wakeCondition;
+    std::condition_variable doneCondition;
+    uint64_t generation = 0;
+    bool stopping = false;
+
+    const Job* currentJob = nullptr;
+    std::atomic<int> remaining{0};
+    std::atomic<uint64_t> steals{0};
+};
@@ -0,0 +1,254 @@
+/*
+ * Wavefront scheduling for the SIMD packet integrator
+ * C++17, header-only
+ *
+ * traceRayPacket keeps a packet together until its slowest lane is done,
+ * so a lane that escapes after 40 steps sits masked off while a
+ * photon-ring lane in the same packet runs to the step budget. The
+ * wavefront tracer keeps its rays in a queue instead. Each wave advances
+ * every queued ray by at most batchSteps step attempts, packing the queue
+ * into packets in order, then compacts the rays that are still alive to
+ * the front of the queue. The next wave therefore packs survivors densely,
+ * and a packet never waits for more than batchSteps attempts on a lane
+ * that has finished.
+ *
+ * While integrating, rays only record their lensing sample (disk hits and
+ * fate). Colours are shaded from the samples in a separate pass
+ * (kerr::shadePixel), which gives the same result as traceRayPacket.
+ *
+ * WaveStats counts, per wave, the rays in the queue and the share of lane
+ * slots that advanced a live ray.
+ */
+
+#pragma once
+
+#include "kerr_simd.h"
+
+#include <algorithm>
+#include <bitset>
+#include <cstdint>
+#include <vector>
+
+namespace kerr {
+namespace simd {
+
+constexpr int WAVE_STEPS = 32;          // default step attempts per wave
+
+// A ray in the wavefront queue
+struct WavefrontRay {
+    float pos[4], vel[4];
+    float lambda = 0.0f;                // Lz / E, for the disk redshift
+    StepController control;
+    StepCounts steps;
+    FarField far;
+    int bounces = 0;
+    int index = 0;                      // caller's ray index
+    bool done = false;
+};
+
+struct WaveStats {
+    uint64_t rays = 0;                  // rays in the queue at the start of the wave
+    uint64_t packets = 0;
+    uint64_t laneSlots = 0;             // packet iterations x WIDTH
+    uint64_t laneSteps = 0;             // step attempts of live rays
+
+    double utilization() const { return laneSlots ? (double)laneSteps / (double)laneSlots : 0.0; }
+
+    WaveStats& operator+=(const WaveStats& o) {
+        rays += o.rays;
+        packets += o.packets;
+        laneSlots += o.laneSlots;
+        laneSteps += o.laneSteps;
+        return *this;
+    }
+};
+
+inline int laneCount(MaskPack m) { return (int)std::bitset<32>(m.bits()).count(); }
+
+// Up to batchSteps step attempts for rays[0 .. n), n <= WIDTH, with the
+// loop body of traceRayPacket minus the shading. Rays that finish are
+// marked done; the others keep their state for the next wave.
+inline void advanceWavePacket(WavefrontRay* rays, int n, float spin, int maxBounces, const StepTolerances& tol,
+                              float farFieldRadius, int batchSteps, LensingSample* samples, WaveStats& stats) {
+    float pos[4][WIDTH] = {}, vel[4][WIDTH] = {}, h0[WIDTH] = {};
+    StepController control[WIDTH];
+    StepCounts steps[WIDTH];
+    uint32_t farBits = 0;
+    for (int i = 0; i < n; ++i) {
+        for (int k = 0; k < 4; ++k) {
+            pos[k][i] = rays[i].pos[k];
+            vel[k][i] = rays[i].vel[k];
+        }
+        control[i] = rays[i].control;
+        steps[i] = rays[i].steps;
+        h0[i] = control[i].h;
+        farBits |= rays[i].far.valid ? 1u << i : 0u;
+    }
+
+    PacketState st;
+    for (int k = 0; k < 4; ++k) {
+        st.pos[k] = FloatPack::load(pos[k]);
+        st.vel[k] = FloatPack::load(vel[k]);
+    }
+
+    const FloatPack a(spin);
+    const FloatPack horizonLimit(eventHorizon(spin) * 1.01f);
+    const FloatPack escapeRadius(ESCAPE_RADIUS);
+    const FloatPack halfPi(PI / 2.0f);
+    const FloatPack zero(0.0f);
+    const FloatPack farRadius(farFieldRadius);
+    const MaskPack farLanes = MaskPack::fromBits(farBits);
+    FloatPack h = FloatPack::load(h0);
+
+    auto escape = [&](int i, float theta, float phi) {
+        LensingSample& s = samples[rays[i].index];
+        s.fate = RayFate::Escaped;
+        s.escapeTheta = theta;
+        s.escapePhi = phi;
+    };
+
+    MaskPack active = MaskPack::fromBits(n >= WIDTH ? (1u << WIDTH) - 1u : (1u << n) - 1u);
+    stats.packets++;
+    for (int attempt = 0; attempt < batchSteps && active.any(); attempt++) {
+        stats.laneSlots += WIDTH;
+        stats.laneSteps += (uint64_t)laneCount(active);
+
+        PacketState prev = st;
+        FloatPack errPos[4], errVel[4];
+        rk5Step(st, a, select(active, h, zero), errPos, errVel);
+        FloatPack error = scaledStepError(prev, st, errPos, errVel, tol);
+
+        MaskPack accepted = updateControllers(control, active, error, steps, h);
+        for (int k = 0; k < 4; ++k) {
+            st.pos[k] = select(accepted, st.pos[k], prev.pos[k]);
+            st.vel[k] = select(accepted, st.vel[k], prev.vel[k]);
+        }
+
+        FloatPack r = st.pos[1];
+        MaskPack horizon = accepted & (r < horizonLimit);
+        MaskPack leaving = accepted & farLanes & (prev.pos[1] > farRadius) & (st.vel[1] > zero);
+        MaskPack escaped = accepted & ~horizon & ~leaving & (r > escapeRadius);
+        active = active & ~(horizon | escaped | leaving);
+
+        if (leaving.any()) {
+            uint32_t bits = leaving.bits();
+            for (int i = 0; i < WIDTH; ++i) {
+                if (!(bits >> i & 1u)) continue;
+                // theta may have run through a pole, see kerr::traceRay
+                float theta = lane(st.pos[2], i), sinTheta = std::sin(theta), th, ph;
+                farFieldEscape(rays[i].far, farFieldRadius, lane(r, i), std::cos(theta),
+                               lane(st.pos[3], i) + (sinTheta < 0.0f ? PI : 0.0f), -sinTheta * lane(st.vel[2], i), th, ph);
+                escape(i, th, ph);
+            }
+        }
+
+        if (escaped.any()) {
+            uint32_t bits = escaped.bits();
+            for (int i = 0; i < WIDTH; ++i) {
+                if (bits >> i & 1u) escape(i, lane(st.pos[2], i), lane(st.pos[3], i));
+            }
+        }
+
+        // Equatorial crossings: theta passes pi/2 on an accepted lane
+        MaskPack crossed = active & accepted & (((prev.pos[2] - halfPi) * (st.pos[2] - halfPi)) <= zero);
+        if (crossed.any()) {
+            uint32_t bits = crossed.bits();
+            uint32_t finished = 0;
+            for (int i = 0; i < WIDTH; ++i) {
+                if (!(bits >> i & 1u)) continue;
+                float diskR, diskPhi;
+                if (!crossDisk(lane(prev.pos[1], i), std::cos(lane(prev.pos[2], i)), lane(prev.pos[3], i),
+                               lane(st.pos[1], i), std::cos(lane(st.pos[2], i)), lane(st.pos[3], i),
+                               diskR, diskPhi)) continue;
+                samples[rays[i].index].addHit(diskR, diskPhi, diskRedshift(diskR, spin, rays[i].lambda));
+                if (++rays[i].bounces >= maxBounces) finished |= 1u << i;
+            }
+            active = active & ~MaskPack::fromBits(finished);
+        }
+
+        uint32_t blackBits = horizon.bits();
+        for (int i = 0; i < WIDTH; ++i) {
+            if (blackBits >> i & 1u) samples[rays[i].index].fate = RayFate::Horizon;
+        }
+
+        // The step budget of traceRayPacket, counted per ray across waves
+        uint32_t exhausted = 0, activeBits = active.bits();
+        for (int i = 0; i < n; ++i) {
+            if ((activeBits >> i & 1u) && steps[i].attempts() >= MAX_STEPS) exhausted |= 1u << i;
+        }
+        active = active & ~MaskPack::fromBits(exhausted);
+    }
+
+    for (int k = 0; k < 4; ++k) {
+        st.pos[k].store(pos[k]);
+        st.vel[k].store(vel[k]);
+    }
+    uint32_t activeBits = active.bits();
+    for (int i = 0; i < n; ++i) {
+        for (int k = 0; k < 4; ++k) {
+            rays[i].pos[k] = pos[k][i];
+            rays[i].vel[k] = vel[k][i];
+        }
+        rays[i].control = control[i];
+        rays[i].steps = steps[i];
+        rays[i].done = !(activeBits >> i & 1u);
+    }
+}
+
+// Lensing samples and step counts of count rays sharing one origin, traced
+// in waves of batchSteps step attempts. waves[k] accumulates the
+// statistics of wave k and grows as needed. farFieldRadius > 0 starts and
+// ends every ray at that sphere as traceRayPacket does.
+inline void traceWavefront(Vec3 rayOrigin, const Vec3* rayDirs, int count, float spin, int maxBounces,
+                           const StepTolerances& tol, float farFieldRadius, int batchSteps,
+                           LensingSample* samples, StepCounts* steps, std::vector<WaveStats>& waves) {
+    std::vector<WavefrontRay> queue;
+    queue.reserve((size_t)count);
+    for (int i = 0; i < count; ++i) {
+        samples[i] = LensingSample{};
+        steps[i] = StepCounts{};
+        Vec3 origin = rayOrigin, dir = rayDirs[i];
+        WavefrontRay ray;
+        FarFieldPoint farPoint;
+        FarFieldPath farPath = farFieldRadius > 0.0f
+            ? farFieldStart(origin, dir, spin, farFieldRadius, ray.far, farPoint) : FarFieldPath::Traced;
+        if (farPath == FarFieldPath::Escaped) {
+            samples[i].fate = RayFate::Escaped;
+            samples[i].escapeTheta = std::acos(farPoint.u);
+            samples[i].escapePhi = farPoint.phi;
+            continue;
+        }
+        RayState state = launchRay(origin, dir, spin);
+        const float* p = &state.pos.x;
+        const float* v = &state.vel.x;
+        for (int k = 0; k < 4; ++k) {
+            ray.pos[k] = p[k];
+            ray.vel[k] = v[k];
+        }
+        ray.lambda = state.Lz / state.E;
+        ray.control.h = farPath == FarFieldPath::Entered ? FAR_FIELD_STEP * farFieldRadius : STEP_INITIAL_AFFINE;
+        ray.index = i;
+        queue.push_back(ray);
+    }
+
+    for (size_t wave = 0; !queue.empty(); ++wave) {
+        if (waves.size() <= wave) waves.resize(wave + 1);
+        WaveStats& stats = waves[wave];
+        stats.rays += queue.size();
+        for (size_t k = 0; k < queue.size(); k += WIDTH) {
+            int n = (int)std::min<size_t>(WIDTH, queue.size() - k);
+            advanceWavePacket(&queue[k], n, spin, maxBounces, tol, farFieldRadius, batchSteps, samples, stats);
+        }
+
+        // Stream compaction: finished rays hand back their step counts and
+        // leave the queue; the rest keep their order
+        for (const WavefrontRay& ray : queue) {
+            if (ray.done) steps[ray.index] = ray.steps;
+        }
+        queue.erase(std::remove_if(queue.begin(), queue.end(), [](const WavefrontRay& ray) { return ray.done; }),
+                    queue.end());
+    }
+}
+
+} // namespace simd
+} // namespace kerr